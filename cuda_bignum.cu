@@ -7,11 +7,17 @@
  */
 
 #include "cuda_bignum.h"
+#include "ntt_mul.h"
+#include "div_mod.h"
 
 #ifndef MAX
 #define MAX(a,b) (a > b ? a : b)
 #endif
 
+#ifndef MIN
+#define MIN(a,b) (a < b ? a : b)
+#endif
+
 char *strrev(char *str){
       char *p1, *p2;
 
@@ -26,6 +32,146 @@ char *strrev(char *str){
       return str;
 }
 
+static __thread U_BN_POOL cu_bn_pool_tls;
+
+int cu_bn_pool_init(unsigned key_size){
+
+    U_BN_POOL *pool = &cu_bn_pool_tls;
+    size_t bytes;
+
+    cu_bn_pool_release();
+
+    pool->limbs = ((key_size + CU_BN_BITS2 - 1) / CU_BN_BITS2) + 2;
+    bytes = (sizeof(U_BN) + pool->limbs * sizeof(unsigned) + CU_BN_BYTES * pool->limbs + CU_BN_POOL_ALIGN);
+    bytes *= CU_BN_POOL_TEMPORARIES;
+
+    if ((pool->base = (unsigned char *)malloc(bytes)) == NULL)
+        return 0;
+    if ((pool->ctx = BN_CTX_new()) == NULL) {
+        free(pool->base);
+        pool->base = NULL;
+        return 0;
+    }
+    pool->size = bytes;
+    pool->high = bytes;
+    return (1);
+
+}
+
+void cu_bn_pool_release(void){
+
+    U_BN_POOL *pool = &cu_bn_pool_tls;
+
+    cu_bn_pool_reset();
+    if (pool->base != NULL)
+        free(pool->base);
+    if (pool->ctx != NULL)
+        BN_CTX_free(pool->ctx);
+    memset(pool, 0, sizeof(*pool));
+
+}
+
+void cu_bn_pool_reset(void){
+
+    U_BN_POOL *pool = &cu_bn_pool_tls;
+    void **block;
+    unsigned char *base;
+
+    while (pool->overflow != NULL) {
+        block = (void **)pool->overflow;
+        pool->overflow = block[0];
+        free(block);
+    }
+
+    /* an overflowing pair means the arena was sized too small, grow it once */
+    if (pool->used + pool->spilled > pool->high)
+        pool->high = pool->used + pool->spilled;
+    if (pool->high > pool->size && (base = (unsigned char *)malloc(pool->high)) != NULL) {
+        free(pool->base);
+        pool->base = base;
+        pool->size = pool->high;
+    }
+    pool->used = 0;
+    pool->spilled = 0;
+
+}
+
+U_BN_POOL *cu_bn_pool_get(void){
+
+    U_BN_POOL *pool = &cu_bn_pool_tls;
+
+    if (NULL == pool->base)
+        cu_bn_pool_init(CU_BN_POOL_DEFAULT_BITS);
+    return (pool);
+
+}
+
+void *cu_bn_pool_alloc(size_t bytes){
+
+    U_BN_POOL *pool = cu_bn_pool_get();
+    unsigned char *p;
+    void **block;
+
+    bytes = (bytes + CU_BN_POOL_ALIGN - 1) & ~((size_t)CU_BN_POOL_ALIGN - 1);
+
+    if (pool->base != NULL && pool->used + bytes <= pool->size) {
+        p = pool->base + pool->used;
+        pool->used += bytes;
+        return (p);
+    }
+
+    /* arena exhausted, chain a block that is freed by the next reset */
+    if ((block = (void **)malloc(sizeof(void *) + bytes)) == NULL)
+        return (NULL);
+    block[0] = pool->overflow;
+    pool->overflow = block;
+    pool->spilled += bytes;
+    return (block + 1);
+
+}
+
+U_BN *cu_bn_pool_new(void){
+
+    U_BN_POOL *pool = cu_bn_pool_get();
+    U_BN *ret;
+
+    if ((ret = (U_BN *)cu_bn_pool_alloc(sizeof(*ret))) == NULL)
+        return (NULL);
+    if ((ret->d = (unsigned *)cu_bn_pool_alloc(pool->limbs * sizeof(unsigned))) == NULL)
+        return (NULL);
+    memset(ret->d, 0, pool->limbs * sizeof(unsigned));
+    ret->top = 1;
+    return (ret);
+
+}
+
+U_BN *cu_bn_pool_dup(const U_BN *a){
+
+    U_BN_POOL *pool = cu_bn_pool_get();
+    U_BN *ret;
+    int words;
+
+    if(NULL == a || NULL == a->d)
+        return (NULL);
+
+    words = MAX((int)pool->limbs, a->top + 2);
+    if ((ret = (U_BN *)cu_bn_pool_alloc(sizeof(*ret))) == NULL)
+        return (NULL);
+    if ((ret->d = (unsigned *)cu_bn_pool_alloc(words * sizeof(unsigned))) == NULL)
+        return (NULL);
+    memcpy(ret->d, a->d, a->top * sizeof(unsigned));
+    memset(ret->d + a->top, 0, (words - a->top) * sizeof(unsigned));
+    ret->top = a->top;
+    return (ret);
+
+}
+
+BN_CTX *cu_bn_pool_ctx(void){
+
+    return (cu_bn_pool_get()->ctx);
+
+}
+
 U_BN *cu_bn_new(void)
 {
     U_BN *ret;
@@ -44,8 +190,7 @@ void cu_bn_free(U_BN *a)
         return;
     if (a->d != NULL)
         free(a->d);
-    if (a == NULL)
-        free(a);
+    free(a);
 }
 
 unsigned cu_bn_mul_words(unsigned  *rp, const unsigned  *ap, int num, unsigned  w){
@@ -199,7 +344,85 @@ int cu_bn_dec2bn(U_BN *ret, const char *a){
 
 }
 
-/* Must 'OPENSSL_free' the returned data */
+int cu_bn_hex2bn(U_BN *ret, const char *a){
+
+    unsigned *d;
+    int i, k, words, v;
+
+    if(NULL == ret)
+        return 0;
+
+    if(NULL == ret->d)
+        return 0;
+
+    if ((a == NULL) || (*a == '\0')){
+        return (0);
+    }
+
+    for (i = 0; i <= (INT_MAX/4) && isxdigit((unsigned char)a[i]); i++)
+        continue;
+
+    if (0 == i || i > INT_MAX/4)
+        return 0;
+
+    words = (i + (CU_BN_BITS2 / 4) - 1) / (CU_BN_BITS2 / 4);
+    if ((d = (unsigned *)realloc(ret->d, words * sizeof(unsigned))) == NULL)
+        return 0;
+    ret->d = d;
+    memset(ret->d, 0, words * sizeof(unsigned));
+
+    /* least significant digit last in string, first in U_BN */
+    for (k = 0; k < i; k++) {
+        v = a[i - 1 - k];
+        v = isdigit(v) ? v - '0' : (toupper(v) - 'A' + 10);
+        ret->d[k / (CU_BN_BITS2 / 4)] |= ((unsigned)v) << (4 * (k % (CU_BN_BITS2 / 4)));
+    }
+    ret->top = words;
+    cu_bn_correct_top(ret);
+    if (ret->top == 0)
+        ret->top = 1;
+    return (1);
+
+}
+
+int cu_bn_bin2bn(U_BN *ret, const unsigned char *s, int len){
+
+    unsigned *d;
+    int i, words;
+
+    if(NULL == ret || NULL == s || len < 0)
+        return 0;
+
+    words = (len + sizeof(unsigned) - 1) / sizeof(unsigned);
+    if ((d = (unsigned *)realloc(ret->d, (words ? words : 1) * sizeof(unsigned))) == NULL)
+        return 0;
+    ret->d = d;
+    memset(ret->d, 0, (words ? words : 1) * sizeof(unsigned));
+    for (i = 0; i < len; i++)
+        ret->d[i / sizeof(unsigned)] |= ((unsigned)s[len - 1 - i]) << (8 * (i % sizeof(unsigned)));
+    ret->top = words;
+    cu_bn_correct_top(ret);
+    if (ret->top == 0)
+        ret->top = 1;
+    return (1);
+
+}
+
+int cu_bn_bn2bin(const U_BN *a, unsigned char *to){
+
+    int i, len;
+
+    if(NULL == a || NULL == to)
+        return 0;
+
+    len = (cu_bn_num_bits(a) + 7) / 8;
+    for (i = 0; i < len; i++)
+        to[len - 1 - i] = (unsigned char)(a->d[i / sizeof(unsigned)] >> (8 * (i % sizeof(unsigned))));
+    return (len);
+
+}
+
+/* Returned data belongs to the scratch pool, valid until cu_bn_pool_reset() */
 char *cu_bn_bn2hex(const U_BN *a){
 
     int i, j, v, z = 0;
@@ -215,7 +438,8 @@ char *cu_bn_bn2hex(const U_BN *a){
     if (cu_bn_is_zero(a))
         return "0";
 
-    buf = (char *)calloc((CU_BN_BYTES * a->top + 1), sizeof(char));
+    if ((buf = (char *)cu_bn_pool_alloc(CU_BN_BYTES * a->top + 1)) == NULL)
+        return 0;
     p=buf;
     for (i = a->top - 1; i >= 0; i--) {
         for (j = CU_BN_BITS2 - 4; j >= 0; j -= 4) {
@@ -711,11 +935,530 @@ int bignum2u_bn(BIGNUM* bignum, U_BN *u_bn){
     if(NULL == u_bn->d)
         return 0;
 
-    u_bn->top = ( (2 * bignum->top) + 1);
+    u_bn->top = ( (BN_BITS2 / CU_BN_BITS2) * bignum->top );
     u_bn->d = (unsigned *) malloc ( sizeof(unsigned) * u_bn->top );
     memcpy(u_bn->d, bignum->d, ( sizeof(unsigned) * u_bn->top ));
+    cu_bn_correct_top(u_bn);
+
+    return (1);
+}
+
+int u_bn2bignum(const U_BN *u_bn, BIGNUM* bignum){
+
+    unsigned char *bin;
+    int i, len, ret;
+
+    if(NULL == u_bn || NULL == u_bn->d || NULL == bignum)
+        return 0;
+
+    /* heap buffer, product tree nodes would grow the scratch arena for good */
+    len = u_bn->top * sizeof(unsigned);
+    if ((bin = (unsigned char *)malloc(len + 1)) == NULL)
+        return 0;
+    /* BN_bin2bn expects big-endian bytes, U_BN keeps least significant word first */
+    for (i = 0; i < len; i++)
+        bin[len - 1 - i] = (unsigned char)(u_bn->d[i / sizeof(unsigned)] >> (8 * (i % sizeof(unsigned))));
+    ret = (NULL != BN_bin2bn(bin, len, bignum));
+    free(bin);
+    return (ret);
+
+}
+
+static int bignum2u_bn_words(const BIGNUM *bignum, U_BN *u_bn){
+
+    int len = BN_num_bytes(bignum);
+    int words = (len + sizeof(unsigned) - 1) / sizeof(unsigned);
+    unsigned char *bin;
+    int i;
+
+    if ((bin = (unsigned char *)malloc(len + 1)) == NULL)
+        return 0;
+    BN_bn2bin(bignum, bin);
+    memset(u_bn->d, 0, (words ? words : 1) * sizeof(unsigned));
+    for (i = 0; i < len; i++)
+        u_bn->d[i / sizeof(unsigned)] |= ((unsigned)bin[len - 1 - i]) << (8 * (i % sizeof(unsigned)));
+    u_bn->top = words ? words : 1;
+    free(bin);
+    return (1);
+
+}
+
+static void cu_bn_fix_top(U_BN *a, int top){
+
+    a->top = top;
+    cu_bn_correct_top(a);
+    if (a->top == 0) {
+        a->d[0] = 0;
+        a->top = 1;
+    }
+
+}
+
+static int cu_bn_div_limbs(U_BN *dv, U_BN *rem, const U_BN *a, const U_BN *d, int nd){
+
+    int na = a->top;
+
+    if (!cu_bn_divmod_limbs((NULL != dv) ? dv->d : NULL, (NULL != rem) ? rem->d : NULL, a->d, na, d->d, nd))
+        return 0;
+    if (NULL != dv) {
+        if (na < nd)
+            dv->d[0] = 0;
+        cu_bn_fix_top(dv, (na < nd) ? 1 : na - nd + 1);
+    }
+    if (NULL != rem)
+        cu_bn_fix_top(rem, nd);
+    return (1);
+
+}
+
+int cu_bn_div(U_BN *dv, U_BN *rem, const U_BN *a, const U_BN *d){
+
+    BN_CTX *ctx;
+    BIGNUM *ba, *bd, *bq, *br;
+    int nd, ret = 0;
+
+    if(NULL == a || NULL == d || cu_bn_is_zero(d))
+        return 0;
+
+    for (nd = d->top; nd > 0 && 0 == d->d[nd - 1]; nd--)
+        ;
+    if (nd < CU_BN_DIV_OPENSSL_THRESHOLD || nd >= CU_BN_DIV_NEWTON_OPENSSL_THRESHOLD)
+        return (cu_bn_div_limbs(dv, rem, a, d, nd));
+
+    ctx = cu_bn_pool_ctx();
+    BN_CTX_start(ctx);
+    ba = BN_CTX_get(ctx);
+    bd = BN_CTX_get(ctx);
+    bq = BN_CTX_get(ctx);
+    br = BN_CTX_get(ctx);
+    if (NULL != br && u_bn2bignum(a, ba) && u_bn2bignum(d, bd) && BN_div(bq, br, ba, bd, ctx)) {
+        ret = 1;
+        if (NULL != dv)
+            ret &= bignum2u_bn_words(bq, dv);
+        if (NULL != rem)
+            ret &= bignum2u_bn_words(br, rem);
+    }
+    BN_CTX_end(ctx);
+    return (ret);
+
+}
+
+unsigned cu_bn_mul_add_words(unsigned *rp, const unsigned *ap, int num, unsigned w){
+
+    unsigned long long t;
+    unsigned c = 0;
+    int i;
+
+    for (i = 0; i < num; i++) {
+        t = (unsigned long long)ap[i] * w + rp[i] + c;
+        rp[i] = Lw(t);
+        c = Hw(t);
+    }
+    return (c);
+
+}
+
+unsigned cu_bn_sub_words(unsigned *r, const unsigned *a, const unsigned *b, int n){
+
+    unsigned long long t;
+    unsigned borrow = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        t = (unsigned long long)a[i] - b[i] - borrow;
+        r[i] = Lw(t);
+        borrow = Hw(t) ? 1 : 0;
+    }
+    return (borrow);
+
+}
+
+static unsigned cu_bn_add_into(unsigned *r, int rn, const unsigned *a, int an){
+
+    unsigned long long t;
+    unsigned c = 0;
+    int i;
+
+    /* r += a, carry runs through the rest of r */
+    for (i = 0; i < an; i++) {
+        t = (unsigned long long)r[i] + a[i] + c;
+        r[i] = Lw(t);
+        c = Hw(t);
+    }
+    for (; c && i < rn; i++)
+        c = (++r[i] == 0);
+    return (c);
+
+}
+
+static unsigned cu_bn_sub_from(unsigned *r, int rn, const unsigned *a, int an){
+
+    unsigned borrow;
+    int i;
+
+    borrow = cu_bn_sub_words(r, r, a, an);
+    for (i = an; borrow && i < rn; i++)
+        borrow = (r[i]-- == 0);
+    return (borrow);
+
+}
+
+static int cu_bn_cmp_words(const unsigned *a, const unsigned *b, int n){
+
+    int i;
+
+    for (i = n - 1; i >= 0; i--) {
+        if (a[i] != b[i])
+            return ((a[i] > b[i]) ? 1 : -1);
+    }
+    return 0;
+
+}
+
+static int cu_bn_abs_diff(unsigned *d, const unsigned *x, int xn, const unsigned *y, int yn){
+
+    /* d = |x - y| in yn >= xn words, returns 1 if x < y */
+    memset(d, 0, yn * sizeof(unsigned));
+    memcpy(d, x, xn * sizeof(unsigned));
+    if (cu_bn_cmp_words(d, y, yn) >= 0) {
+        cu_bn_sub_words(d, d, y, yn);
+        return 0;
+    }
+    cu_bn_sub_words(d, y, d, yn);
+    return (1);
+
+}
+
+void cu_bn_mul_school(unsigned *r, const unsigned *a, int na, const unsigned *b, int nb){
+
+    int j;
 
+    memset(r, 0, (na + nb) * sizeof(unsigned));
+    for (j = 0; j < nb; j++)
+        r[na + j] = cu_bn_mul_add_words(r + j, a, na, b[j]);
+
+}
+
+void cu_bn_sqr_school(unsigned *r, const unsigned *a, int n){
+
+    unsigned long long t, s;
+    unsigned c;
+    int i;
+
+    /* cross products once, doubled, then the squares on the diagonal */
+    memset(r, 0, 2 * n * sizeof(unsigned));
+    for (i = 0; i < n - 1; i++)
+        r[n + i] = cu_bn_mul_add_words(r + 2 * i + 1, a + i + 1, n - i - 1, a[i]);
+    for (c = 0, i = 0; i < 2 * n; i++) {
+        t = r[i];
+        r[i] = Lw((t << 1) | c);
+        c = (unsigned)(t >> (CU_BN_BITS2 - 1));
+    }
+    for (c = 0, i = 0; i < n; i++) {
+        t = (unsigned long long)a[i] * a[i];
+        s = (unsigned long long)r[2 * i] + Lw(t) + c;
+        r[2 * i] = Lw(s);
+        s = (unsigned long long)r[2 * i + 1] + Hw(t) + Hw(s);
+        r[2 * i + 1] = Lw(s);
+        c = Hw(s);
+    }
+
+}
+
+static int cu_bn_mul_balanced(unsigned *r, const unsigned *a, const unsigned *b, int n);
+
+static int cu_bn_mul_karatsuba(unsigned *r, const unsigned *a, const unsigned *b, int n){
+
+    unsigned *buf, *da, *db, *mid, *z1;
+    int h = n / 2, m = n - h, neg, ret;
+
+    /* r = z0 + (z0 + z2 - (a0 - a1)(b0 - b1)) B^h + z2 B^2h */
+    if ((buf = (unsigned *)malloc((6 * m + 1) * sizeof(unsigned))) == NULL)
+        return 0;
+    da = buf;
+    db = buf + m;
+    mid = buf + 2 * m;
+    z1 = buf + 4 * m + 1;
+    neg = cu_bn_abs_diff(da, a, h, a + h, m);
+    if (a == b) {
+        db = da;
+        neg = 0;
+    } else {
+        neg ^= cu_bn_abs_diff(db, b, h, b + h, m);
+    }
+
+    ret = cu_bn_mul_balanced(r, a, b, h)
+        && cu_bn_mul_balanced(r + 2 * h, a + h, b + h, m)
+        && cu_bn_mul_balanced(z1, da, db, m);
+    if (ret) {
+        memcpy(mid, r + 2 * h, 2 * m * sizeof(unsigned));
+        mid[2 * m] = 0;
+        cu_bn_add_into(mid, 2 * m + 1, r, 2 * h);
+        if (neg)
+            cu_bn_add_into(mid, 2 * m + 1, z1, 2 * m);
+        else
+            cu_bn_sub_from(mid, 2 * m + 1, z1, 2 * m);
+        cu_bn_add_into(r + h, 2 * n - h, mid, 2 * m + 1);
+    }
+    free(buf);
+    return (ret);
+
+}
+
+static void cu_bn_toom3_eval(unsigned *one, unsigned *minus, int *negative, unsigned *two, const unsigned *a, int k, int n){
+
+    unsigned *s = two;
+    int top = n - 2 * k;
+
+    /* a(1) = a0 + a1 + a2, |a(-1)| = |a0 - a1 + a2|, a(2) = a0 + 2 a1 + 4 a2 in k + 1 words */
+    memset(s, 0, (k + 1) * sizeof(unsigned));
+    memcpy(s, a, k * sizeof(unsigned));
+    cu_bn_add_into(s, k + 1, a + 2 * k, top);
+    memcpy(one, s, (k + 1) * sizeof(unsigned));
+    cu_bn_add_into(one, k + 1, a + k, k);
+    *negative = !cu_bn_abs_diff(minus, a + k, k, s, k + 1);
+
+    memset(two, 0, (k + 1) * sizeof(unsigned));
+    memcpy(two, a + 2 * k, top * sizeof(unsigned));
+    cu_bn_add_into(two, k + 1, two, k + 1);
+    cu_bn_add_into(two, k + 1, a + k, k);
+    cu_bn_add_into(two, k + 1, two, k + 1);
+    cu_bn_add_into(two, k + 1, a, k);
+
+}
+
+static void cu_bn_twos_negate(unsigned *x, int w){
+
+    int i;
+
+    for (i = 0; i < w; i++)
+        x[i] = ~x[i];
+    for (i = 0; i < w && ++x[i] == 0; i++)
+        ;
+
+}
+
+static void cu_bn_twos_half(unsigned *x, int w){
+
+    int i;
+
+    /* exact arithmetic shift of a two's complement number */
+    for (i = 0; i < w - 1; i++)
+        x[i] = (x[i] >> 1) | (x[i + 1] << (CU_BN_BITS2 - 1));
+    x[w - 1] = (unsigned)((int)x[w - 1] >> 1);
+
+}
+
+static void cu_bn_twos_third(unsigned *x, int w){
+
+    unsigned long long t;
+    unsigned c = 0, q, borrow;
+    int i;
+
+    /* exact division by 3 with the inverse of 3 modulo B */
+    for (i = 0; i < w; i++) {
+        borrow = (x[i] < c);
+        q = (x[i] - c) * 0xAAAAAAABu;
+        t = (unsigned long long)q * 3;
+        x[i] = q;
+        c = Hw(t) + borrow;
+    }
+
+}
+
+static int cu_bn_mul_toom3(unsigned *r, const unsigned *a, const unsigned *b, int n){
+
+    unsigned *buf, *a1, *am, *a2, *b1, *bm, *b2, *v0, *v1, *vm, *v2, *vi;
+    int k = (n + 2) / 3, top = n - 2 * k, w = 2 * k + 3, neg_a, neg_b, ret;
+
+    if ((buf = (unsigned *)calloc(6 * (k + 1) + 5 * w, sizeof(unsigned))) == NULL)
+        return 0;
+    a1 = buf;
+    am = a1 + k + 1;
+    a2 = am + k + 1;
+    b1 = a2 + k + 1;
+    bm = b1 + k + 1;
+    b2 = bm + k + 1;
+    v0 = b2 + k + 1;
+    v1 = v0 + w;
+    vm = v1 + w;
+    v2 = vm + w;
+    vi = v2 + w;
+
+    cu_bn_toom3_eval(a1, am, &neg_a, a2, a, k, n);
+    if (a == b) {
+        b1 = a1;
+        bm = am;
+        b2 = a2;
+        neg_b = neg_a;
+    } else {
+        cu_bn_toom3_eval(b1, bm, &neg_b, b2, b, k, n);
+    }
+
+    /* r(0) and r(inf) go straight to their place in r */
+    memset(r + 2 * k, 0, 2 * k * sizeof(unsigned));
+    ret = cu_bn_mul_balanced(r, a, b, k)
+        && cu_bn_mul_balanced(r + 4 * k, a + 2 * k, b + 2 * k, top)
+        && cu_bn_mul_balanced(v1, a1, b1, k + 1)
+        && cu_bn_mul_balanced(vm, am, bm, k + 1)
+        && cu_bn_mul_balanced(v2, a2, b2, k + 1);
+    if (!ret) {
+        free(buf);
+        return 0;
+    }
+    memcpy(v0, r, 2 * k * sizeof(unsigned));
+    memcpy(vi, r + 4 * k, 2 * top * sizeof(unsigned));
+    if (neg_a != neg_b)
+        cu_bn_twos_negate(vm, w);
+
+    /* interpolation of c0 + c1 x + c2 x^2 + c3 x^3 + c4 x^4 in w words of two's complement */
+    cu_bn_sub_words(v2, v2, vm, w);
+    cu_bn_twos_third(v2, w);
+    cu_bn_sub_words(vm, v1, vm, w);
+    cu_bn_twos_half(vm, w);
+    cu_bn_sub_words(v1, v1, v0, w);
+    cu_bn_sub_words(v2, v2, v1, w);
+    cu_bn_twos_half(v2, w);
+    cu_bn_sub_words(v1, v1, vm, w);
+    cu_bn_sub_words(v1, v1, vi, w);
+    cu_bn_sub_words(v2, v2, vi, w);
+    cu_bn_sub_words(v2, v2, vi, w);
+    cu_bn_sub_words(vm, vm, v2, w);
+
+    /* c1, c2 and c3 are non negative, their words past the product are zero */
+    cu_bn_add_into(r + k, 2 * n - k, vm, MIN(w, 2 * n - k));
+    cu_bn_add_into(r + 2 * k, 2 * n - 2 * k, v1, MIN(w, 2 * n - 2 * k));
+    cu_bn_add_into(r + 3 * k, 2 * n - 3 * k, v2, MIN(w, 2 * n - 3 * k));
+    free(buf);
+    return (1);
+
+}
+
+static int cu_bn_mul_balanced(unsigned *r, const unsigned *a, const unsigned *b, int n){
+
+    if (a == b) {
+        if (n < CU_BN_SQR_KARATSUBA_THRESHOLD) {
+            cu_bn_sqr_school(r, a, n);
+            return (1);
+        }
+    } else if (n < CU_BN_MUL_KARATSUBA_THRESHOLD) {
+        cu_bn_mul_school(r, a, n, b, n);
+        return (1);
+    }
+    if (n < CU_BN_MUL_TOOM3_THRESHOLD)
+        return (cu_bn_mul_karatsuba(r, a, b, n));
+    if (n < CU_BN_MUL_NTT_THRESHOLD || 2 * n > NTT_MUL_MAX_WORDS)
+        return (cu_bn_mul_toom3(r, a, b, n));
+    return (cu_bn_mul_ntt(r, a, n, b, n));
+
+}
+
+int cu_bn_mul_limbs(unsigned *r, const unsigned *a, int na, const unsigned *b, int nb){
+
+    const unsigned *t;
+    unsigned *p;
+    int off, len;
+
+    if (na < nb) {
+        t = a;
+        a = b;
+        b = t;
+        off = na;
+        na = nb;
+        nb = off;
+    }
+    if (nb <= 0) {
+        memset(r, 0, na * sizeof(unsigned));
+        return (1);
+    }
+    if (na == nb)
+        return (cu_bn_mul_balanced(r, a, b, na));
+    if (nb < CU_BN_MUL_KARATSUBA_THRESHOLD) {
+        cu_bn_mul_school(r, a, na, b, nb);
+        return (1);
+    }
+    /* transforms take unbalanced operands as they are */
+    if (nb >= CU_BN_MUL_NTT_THRESHOLD && na + nb <= NTT_MUL_MAX_WORDS)
+        return (cu_bn_mul_ntt(r, a, na, b, nb));
+
+    /* unbalanced operands are cut into slices of the shorter one */
+    if ((p = (unsigned *)malloc(2 * nb * sizeof(unsigned))) == NULL)
+        return 0;
+    memset(r, 0, (na + nb) * sizeof(unsigned));
+    for (off = 0; off < na; off += nb) {
+        len = MIN(nb, na - off);
+        if (!((len == nb) ? cu_bn_mul_balanced(p, a + off, b, nb) : cu_bn_mul_limbs(p, b, nb, a + off, len))) {
+            free(p);
+            return 0;
+        }
+        cu_bn_add_into(r + off, na + nb - off, p, len + nb);
+    }
+    free(p);
     return (1);
+
+}
+
+int cu_bn_sqr_limbs(unsigned *r, const unsigned *a, int n){
+
+    if (n <= 0)
+        return (1);
+    return (cu_bn_mul_balanced(r, a, a, n));
+
+}
+
+static int cu_bn_mul_openssl(U_BN *r, const U_BN *a, const U_BN *b){
+
+    BN_CTX *ctx;
+    BIGNUM *ba, *bb, *br;
+    int ret = 0;
+
+    ctx = cu_bn_pool_ctx();
+    BN_CTX_start(ctx);
+    ba = BN_CTX_get(ctx);
+    bb = BN_CTX_get(ctx);
+    br = BN_CTX_get(ctx);
+    if (NULL != br && u_bn2bignum(a, ba)) {
+        if (a == b)
+            ret = BN_sqr(br, ba, ctx);
+        else
+            ret = u_bn2bignum(b, bb) && BN_mul(br, ba, bb, ctx);
+        ret = ret && bignum2u_bn_words(br, r);
+    }
+    BN_CTX_end(ctx);
+    return (ret);
+
+}
+
+int cu_bn_mul(U_BN *r, const U_BN *a, const U_BN *b){
+
+    int min, limit;
+
+    if(NULL == r || NULL == a || NULL == b)
+        return 0;
+
+    /* in between the 64 bit kernels of OpenSSL outrun 32 bit words despite the conversion,
+     * but OpenSSL recurses only on lengths within a 64 bit word and multiplies the rest by schoolbook */
+    min = MIN(a->top, b->top);
+    limit = (cu_long_abs(((a->top + 1) >> 1) - ((b->top + 1) >> 1)) <= 1)
+        ? CU_BN_MUL_NTT_OPENSSL_THRESHOLD : CU_BN_MUL_UNBALANCED_OPENSSL_THRESHOLD;
+    if (min >= CU_BN_MUL_OPENSSL_THRESHOLD && (min < limit || a->top + b->top > NTT_MUL_MAX_WORDS))
+        return (cu_bn_mul_openssl(r, a, b));
+    if (!((a == b) ? cu_bn_sqr_limbs(r->d, a->d, a->top) : cu_bn_mul_limbs(r->d, a->d, a->top, b->d, b->top)))
+        return 0;
+    r->top = a->top + b->top;
+    cu_bn_correct_top(r);
+    if (r->top == 0) {
+        r->d[0] = 0;
+        r->top = 1;
+    }
+    return (1);
+
+}
+
+int cu_bn_sqr(U_BN *r, const U_BN *a){
+
+    return (cu_bn_mul(r, a, a));
+
 }
 
 U_BN *cu_fast_binary_euclid(U_BN *a, U_BN *b){
@@ -740,14 +1483,21 @@ U_BN *cu_fast_binary_euclid(U_BN *a, U_BN *b){
 
 U_BN *cu_classic_euclid(U_BN *a, U_BN *b){
 
-    while (cu_bn_ucmp(a, b) != 0) {
-        if (cu_bn_ucmp(a, b) > 0) {
-            cu_bn_usub(a, b, a); 
-        }
-        else {
-            cu_bn_usub(b, a, b);
-        }
+    U_BN *t = NULL;
+
+    /* remainders instead of repeated subtraction, a zero operand ends the loop */
+    if (cu_bn_ucmp(a, b) < 0) {
+        t = a;
+        a = b;
+        b = t;
+    }
+    while (!cu_bn_is_zero(b)) {
+        if (!cu_bn_div(NULL, a, a, b))
+            break;
         DEBUG_PRINT("a is equal: %s\n", cu_bn_bn2hex(a));
+        t = a;
+        a = b;
+        b = t;
     }
 
     return (a);
@@ -839,87 +1589,262 @@ int cu_ubn_uadd(const U_BN *a, const U_BN *b, U_BN *r)
     return (1);
 }
 
+static int cu_bn_pm_rshift(U_BN *b, const U_BN *a){
+
+    unsigned long long t;
+    unsigned carry = 0, w, x, y, prev = 0, s = 0, add;
+    int i, n, out = 0, found = -1;
+
+    /* odd a and b, whichever of a + b and a - b is divisible by 4 */
+    add = (0 == ((a->d[0] + b->d[0]) & 3));
+    n = MAX(a->top, b->top);
+    for (i = 0; i < n; i++) {
+        x = (i < a->top) ? a->d[i] : 0;
+        y = (i < b->top) ? b->d[i] : 0;
+        if (add) {
+            t = (unsigned long long)x + y + carry;
+            carry = Hw(t);
+        } else {
+            t = (unsigned long long)x - y - carry;
+            carry = Hw(t) ? 1 : 0;
+        }
+        w = Lw(t);
+        if (found < 0) {
+            if (0 == w)
+                continue;
+            found = i;
+            s = __builtin_ctz(w);
+        } else {
+            b->d[out++] = s ? (prev >> s) | (w << (CU_BN_BITS2 - s)) : prev;
+        }
+        prev = w;
+    }
+    if (found < 0) {
+        /* zero, or a sum that is a power of two words */
+        b->d[0] = carry;
+        b->top = 1;
+        return (carry ? n * CU_BN_BITS2 : 0);
+    }
+
+    /* the word above the top one is the carry of a sum or the sign of a difference */
+    w = add ? carry : (carry ? CU_BN_MASK2 : 0);
+    b->d[out++] = s ? (prev >> s) | (w << (CU_BN_BITS2 - s)) : prev;
+    if (add && 0 == s && w)
+        b->d[out++] = w;
+    if (!add && carry) {
+        for (i = 0; i < out; i++)
+            b->d[i] = ~b->d[i];
+        for (i = 0; i < out && ++b->d[i] == 0; i++)
+            ;
+    }
+    b->top = out;
+    cu_bn_correct_top(b);
+    return (found * CU_BN_BITS2 + s);
+
+}
+
+static void cu_bn_pm_prepare(U_BN *a, U_BN *b, unsigned *shifts){
+
+    unsigned za = 0, zb = 0;
+    int n = MAX(a->top, b->top);
+
+    /* both odd and with room for the words of either */
+    if (a->top < n)
+        a->d = (unsigned *)realloc(a->d, n * sizeof(unsigned));
+    if (b->top < n)
+        b->d = (unsigned *)realloc(b->d, n * sizeof(unsigned));
+    while (!cu_bn_is_odd(a) && cu_bn_rshift1(a))
+        za++;
+    while (!cu_bn_is_odd(b) && cu_bn_rshift1(b))
+        zb++;
+    *shifts = MIN(za, zb);
+
+}
+
+static void cu_bn_pm_finish(U_BN *a, unsigned shifts){
+
+    unsigned k;
+
+    /* the common power of two, a word multiplication at a time */
+    for (; shifts > 0; shifts -= k) {
+        k = MIN(shifts, CU_BN_BITS2 - 1);
+        cu_bn_mul_word(a, 1u << k);
+    }
+
+}
+
 U_BN *q_algorithm_PM(U_BN *a, U_BN *b){
-    int q=0;
+
     U_BN *t = NULL;
+    unsigned shifts;
+    int q;
+
+    if (cu_bn_is_zero(a))
+        return (b);
+    if (cu_bn_is_zero(b))
+        return (a);
+    cu_bn_pm_prepare(a, b, &shifts);
+
+    /* only the difference q of the bounds on the lengths of a and b is kept */
+    q = cu_bn_num_bits(a) - cu_bn_num_bits(b);
     while (!cu_bn_is_zero(b)) {
         DEBUG_PRINT("q: %d b: %s\n", q, cu_bn_bn2hex(b));
-        while(!cu_bn_is_odd(b)){
-            cu_bn_rshift1(b);
-            q++;
-        }
-        if(q >= 0) {
+        if (q > 0) {
             t = a;
             a = b;
             b = t;
-            q=-q;
-        }
-        if((a->d[0]+b->d[0])&3==0) {
-            cu_ubn_uadd(a, b, b);
-            cu_bn_rshift1(b);
-        } else {
-            cu_bn_usub(a, b, b);
-            cu_bn_rshift1(b);
+            q = -q;
         }
+        q += cu_bn_pm_rshift(b, a) - 1;
     }
+    cu_bn_pm_finish(a, shifts);
     return (a);
 
 }
 
 U_BN *algorithm_PM(U_BN *a, U_BN *b, unsigned keysize){
-    int beta=keysize, alfa=keysize, tmp;
+
     U_BN *t = NULL;
+    unsigned shifts;
+    int alfa = keysize, beta = keysize, tmp;
+
+    if (cu_bn_is_zero(a))
+        return (b);
+    if (cu_bn_is_zero(b))
+        return (a);
+    cu_bn_pm_prepare(a, b, &shifts);
+
+    /* b keeps the larger bound, each step lowers it by at least one bit */
     while (!cu_bn_is_zero(b)) {
-        //DEBUG_PRINT("b: %s\n", cu_bn_bn2hex(b));
-        while(!cu_bn_is_odd(b)){
-            cu_bn_rshift1(b);
-            beta--;
-        }
-        if(alfa >= beta) {
+        if (alfa > beta) {
             t = a;
             a = b;
             b = t;
             tmp = alfa;
             alfa = beta;
             beta = tmp;
-            
-        }
-        if((a->d[0]+b->d[0])&3==0) {
-            cu_ubn_uadd(a, b, b);
-            cu_bn_rshift1(b);
-        } else {
-            cu_bn_usub(a, b, b);
-            cu_bn_rshift1(b);
         }
+        beta += 1 - cu_bn_pm_rshift(b, a);
     }
+    cu_bn_pm_finish(a, shifts);
     return (a);
 
 }
 
-U_BN *cu_approximate_euclid(U_BN *a, U_BN *b, unsigned keysize){
-    int beta=keysize, alfa=keysize, tmp;
-    U_BN *t = NULL;
-    do{
-        if(beta==0){
-            if(!(alfa&1)) alfa --;
-            cu_bn_mul_word(b, alfa);
-            cu_bn_usub(a, b, a);
+static int cu_bn_abs_submul(U_BN *a, const U_BN *b, unsigned q, unsigned s){
+
+    unsigned long long m, t;
+    unsigned c = 0, p, prev = 0, w, borrow = 0, over = 0, sw, sb;
+    int i, j;
+
+    if (NULL == a || NULL == b || NULL == a->d || NULL == b->d)
+        return 0;
+    sw = s / CU_BN_BITS2;
+    sb = s % CU_BN_BITS2;
+
+    /* a - q b 2^s word by word, the product shifted as it is formed */
+    for (i = sw, j = 0; j <= b->top; i++, j++) {
+        if (j < b->top) {
+            m = (unsigned long long)q * b->d[j] + c;
+            p = Lw(m);
+            c = Hw(m);
         } else {
-            
+            p = c;
         }
-    } while(!cu_bn_is_odd(b));
+        w = sb ? (p << sb) | (prev >> (CU_BN_BITS2 - sb)) : p;
+        prev = p;
+        if (i < a->top) {
+            t = (unsigned long long)a->d[i] - w - borrow;
+            a->d[i] = Lw(t);
+            borrow = Hw(t) ? 1 : 0;
+        } else {
+            over |= w;
+        }
+    }
+    w = sb ? prev >> (CU_BN_BITS2 - sb) : 0;
+    for (; i < a->top && (w || borrow); i++) {
+        t = (unsigned long long)a->d[i] - w - borrow;
+        a->d[i] = Lw(t);
+        borrow = Hw(t) ? 1 : 0;
+        w = 0;
+    }
+    over |= w;
+
+    /* an estimate above a leaves the two's complement of the difference */
+    if (borrow || over) {
+        for (i = 0; i < a->top; i++)
+            a->d[i] = ~a->d[i];
+        for (i = 0; i < a->top && ++a->d[i] == 0; i++)
+            ;
+    }
+    cu_bn_correct_top(a);
+    if (0 == a->top) {
+        a->d[0] = 0;
+        a->top = 1;
+    }
+    return (1);
+
+}
+
+static unsigned long long cu_bn_top64(const U_BN *a, int bits){
+
+    unsigned long long lo, hi;
+    int shift = bits - 64, w, s;
+
+    /* the 64 bits below bit number bits, zero filled under short numbers */
+    if (shift <= 0) {
+        lo = a->d[0];
+        if (a->top > 1)
+            lo |= (unsigned long long)a->d[1] << 32;
+        return (lo << (-shift));
+    }
+    w = shift / CU_BN_BITS2;
+    s = shift % CU_BN_BITS2;
+    lo = a->d[w] | ((w + 1 < a->top) ? (unsigned long long)a->d[w + 1] << 32 : 0);
+    hi = (w + 2 < a->top) ? a->d[w + 2] : 0;
+    return ((lo >> s) | (s ? hi << (64 - s) : 0));
+
+}
 
+U_BN *cu_approximate_euclid(U_BN *a, U_BN *b){
 
-    while (cu_bn_ucmp(a, b) != 0) {
-        if (cu_bn_ucmp(a, b) > 0) {
-            cu_bn_usub(a, b, a); 
+    unsigned long long q;
+    U_BN *t = NULL;
+    int la, lb, e, tmp;
+
+    if (cu_bn_is_zero(a))
+        return (b);
+    if (cu_bn_is_zero(b))
+        return (a);
+
+    for (;;) {
+        la = cu_bn_num_bits(a);
+        lb = cu_bn_num_bits(b);
+        if (la < lb) {
+            t = a;
+            a = b;
+            b = t;
+            tmp = la;
+            la = lb;
+            lb = tmp;
         }
-        else {
-            cu_bn_usub(b, a, b);
+        if (0 == lb)
+            break;
+
+        /* a / b is about q 2^e from the top 64 bits of a and 32 bits of b, one word of it is taken */
+        e = la - lb - CU_BN_BITS2;
+        q = cu_bn_top64(a, la) / (cu_bn_top64(b, lb) >> CU_BN_BITS2);
+        while (q > CU_BN_MASK2) {
+            q >>= 1;
+            e++;
+        }
+        if (e < 0) {
+            q >>= -e;
+            e = 0;
         }
+        cu_bn_abs_submul(a, b, q ? (unsigned)q : 1, e);
         DEBUG_PRINT("a is equal: %s\n", cu_bn_bn2hex(a));
     }
-
     return (a);
 
 }
@@ -163,34 +163,29 @@ __host__ __device__ int cu_dev_bn_lshift(U_BN *a, unsigned n){
     if (0 == n)
         return 0;
 
-    unsigned nw = 0, lb, rb, l;
+    unsigned nw, lb, rb, top, l;
     int i;
-    unsigned nwb = 0, c = 0;
 
     nw = (n / CU_BN_BITS2);
     lb = (n % CU_BN_BITS2);
     rb = (CU_BN_BITS2 - lb);
 
-    l=a->d[a->top-1];
-    if( ((l << lb)/32) > 0 ) nwb = 1;
-
-    if(nw || nwb){
-        a->d[a->top]=0;
-    }
-
-    if (lb == 0 && nw != 0 ){
-        for (i = a->top - 1; i >= 0; i--){
-            a->d[nw + i] = a->d[i];
-        }
+    /* top down, a word is added only if bits are shifted out of the top one */
+    top = a->top + nw;
+    if (lb) {
+        l = a->d[a->top - 1] >> rb;
+        if (l)
+            a->d[top++] = l;
+        for (i = a->top - 1; i > 0; i--)
+            a->d[nw + i] = (a->d[i] << lb) | (a->d[i - 1] >> rb);
+        a->d[nw] = a->d[0] << lb;
     } else {
-        for (i = 0; i < (a->top + nw + nwb); i++) {
-            l = a->d[i];
-            a->d[i] = (l << lb) | c;
-            c = (l >> rb);
-
-        }
+        for (i = a->top - 1; i >= 0; i--)
+            a->d[nw + i] = a->d[i];
     }
-    a->top += (nw + nwb);
+    for (i = 0; i < (int)nw; i++)
+        a->d[i] = 0;
+    a->top = top;
     return (1);
 
 }
@@ -248,6 +243,154 @@ __host__ __device__ U_BN *cu_dev_binary_gcd(U_BN *a, U_BN *b){
 }
 
 
+static __host__ __device__ int cu_dev_divsteps_batch(int eta, unsigned f, unsigned g, int *t){
+
+    unsigned u = 1, v = 0, q = 0, r = 1, m1, m2, x, y, z;
+    int i;
+
+    /* eta = -delta, the matrix t maps f, g to 2^30 times their values after the batch */
+    for (i = 0; i < CU_DEV_DIVSTEPS_BATCH; i++) {
+        m1 = (unsigned)(eta >> 31);
+        m2 = 0 - (g & 1);
+        x = (f ^ m1) - m1;
+        y = (u ^ m1) - m1;
+        z = (v ^ m1) - m1;
+        g += x & m2;
+        q += y & m2;
+        r += z & m2;
+        /* delta > 0 and g odd: delta = 1 - delta and f takes g, otherwise delta = 1 + delta */
+        m1 &= m2;
+        eta = (eta ^ (int)m1) - 1 - (int)m1;
+        f += g & m1;
+        u += q & m1;
+        v += r & m1;
+        g >>= 1;
+        u <<= 1;
+        v <<= 1;
+    }
+    t[0] = (int)u;
+    t[1] = (int)v;
+    t[2] = (int)q;
+    t[3] = (int)r;
+    return (eta);
+
+}
+
+static __host__ __device__ void cu_dev_divsteps_update(int *f, int *g, int n, const int *t){
+
+    const int m30 = (int)(CU_BN_MASK2 >> 2);
+    long long cf, cg;
+    int i;
+
+    /* the low 30 bits of both combinations are zero and dropped */
+    cf = ((long long)t[0] * f[0] + (long long)t[1] * g[0]) >> CU_DEV_DIVSTEPS_BATCH;
+    cg = ((long long)t[2] * f[0] + (long long)t[3] * g[0]) >> CU_DEV_DIVSTEPS_BATCH;
+    for (i = 1; i < n; i++) {
+        cf += (long long)t[0] * f[i] + (long long)t[1] * g[i];
+        cg += (long long)t[2] * f[i] + (long long)t[3] * g[i];
+        f[i - 1] = (int)cf & m30;
+        g[i - 1] = (int)cg & m30;
+        cf >>= CU_DEV_DIVSTEPS_BATCH;
+        cg >>= CU_DEV_DIVSTEPS_BATCH;
+    }
+    f[n - 1] = (int)cf;
+    g[n - 1] = (int)cg;
+
+}
+
+static __host__ __device__ void cu_dev_bn_to_limbs(int *v, int n, const U_BN *a){
+
+    unsigned long long acc = 0;
+    int i, j = 0, bits = 0;
+
+    for (i = 0; i < n; i++) {
+        if (bits < CU_DEV_DIVSTEPS_BATCH && j < a->top) {
+            acc |= (unsigned long long)a->d[j++] << bits;
+            bits += CU_BN_BITS2;
+        }
+        v[i] = (int)(acc & (CU_BN_MASK2 >> 2));
+        acc >>= CU_DEV_DIVSTEPS_BATCH;
+        bits = (bits > CU_DEV_DIVSTEPS_BATCH) ? bits - CU_DEV_DIVSTEPS_BATCH : 0;
+    }
+
+}
+
+static __host__ __device__ void cu_dev_bn_from_limbs(U_BN *a, int top, int *v, int n){
+
+    unsigned long long acc = 0;
+    long long c = 0;
+    int i, j = 0, bits = 0, neg = v[n - 1] >> 31;
+
+    /* absolute value, limbs below the top one back to 30 bits */
+    for (i = 0; i < n; i++) {
+        c += (v[i] ^ neg) - neg;
+        v[i] = (i < n - 1) ? (int)c & (int)(CU_BN_MASK2 >> 2) : (int)c;
+        c >>= CU_DEV_DIVSTEPS_BATCH;
+    }
+    for (i = 0; i < n && j < top; i++) {
+        acc |= (unsigned long long)(unsigned)v[i] << bits;
+        bits += CU_DEV_DIVSTEPS_BATCH;
+        if (bits >= CU_BN_BITS2) {
+            a->d[j++] = Lw(acc);
+            acc >>= CU_BN_BITS2;
+            bits -= CU_BN_BITS2;
+        }
+    }
+    if (j < top)
+        a->d[j++] = Lw(acc);
+    while (j < top)
+        a->d[j++] = 0;
+    a->top = top;
+    cu_bn_correct_top(a);
+    if (0 == a->top) {
+        a->d[0] = 0;
+        a->top = 1;
+    }
+
+}
+
+__host__ __device__ U_BN *cu_dev_divsteps_gcd(U_BN *a, U_BN *b){
+
+    int f[CU_DEV_DIVSTEPS_LIMBS], g[CU_DEV_DIVSTEPS_LIMBS], t[4];
+    int za, zb, top, d, n, steps, eta = -1, i;
+
+    cu_bn_correct_top(a);
+    cu_bn_correct_top(b);
+    if (0 == a->top || cu_bn_is_zero(a))
+        return (b);
+    if (0 == b->top || cu_bn_is_zero(b))
+        return (a);
+    top = (a->top > b->top) ? a->top : b->top;
+    d = top * CU_BN_BITS2;
+    if (d > CU_DEV_DIVSTEPS_MAX_BITS)
+        return (cu_dev_ctz_binary_gcd(a, b));
+
+    /* f must be odd, both are made odd and the common power of two is restored at the end */
+    za = cu_dev_bn_ctz(a);
+    zb = cu_dev_bn_ctz(b);
+    if (za)
+        cu_dev_bn_rshift(a, za);
+    if (zb)
+        cu_dev_bn_rshift(b, zb);
+
+    /* g is zero after this many divsteps for operands below 2^d, Bernstein and Yang theorem 11.2 */
+    n = (d + CU_DEV_DIVSTEPS_BATCH) / CU_DEV_DIVSTEPS_BATCH + 1;
+    steps = (d < 46) ? (49 * d + 80) / 17 : (49 * d + 57) / 17;
+    cu_dev_bn_to_limbs(f, n, a);
+    cu_dev_bn_to_limbs(g, n, b);
+    for (i = 0; i < steps; i += CU_DEV_DIVSTEPS_BATCH) {
+        eta = cu_dev_divsteps_batch(eta, (unsigned)f[0], (unsigned)g[0], t);
+        cu_dev_divsteps_update(f, g, n, t);
+    }
+
+    /* f is plus or minus the odd part of the GCD */
+    cu_dev_bn_from_limbs(a, top, f, n);
+    if (za && zb)
+        cu_dev_bn_lshift(a, (za < zb) ? za : zb);
+    return (a);
+
+}
+
 __host__ __device__ U_BN *cu_dev_fast_binary_euclid(U_BN *a, U_BN *b){
     U_BN *t;
     do {
@@ -265,15 +408,746 @@ __host__ __device__ U_BN *cu_dev_fast_binary_euclid(U_BN *a, U_BN *b){
     return (a);
 }
 
-__host__ __device__ U_BN *cu_dev_classic_euclid(U_BN *a, U_BN *b){
+static __host__ __device__ int cu_dev_ctz_word(unsigned w){
+
+#if defined(__CUDA_ARCH__)
+    return (__ffs(w) - 1);
+#else
+    return (__builtin_ctz(w));
+#endif
+
+}
+
+__host__ __device__ int cu_dev_bn_ctz(const U_BN *a){
+
+    int i;
+
+    for (i = 0; i < a->top; i++)
+        if (a->d[i])
+            return (i * CU_BN_BITS2 + cu_dev_ctz_word(a->d[i]));
+    return (0);
+
+}
+
+__host__ __device__ int cu_dev_bn_rshift(U_BN *a, unsigned n){
+
+    unsigned s = n % CU_BN_BITS2, l;
+    int nw = (int)(n / CU_BN_BITS2), i;
+
+    if (NULL == a || NULL == a->d)
+        return 0;
+    if (nw >= a->top) {
+        a->d[0] = 0;
+        a->top = 1;
+        return (1);
+    }
+    for (i = 0; i + nw < a->top; i++) {
+        l = a->d[i + nw] >> s;
+        if (s && i + nw + 1 < a->top)
+            l |= a->d[i + nw + 1] << (CU_BN_BITS2 - s);
+        a->d[i] = l;
+    }
+    a->top -= nw;
+    cu_bn_correct_top(a);
+    if (0 == a->top) {
+        a->d[0] = 0;
+        a->top = 1;
+    }
+    return (1);
+
+}
+
+__host__ __device__ int cu_dev_bn_sub_rshift(U_BN *a, const U_BN *b){
+
+    unsigned long long t;
+    unsigned borrow = 0, w, prev = 0, s = 0;
+    int i, out = 0, found = 0;
+
+    /* a - b word by word, written back shifted by its trailing zeros one word behind */
+    for (i = 0; i < a->top; i++) {
+        t = (unsigned long long)a->d[i] - ((i < b->top) ? b->d[i] : 0) - borrow;
+        w = Lw(t);
+        borrow = Hw(t) ? 1 : 0;
+        if (!found) {
+            if (0 == w)
+                continue;
+            found = 1;
+            s = cu_dev_ctz_word(w);
+        } else {
+            a->d[out++] = s ? (prev >> s) | (w << (CU_BN_BITS2 - s)) : prev;
+        }
+        prev = w;
+    }
+    if (borrow)
+        return 0;
+    a->d[out++] = prev >> s;
+    a->top = out;
+    cu_bn_correct_top(a);
+    if (0 == a->top) {
+        a->d[0] = 0;
+        a->top = 1;
+    }
+    return (1);
+
+}
+
+static __host__ __device__ int cu_dev_bn_num_bits(const U_BN *a){
+
+    unsigned l;
+    int top = a->top, bits = 0;
+
+    while (top > 0 && 0 == a->d[top - 1])
+        top--;
+    if (0 == top)
+        return (0);
+    for (l = a->d[top - 1]; l; l >>= 1)
+        bits++;
+    return ((top - 1) * CU_BN_BITS2 + bits);
+
+}
+
+static __host__ __device__ unsigned long long cu_dev_bn_top64(const U_BN *a, int bits){
+
+    unsigned long long lo, hi;
+    int shift = bits - 64, w, s;
 
-    while (cu_dev_bn_ucmp(a, b) != 0) {
-        if (cu_dev_bn_ucmp(a, b) > 0) {
-            cu_dev_bn_usub(a, b, a); 
+    /* the 64 bits below bit number bits, zero filled under short numbers */
+    if (shift <= 0) {
+        lo = a->d[0];
+        if (a->top > 1)
+            lo |= (unsigned long long)a->d[1] << 32;
+        return (lo << (-shift));
+    }
+    w = shift / CU_BN_BITS2;
+    s = shift % CU_BN_BITS2;
+    lo = a->d[w] | ((w + 1 < a->top) ? (unsigned long long)a->d[w + 1] << 32 : 0);
+    hi = (w + 2 < a->top) ? a->d[w + 2] : 0;
+    return ((lo >> s) | (s ? hi << (64 - s) : 0));
+
+}
+
+__host__ __device__ int cu_dev_bn_umod(U_BN *a, const U_BN *b){
+
+    unsigned long long p, t, q, bb;
+    unsigned w, c, borrow;
+    int la, lb, nb, e, k, i;
+
+    lb = cu_dev_bn_num_bits(b);
+    if (0 == lb)
+        return 0;
+    nb = (lb + CU_BN_BITS2 - 1) / CU_BN_BITS2;
+    bb = cu_dev_bn_top64(b, lb) >> 32;
+
+    /* a -= w b B^k with the largest word w that the top bits of a and b guarantee */
+    while ((la = cu_dev_bn_num_bits(a)) >= lb) {
+        /* b B^k stays below a for k < e / 32, so w is at least 1 there */
+        e = la - lb;
+        k = (e > 0) ? (e - 1) / CU_BN_BITS2 : 0;
+        q = (cu_dev_bn_top64(a, la) / (bb + 1)) >> (CU_BN_BITS2 + CU_BN_BITS2 * k - e);
+        w = (q > CU_BN_MASK2) ? CU_BN_MASK2 : (unsigned)q;
+        if (0 == w) {
+            /* equal lengths, a may still be below b */
+            for (i = nb - 1; i > 0 && a->d[i] == b->d[i]; i--)
+                ;
+            if (a->d[i] < b->d[i])
+                break;
+            w = 1;
+        }
+        c = borrow = 0;
+        for (i = 0; i < nb; i++) {
+            p = (unsigned long long)w * b->d[i] + c;
+            c = Hw(p);
+            t = (unsigned long long)a->d[k + i] - Lw(p) - borrow;
+            a->d[k + i] = Lw(t);
+            borrow = Hw(t) ? 1 : 0;
+        }
+        for (i += k; (c || borrow) && i < a->top; i++) {
+            t = (unsigned long long)a->d[i] - c - borrow;
+            a->d[i] = Lw(t);
+            borrow = Hw(t) ? 1 : 0;
+            c = 0;
+        }
+        cu_bn_correct_top(a);
+        if (0 == a->top) {
+            a->d[0] = 0;
+            a->top = 1;
         }
-        else {
-            cu_dev_bn_usub(b, a, b);
+    }
+    return (1);
+
+}
+
+__host__ __device__ U_BN *cu_dev_ctz_binary_gcd(U_BN *a, U_BN *b){
+
+    U_BN *t;
+    int za, zb, c;
+
+    cu_bn_correct_top(a);
+    cu_bn_correct_top(b);
+    if (0 == a->top || cu_bn_is_zero(a))
+        return (b);
+    if (0 == b->top || cu_bn_is_zero(b))
+        return (a);
+
+    /* odd operands, the common power of two is restored at the end */
+    za = cu_dev_bn_ctz(a);
+    zb = cu_dev_bn_ctz(b);
+    cu_dev_bn_rshift(a, za);
+    cu_dev_bn_rshift(b, zb);
+
+    /* the comparison usually ends at the top word, the rest is one pass */
+    while ((c = cu_dev_bn_ucmp(a, b)) != 0) {
+        if (c < 0) {
+            t = a;
+            a = b;
+            b = t;
         }
+        cu_dev_bn_sub_rshift(a, b);
+    }
+    if (za && zb)
+        cu_dev_bn_lshift(a, (za < zb) ? za : zb);
+    return (a);
+
+}
+
+__host__ __device__ int cu_dev_bn_pm_rshift(U_BN *b, const U_BN *a){
+
+    unsigned long long t;
+    unsigned carry = 0, w, x, y, prev = 0, s = 0, add;
+    int i, n, out = 0, found = -1;
+
+    /* odd a and b, whichever of a + b and a - b is divisible by 4, one pass either way */
+    add = (0 == ((a->d[0] + b->d[0]) & 3));
+    n = (a->top > b->top) ? a->top : b->top;
+    for (i = 0; i < n; i++) {
+        x = (i < a->top) ? a->d[i] : 0;
+        y = (i < b->top) ? b->d[i] : 0;
+        if (add) {
+            t = (unsigned long long)x + y + carry;
+            carry = Hw(t);
+        } else {
+            t = (unsigned long long)x - y - carry;
+            carry = Hw(t) ? 1 : 0;
+        }
+        w = Lw(t);
+        if (found < 0) {
+            if (0 == w)
+                continue;
+            found = i;
+            s = cu_dev_ctz_word(w);
+        } else {
+            b->d[out++] = s ? (prev >> s) | (w << (CU_BN_BITS2 - s)) : prev;
+        }
+        prev = w;
+    }
+    if (found < 0) {
+        /* zero, or a sum that is a power of two words */
+        b->d[0] = carry;
+        b->top = 1;
+        return (carry ? n * CU_BN_BITS2 : 0);
+    }
+
+    /* the word above the top one is the carry of a sum or the sign of a difference */
+    w = add ? carry : (carry ? CU_BN_MASK2 : 0);
+    b->d[out++] = s ? (prev >> s) | (w << (CU_BN_BITS2 - s)) : prev;
+    if (add && 0 == s && w)
+        b->d[out++] = w;
+    if (!add && carry) {
+        for (i = 0; i < out; i++)
+            b->d[i] = ~b->d[i];
+        for (i = 0; i < out && ++b->d[i] == 0; i++)
+            ;
+    }
+    b->top = out;
+    cu_bn_correct_top(b);
+    return (found * CU_BN_BITS2 + s);
+
+}
+
+__host__ __device__ U_BN *cu_dev_pm_gcd(U_BN *a, U_BN *b){
+
+    U_BN *t;
+    int za, zb, alfa, beta, tmp;
+
+    cu_bn_correct_top(a);
+    cu_bn_correct_top(b);
+    if (0 == a->top || cu_bn_is_zero(a))
+        return (b);
+    if (0 == b->top || cu_bn_is_zero(b))
+        return (a);
+
+    za = cu_dev_bn_ctz(a);
+    zb = cu_dev_bn_ctz(b);
+    cu_dev_bn_rshift(a, za);
+    cu_dev_bn_rshift(b, zb);
+
+    /* b keeps the larger bound, each step lowers it by at least one bit without comparing a and b */
+    alfa = cu_dev_bn_num_bits(a);
+    beta = cu_dev_bn_num_bits(b);
+    while (!cu_bn_is_zero(b)) {
+        if (alfa > beta) {
+            t = a;
+            a = b;
+            b = t;
+            tmp = alfa;
+            alfa = beta;
+            beta = tmp;
+        }
+        beta += 1 - cu_dev_bn_pm_rshift(b, a);
+    }
+    if (za && zb)
+        cu_dev_bn_lshift(a, (za < zb) ? za : zb);
+    return (a);
+
+}
+
+__host__ __device__ int cu_dev_bn_abs_submul(U_BN *a, const U_BN *b, unsigned q, unsigned s){
+
+    unsigned long long m, t;
+    unsigned c = 0, p, prev = 0, w, borrow = 0, over = 0, sw, sb;
+    int i, j;
+
+    if (NULL == a || NULL == b || NULL == a->d || NULL == b->d)
+        return 0;
+    sw = s / CU_BN_BITS2;
+    sb = s % CU_BN_BITS2;
+
+    /* a - q b 2^s word by word, the product shifted as it is formed */
+    for (i = sw, j = 0; j <= b->top; i++, j++) {
+        if (j < b->top) {
+            m = (unsigned long long)q * b->d[j] + c;
+            p = Lw(m);
+            c = Hw(m);
+        } else {
+            p = c;
+        }
+        w = sb ? (p << sb) | (prev >> (CU_BN_BITS2 - sb)) : p;
+        prev = p;
+        if (i < a->top) {
+            t = (unsigned long long)a->d[i] - w - borrow;
+            a->d[i] = Lw(t);
+            borrow = Hw(t) ? 1 : 0;
+        } else {
+            over |= w;
+        }
+    }
+    w = sb ? prev >> (CU_BN_BITS2 - sb) : 0;
+    for (; i < a->top && (w || borrow); i++) {
+        t = (unsigned long long)a->d[i] - w - borrow;
+        a->d[i] = Lw(t);
+        borrow = Hw(t) ? 1 : 0;
+        w = 0;
+    }
+    over |= w;
+
+    /* an estimate above a leaves the two's complement of the difference */
+    if (borrow || over) {
+        for (i = 0; i < a->top; i++)
+            a->d[i] = ~a->d[i];
+        for (i = 0; i < a->top && ++a->d[i] == 0; i++)
+            ;
+    }
+    cu_bn_correct_top(a);
+    if (0 == a->top) {
+        a->d[0] = 0;
+        a->top = 1;
+    }
+    return (1);
+
+}
+
+__host__ __device__ U_BN *cu_dev_approximate_euclid(U_BN *a, U_BN *b){
+
+    unsigned long long q;
+    U_BN *t;
+    int la, lb, e, tmp;
+
+    cu_bn_correct_top(a);
+    cu_bn_correct_top(b);
+    if (0 == a->top || cu_bn_is_zero(a))
+        return (b);
+    if (0 == b->top || cu_bn_is_zero(b))
+        return (a);
+
+    for (;;) {
+        la = cu_dev_bn_num_bits(a);
+        lb = cu_dev_bn_num_bits(b);
+        if (la < lb) {
+            t = a;
+            a = b;
+            b = t;
+            tmp = la;
+            la = lb;
+            lb = tmp;
+        }
+        if (0 == lb)
+            break;
+
+        /* a / b is about q 2^e from the top 64 bits of a and 32 bits of b, one word of it is taken */
+        e = la - lb - CU_BN_BITS2;
+        q = cu_dev_bn_top64(a, la) / (cu_dev_bn_top64(b, lb) >> CU_BN_BITS2);
+        while (q > CU_BN_MASK2) {
+            q >>= 1;
+            e++;
+        }
+        if (e < 0) {
+            q >>= -e;
+            e = 0;
+        }
+        cu_dev_bn_abs_submul(a, b, q ? (unsigned)q : 1, e);
+    }
+    return (a);
+
+}
+
+__host__ __device__ int cu_dev_bn_lincomb_rshift(U_BN *a, const U_BN *b, unsigned x, unsigned y, int add, int s){
+
+    unsigned long long p, q, t;
+    unsigned cp = 0, cq = 0, c = 0, ai, bi;
+    int i, n;
+
+    if (NULL == a || NULL == b || NULL == a->d || NULL == b->d)
+        return 0;
+    n = (a->top > b->top) ? a->top : b->top;
+
+    /* x a + y b or x a - y b word by word, written back s words lower, its low s words are zero */
+    for (i = 0; i < n + 2; i++) {
+        ai = (i < a->top) ? a->d[i] : 0;
+        bi = (i < b->top) ? b->d[i] : 0;
+        p = (unsigned long long)x * ai + cp;
+        cp = Hw(p);
+        q = (unsigned long long)y * bi + cq;
+        cq = Hw(q);
+        if (add) {
+            t = (unsigned long long)Lw(p) + Lw(q) + c;
+            c = Hw(t);
+        } else {
+            t = (unsigned long long)Lw(p) - Lw(q) - c;
+            c = Hw(t) ? 1 : 0;
+        }
+        if (i >= s && i - s < n)
+            a->d[i - s] = Lw(t);
+    }
+    if (!add && c) {
+        for (i = 0; i < n; i++)
+            a->d[i] = ~a->d[i];
+        for (i = 0; i < n && ++a->d[i] == 0; i++)
+            ;
+    }
+    a->top = n;
+    cu_bn_correct_top(a);
+    if (0 == a->top) {
+        a->d[0] = 0;
+        a->top = 1;
+    }
+    return (1);
+
+}
+
+static __host__ __device__ unsigned long long cu_dev_kary_inverse(unsigned long long v){
+
+    unsigned long long x = (3 * v) ^ 2;
+    int i;
+
+    /* 5 correct low bits of 1 / v, doubled by every Newton step */
+    for (i = 0; i < 4; i++)
+        x *= 2 - v * x;
+    return (x);
+
+}
+
+static __host__ __device__ unsigned long long cu_dev_bn_low64(const U_BN *a){
+
+    return (a->d[0] | ((a->top > 1) ? (unsigned long long)a->d[1] << 32 : 0));
+
+}
+
+static __host__ __device__ void cu_dev_kary_ratmod(unsigned long long c, unsigned *n, long long *d){
+
+    unsigned long long n1, n2, q, t;
+    long long d1, d2, e;
+
+    /* n = d c mod 2^64 with n and |d| below 2^32, by Euclid on 2^64 and c stopped half way */
+    if (c <= CU_BN_MASK2) {
+        *n = (unsigned)c;
+        *d = 1;
+        return;
+    }
+    q = (0 - c) / c + 1;
+    n1 = c;
+    n2 = (0 - c) % c;
+    d1 = 1;
+    d2 = -(long long)q;
+    while (n2 > CU_BN_MASK2) {
+        q = n1 / n2;
+        t = n1 - q * n2;
+        n1 = n2;
+        n2 = t;
+        e = d1 - (long long)q * d2;
+        d1 = d2;
+        d2 = e;
+    }
+    *n = (unsigned)n2;
+    *d = d2;
+
+}
+
+static __host__ __device__ int cu_dev_kary_step(U_BN *a, const U_BN *b, int la, int lb){
+
+    unsigned long long c;
+    long long d;
+    unsigned n;
+    int z;
+
+    /* odd a and b, a the longer one, returns 1 if a multiplier of a may bring in a factor */
+    if (la - lb >= CU_BN_BITS2) {
+        /* a - c b clears the low word of a without a multiplier on it */
+        c = (unsigned)(a->d[0] * (unsigned)cu_dev_kary_inverse(b->d[0]));
+        cu_dev_bn_lincomb_rshift(a, b, 1, (unsigned)c, 0, 1);
+        d = 1;
+    } else {
+        /* d a - n b with word multipliers clears the low two words of a */
+        c = cu_dev_bn_low64(a) * cu_dev_kary_inverse(cu_dev_bn_low64(b));
+        cu_dev_kary_ratmod(c, &n, &d);
+        cu_dev_bn_lincomb_rshift(a, b, (unsigned)((d < 0) ? -d : d), n, d < 0, 2);
+    }
+    if ((z = cu_dev_bn_ctz(a)) != 0)
+        cu_dev_bn_rshift(a, z);
+    return (d != 1);
+
+}
+
+static __host__ __device__ void cu_dev_kary_clean(U_BN *a, U_BN *u, U_BN *v){
+
+    U_BN *r;
+    int i;
+
+    /* gcd(a, u, v) drops factors of the multipliers, a is usually one word by now */
+    if (cu_bn_is_one(a))
+        return;
+    cu_dev_bn_umod(u, a);
+    r = cu_dev_ctz_binary_gcd(a, u);
+    cu_dev_bn_umod(v, r);
+    r = cu_dev_ctz_binary_gcd(r, v);
+    if (r != a) {
+        for (i = 0; i < r->top; i++)
+            a->d[i] = r->d[i];
+        a->top = r->top;
+    }
+
+}
+
+__host__ __device__ U_BN *cu_dev_kary_gcd(U_BN *a, U_BN *b){
+
+    unsigned ud[CU_DEV_KARY_MAX_BITS / CU_BN_BITS2], vd[CU_DEV_KARY_MAX_BITS / CU_BN_BITS2];
+    U_BN u, v, *t;
+    int za, zb, la, lb, i, spurious = 0;
+
+    cu_bn_correct_top(a);
+    cu_bn_correct_top(b);
+    if (0 == a->top || cu_bn_is_zero(a))
+        return (b);
+    if (0 == b->top || cu_bn_is_zero(b))
+        return (a);
+    if (a->top * CU_BN_BITS2 > CU_DEV_KARY_MAX_BITS || b->top * CU_BN_BITS2 > CU_DEV_KARY_MAX_BITS)
+        return (cu_dev_ctz_binary_gcd(a, b));
+
+    za = cu_dev_bn_ctz(a);
+    zb = cu_dev_bn_ctz(b);
+    cu_dev_bn_rshift(a, za);
+    cu_dev_bn_rshift(b, zb);
+
+    /* the odd operands are kept to remove the factors the multipliers of a bring in */
+    u.d = ud;
+    v.d = vd;
+    u.top = a->top;
+    v.top = b->top;
+    for (i = 0; i < a->top; i++)
+        ud[i] = a->d[i];
+    for (i = 0; i < b->top; i++)
+        vd[i] = b->d[i];
+
+    for (;;) {
+        la = cu_dev_bn_num_bits(a);
+        lb = cu_dev_bn_num_bits(b);
+        if (la < lb) {
+            t = a;
+            a = b;
+            b = t;
+            i = la;
+            la = lb;
+            lb = i;
+        }
+        if (0 == lb)
+            break;
+        spurious |= cu_dev_kary_step(a, b, la, lb);
+    }
+    if (spurious)
+        cu_dev_kary_clean(a, &u, &v);
+    if (za && zb)
+        cu_dev_bn_lshift(a, (za < zb) ? za : zb);
+    return (a);
+
+}
+
+static __host__ __device__ int cu_dev_ctz_dword(unsigned long long w){
+
+#if defined(__CUDA_ARCH__)
+    return (__ffsll(w) - 1);
+#else
+    return (__builtin_ctzll(w));
+#endif
+
+}
+
+__host__ __device__ void cu_dev_pair_binary_steps(unsigned long long *x, unsigned long long *y){
+
+    unsigned long long w;
+    int s;
+
+    /* the steps of the __int128 loop with the borrow and shift across the words */
+    while ((x[1] || y[1]) && (x[0] != y[0] || x[1] != y[1])) {
+        if (x[1] < y[1] || (x[1] == y[1] && x[0] < y[0])) {
+            w = x[0];
+            x[0] = y[0];
+            y[0] = w;
+            w = x[1];
+            x[1] = y[1];
+            y[1] = w;
+        }
+        x[1] -= y[1] + (x[0] < y[0]);
+        x[0] -= y[0];
+        if (0 == x[0]) {
+            x[0] = x[1] >> cu_dev_ctz_dword(x[1]);
+            x[1] = 0;
+        } else {
+            s = cu_dev_ctz_dword(x[0]);
+            x[0] = (x[0] >> s) | (x[1] << (64 - s));
+            x[1] >>= s;
+        }
+    }
+
+}
+
+static __host__ __device__ void cu_dev_native_gcd(unsigned long long *x, unsigned long long *y){
+
+    unsigned long long p, q, w;
+#if !defined(__CUDA_ARCH__)
+    unsigned __int128 g, h, t;
+
+    /* odd x and y as low and high words, binary steps on two words until both fit one */
+    g = ((unsigned __int128)x[1] << 64) | x[0];
+    h = ((unsigned __int128)y[1] << 64) | y[0];
+    while (((g >> 64) || (h >> 64)) && g != h) {
+        if (g < h) {
+            t = g;
+            g = h;
+            h = t;
+        }
+        g -= h;
+        g >>= ((unsigned long long)g) ? cu_dev_ctz_dword((unsigned long long)g) : 64 + cu_dev_ctz_dword((unsigned long long)(g >> 64));
+    }
+    x[0] = (unsigned long long)g;
+    x[1] = (unsigned long long)(g >> 64);
+    y[0] = (unsigned long long)h;
+    y[1] = (unsigned long long)(h >> 64);
+#else
+    /* no __int128 on the device */
+    cu_dev_pair_binary_steps(x, y);
+#endif
+    if (x[1])
+        return;
+    p = x[0];
+    q = y[0];
+    while (p != q) {
+        if (p < q) {
+            w = p;
+            p = q;
+            q = w;
+        }
+        p -= q;
+        p >>= cu_dev_ctz_dword(p);
+    }
+    x[0] = p;
+
+}
+
+__host__ __device__ U_BN *cu_dev_hybrid_gcd(U_BN *a, U_BN *b){
+
+    unsigned ud[CU_DEV_KARY_MAX_BITS / CU_BN_BITS2], vd[CU_DEV_KARY_MAX_BITS / CU_BN_BITS2];
+    unsigned long long x[2], y[2];
+    U_BN u, v, *t;
+    int za, zb, la, lb, i, spurious = 0;
+
+    cu_bn_correct_top(a);
+    cu_bn_correct_top(b);
+    if (0 == a->top || cu_bn_is_zero(a))
+        return (b);
+    if (0 == b->top || cu_bn_is_zero(b))
+        return (a);
+    if (a->top * CU_BN_BITS2 > CU_DEV_KARY_MAX_BITS || b->top * CU_BN_BITS2 > CU_DEV_KARY_MAX_BITS)
+        return (cu_dev_ctz_binary_gcd(a, b));
+
+    za = cu_dev_bn_ctz(a);
+    zb = cu_dev_bn_ctz(b);
+    cu_dev_bn_rshift(a, za);
+    cu_dev_bn_rshift(b, zb);
+    u.d = ud;
+    v.d = vd;
+    u.top = a->top;
+    v.top = b->top;
+    for (i = 0; i < a->top; i++)
+        ud[i] = a->d[i];
+    for (i = 0; i < b->top; i++)
+        vd[i] = b->d[i];
+
+    /* k-ary steps run over the words left as the operands shrink, native integers finish the last ones */
+    for (;;) {
+        la = cu_dev_bn_num_bits(a);
+        lb = cu_dev_bn_num_bits(b);
+        if (la < lb) {
+            t = a;
+            a = b;
+            b = t;
+            i = la;
+            la = lb;
+            lb = i;
+        }
+        if (0 == lb)
+            break;
+        if (la <= CU_DEV_HYBRID_NATIVE_BITS) {
+            x[0] = x[1] = y[0] = y[1] = 0;
+            for (i = 0; i < a->top; i++)
+                x[i / 2] |= (unsigned long long)a->d[i] << ((i & 1) * CU_BN_BITS2);
+            for (i = 0; i < b->top; i++)
+                y[i / 2] |= (unsigned long long)b->d[i] << ((i & 1) * CU_BN_BITS2);
+            cu_dev_native_gcd(x, y);
+            for (i = 0; i < a->top; i++)
+                a->d[i] = (unsigned)(x[i / 2] >> ((i & 1) * CU_BN_BITS2));
+            cu_bn_correct_top(a);
+            break;
+        }
+        spurious |= cu_dev_kary_step(a, b, la, lb);
+    }
+    if (spurious)
+        cu_dev_kary_clean(a, &u, &v);
+    if (za && zb)
+        cu_dev_bn_lshift(a, (za < zb) ? za : zb);
+    return (a);
+
+}
+
+__host__ __device__ U_BN *cu_dev_classic_euclid(U_BN *a, U_BN *b){
+
+    U_BN *t;
+
+    /* remainders instead of repeated subtraction, a zero operand ends the loop */
+    while (0 != cu_dev_bn_num_bits(b)) {
+        if (!cu_dev_bn_umod(a, b))
+            break;
+        t = a;
+        a = b;
+        b = t;
     }
     return (a);
 
@@ -317,8 +1191,9 @@ void OpenSSL_GCD(unsigned number_of_keys, unsigned key_size, char *keys_director
     }
 
     free(tmp.d);
-    ctx = BN_CTX_new();
-    r=BN_new();
+    ctx = cu_bn_pool_ctx();
+    BN_CTX_start(ctx);
+    r = BN_CTX_get(ctx);
     clock_t start = clock();
     for(i=0, k=0; i<number_of_keys; i++){
         for(j=(i+1); j<number_of_keys; j++, k++){
@@ -332,8 +1207,7 @@ void OpenSSL_GCD(unsigned number_of_keys, unsigned key_size, char *keys_director
     double elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
     printf("[CPU] Time elapsed in ms: %f\n", elapsed);
     printf("[CPU] Weak keys: %u\n", sum);
-    BN_CTX_free(ctx);
-    BN_free(r);
+    BN_CTX_end(ctx);
 
 }
 
@@ -368,3 +1242,182 @@ __global__ void fastBinaryKernel(U_BN *A, U_BN *B, U_BN *C, unsigned n) {
         C[i] = *TMP;
     }
 }
+
+
+__host__ __device__ void cu_dev_pair_index(unsigned k, unsigned number_of_keys, unsigned *i, unsigned *j){
+
+    unsigned long long n = number_of_keys;
+    long r;
+
+    /* row r of the upper triangle starts at r*(2n-r-1)/2, estimate r and correct rounding */
+    r = (long)(n - 2) - (long)(sqrtf((float)(4*n*(n-1) - 8ULL*k - 7)) / 2.0f - 0.5f);
+    if (r < 0)
+        r = 0;
+    if (r > (long)n - 2)
+        r = (long)n - 2;
+    while (r > 0 && (unsigned long long)r*(2*n-r-1)/2 > k)
+        r--;
+    while ((unsigned long long)(r+1)*(2*n-r-2)/2 <= k)
+        r++;
+    *i = (unsigned)r;
+    *j = (unsigned)(k - (unsigned long long)r*(2*n-r-1)/2 + r + 1);
+
+}
+
+__host__ __device__ void cu_dev_scan_pair_index(unsigned k, unsigned number_of_keys, unsigned number_of_b_keys, unsigned *i, unsigned *j){
+
+    if (number_of_b_keys) {
+        *i = k / number_of_b_keys;
+        *j = number_of_keys + k % number_of_b_keys;
+    } else {
+        cu_dev_pair_index(k, number_of_keys, i, j);
+    }
+
+}
+
+__device__ int cu_dev_weak_pairs_push(WEAK_PAIRS *R, unsigned i, unsigned j, const U_BN *gcd){
+
+    unsigned slot;
+    unsigned *rp;
+    int top, l;
+
+    slot = atomicAdd(&R->count, 1);
+    if (slot >= R->capacity)
+        return 0;
+
+    top = (gcd->top < R->limbs) ? gcd->top : R->limbs;
+    rp = R->words + ((size_t)slot * R->limbs);
+    for (l = 0; l < top; l++)
+        rp[l] = gcd->d[l];
+    R->pairs[slot].i = i;
+    R->pairs[slot].j = j;
+    R->pairs[slot].gcd.d = rp;
+    R->pairs[slot].gcd.top = top;
+    return (1);
+
+}
+
+__global__ void orgEuclideanKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys) {
+    unsigned i, j;
+    unsigned k = blockIdx.x * blockDim.x + threadIdx.x;
+    U_BN *TMP=NULL;
+
+    if(k<number_of_comutations){
+        TMP = cu_dev_classic_euclid(&A[k], &B[k]);
+        if(!cu_bn_is_one(TMP)){
+            cu_dev_scan_pair_index(k, number_of_keys, number_of_b_keys, &i, &j);
+            cu_dev_weak_pairs_push(R, i, j, TMP);
+        }
+    }
+}
+
+__global__ void binEuclideanKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys) {
+    unsigned i, j;
+    unsigned k = blockIdx.x * blockDim.x + threadIdx.x;
+    U_BN *TMP=NULL;
+
+    if(k<number_of_comutations){
+        TMP = cu_dev_binary_gcd(&A[k], &B[k]);
+        if(!cu_bn_is_one(TMP)){
+            cu_dev_scan_pair_index(k, number_of_keys, number_of_b_keys, &i, &j);
+            cu_dev_weak_pairs_push(R, i, j, TMP);
+        }
+    }
+}
+
+__global__ void fastBinaryKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys) {
+    unsigned i, j;
+    unsigned k = blockIdx.x * blockDim.x + threadIdx.x;
+    U_BN *TMP=NULL;
+
+    if(k<number_of_comutations){
+        TMP = cu_dev_fast_binary_euclid(&A[k], &B[k]);
+        if(!cu_bn_is_one(TMP)){
+            cu_dev_scan_pair_index(k, number_of_keys, number_of_b_keys, &i, &j);
+            cu_dev_weak_pairs_push(R, i, j, TMP);
+        }
+    }
+}
+
+__global__ void ctzBinaryKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys) {
+    unsigned i, j;
+    unsigned k = blockIdx.x * blockDim.x + threadIdx.x;
+    U_BN *TMP=NULL;
+
+    if(k<number_of_comutations){
+        TMP = cu_dev_ctz_binary_gcd(&A[k], &B[k]);
+        if(!cu_bn_is_one(TMP)){
+            cu_dev_scan_pair_index(k, number_of_keys, number_of_b_keys, &i, &j);
+            cu_dev_weak_pairs_push(R, i, j, TMP);
+        }
+    }
+}
+__global__ void pmKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys) {
+    unsigned i, j;
+    unsigned k = blockIdx.x * blockDim.x + threadIdx.x;
+    U_BN *TMP=NULL;
+
+    if(k<number_of_comutations){
+        TMP = cu_dev_pm_gcd(&A[k], &B[k]);
+        if(!cu_bn_is_one(TMP)){
+            cu_dev_scan_pair_index(k, number_of_keys, number_of_b_keys, &i, &j);
+            cu_dev_weak_pairs_push(R, i, j, TMP);
+        }
+    }
+}
+
+__global__ void approximateEuclideanKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys) {
+    unsigned i, j;
+    unsigned k = blockIdx.x * blockDim.x + threadIdx.x;
+    U_BN *TMP=NULL;
+
+    if(k<number_of_comutations){
+        TMP = cu_dev_approximate_euclid(&A[k], &B[k]);
+        if(!cu_bn_is_one(TMP)){
+            cu_dev_scan_pair_index(k, number_of_keys, number_of_b_keys, &i, &j);
+            cu_dev_weak_pairs_push(R, i, j, TMP);
+        }
+    }
+}
+
+__global__ void divstepsKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys) {
+    unsigned i, j;
+    unsigned k = blockIdx.x * blockDim.x + threadIdx.x;
+    U_BN *TMP=NULL;
+
+    if(k<number_of_comutations){
+        TMP = cu_dev_divsteps_gcd(&A[k], &B[k]);
+        if(!cu_bn_is_one(TMP)){
+            cu_dev_scan_pair_index(k, number_of_keys, number_of_b_keys, &i, &j);
+            cu_dev_weak_pairs_push(R, i, j, TMP);
+        }
+    }
+}
+
+__global__ void karyKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys) {
+    unsigned i, j;
+    unsigned k = blockIdx.x * blockDim.x + threadIdx.x;
+    U_BN *TMP=NULL;
+
+    if(k<number_of_comutations){
+        TMP = cu_dev_kary_gcd(&A[k], &B[k]);
+        if(!cu_bn_is_one(TMP)){
+            cu_dev_scan_pair_index(k, number_of_keys, number_of_b_keys, &i, &j);
+            cu_dev_weak_pairs_push(R, i, j, TMP);
+        }
+    }
+}
+
+__global__ void hybridKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys) {
+    unsigned i, j;
+    unsigned k = blockIdx.x * blockDim.x + threadIdx.x;
+    U_BN *TMP=NULL;
+
+    if(k<number_of_comutations){
+        TMP = cu_dev_hybrid_gcd(&A[k], &B[k]);
+        if(!cu_bn_is_one(TMP)){
+            cu_dev_scan_pair_index(k, number_of_keys, number_of_b_keys, &i, &j);
+            cu_dev_weak_pairs_push(R, i, j, TMP);
+        }
+    }
+}
@@ -12,7 +12,26 @@
 #include "test.h"
 #include "cuda_bignum.h"
 #include "files_manager.h"
+#include "weak_pairs.h"
 #include <time.h>
+#include <math.h>
+
+/* divsteps per transition matrix, as many bits per signed limb, and the longest operands of cu_dev_divsteps_gcd */
+#define CU_DEV_DIVSTEPS_BATCH    30
+#ifndef CU_DEV_DIVSTEPS_MAX_BITS
+#define CU_DEV_DIVSTEPS_MAX_BITS 4096
+#endif
+#define CU_DEV_DIVSTEPS_LIMBS    ((CU_DEV_DIVSTEPS_MAX_BITS + CU_DEV_DIVSTEPS_BATCH) / CU_DEV_DIVSTEPS_BATCH + 1)
+
+/* longest operands of cu_dev_kary_gcd, copies of both are kept on the stack */
+#ifndef CU_DEV_KARY_MAX_BITS
+#define CU_DEV_KARY_MAX_BITS     4096
+#endif
+
+/* length in bits where cu_dev_hybrid_gcd leaves k-ary steps for native integers, two 64 bit words */
+#ifndef CU_DEV_HYBRID_NATIVE_BITS
+#define CU_DEV_HYBRID_NATIVE_BITS 128
+#endif
 
 
 
@@ -59,7 +78,8 @@ __host__ __device__ int cu_dev_bn_rshift1(U_BN *a);
 
 /** @brief cu_dev_bn_lshift
  *
- *	shifts a left by n bits and returns the result (r=a*2^n)
+ *	shifts a left by n bits and returns the result (r=a*2^n),
+ *	a must have room for the words of the result
  *
  *  @param[in,out] a U_BN struct
  *  @param[in] n number of bits to left
@@ -67,6 +87,36 @@ __host__ __device__ int cu_dev_bn_rshift1(U_BN *a);
  */
 __host__ __device__ int cu_dev_bn_lshift(U_BN *a, unsigned n);
 
+/** @brief cu_dev_bn_ctz
+ *
+ *	counts the trailing zero bits of a
+ *
+ *  @param[in] a U_BN struct
+ *  @return number of trailing zero bits, 0 if a is zero
+ */
+__host__ __device__ int cu_dev_bn_ctz(const U_BN *a);
+
+/** @brief cu_dev_bn_rshift
+ *
+ *	shifts a right by n bits in one pass over its words (a/2^n)
+ *
+ *  @param[in,out] a U_BN struct
+ *  @param[in] n number of bits to right
+ *  @return 1 on success
+ */
+__host__ __device__ int cu_dev_bn_rshift(U_BN *a, unsigned n);
+
+/** @brief cu_dev_bn_sub_rshift
+ *
+ *	places (a-b)/2^ctz(a-b) in a, subtracting and shifting in
+ *	one pass over the words of a.
+ *
+ *  @param[in,out] a U_BN struct, not below b
+ *  @param[in] b U_BN struct
+ *  @return 1 on success, 0 if a is below b
+ */
+__host__ __device__ int cu_dev_bn_sub_rshift(U_BN *a, const U_BN *b);
+
 /** @brief cu_dev_binary_gcd
  *
  *	computes the greatest common divisor of a and b using 
@@ -79,6 +129,27 @@ __host__ __device__ int cu_dev_bn_lshift(U_BN *a, unsigned n);
  */
 __host__ __device__ U_BN *cu_dev_binary_gcd(U_BN *a, U_BN *b);
 
+/** @brief cu_dev_divsteps_gcd
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	Bernstein and Yang's divsteps on signed limbs of 30 bits.
+ *	Batches of 30 divsteps are found branch free from the low
+ *	bits of f and g and applied to the limbs as one transition
+ *	matrix. The number of batches, the bound for operands of
+ *	the word count of a and b, and every loop depend only on
+ *	the word counts, not on the values, so pairs of keys of
+ *	one size take the same path. Only even operands add the
+ *	work of removing and restoring their common power of two.
+ *	Operands longer than CU_DEV_DIVSTEPS_MAX_BITS are left to
+ *	cu_dev_ctz_binary_gcd. r may be the same BIGNUM as a or b.
+ *	If one of them is zero the other one is returned.
+ *
+ *  @param[in,out] a U_BN struct
+ *  @param[in,out] b U_BN struct
+ *  @return r U_BN result of GCD
+ */
+__host__ __device__ U_BN *cu_dev_divsteps_gcd(U_BN *a, U_BN *b);
+
 /** @brief cu_dev_fast_binary_euclid
  *
  *	computes the greatest common divisor of a and b using 
@@ -91,11 +162,166 @@ __host__ __device__ U_BN *cu_dev_binary_gcd(U_BN *a, U_BN *b);
  */
 __host__ __device__ U_BN *cu_dev_fast_binary_euclid(U_BN *a, U_BN *b);
 
+/** @brief cu_dev_bn_umod
+ *
+ *	reduces a modulo b in place. Every step subtracts a word
+ *	multiple of b estimated from the top bits of a and b, so
+ *	each step clears about 31 bits of the quotient.
+ *
+ *  @param[in,out] a U_BN struct
+ *  @param[in] b U_BN struct modulus
+ *  @return 1 on success, 0 if b is zero
+ */
+__host__ __device__ int cu_dev_bn_umod(U_BN *a, const U_BN *b);
+
+/** @brief cu_dev_ctz_binary_gcd
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	binary Euclidean algorithm on odd operands, where every
+ *	step is cu_dev_bn_sub_rshift of the smaller from the larger
+ *	one. r may be the same BIGNUM as a or b. If one of them is
+ *	zero the other one is returned.
+ *
+ *  @param[in,out] a U_BN struct
+ *  @param[in,out] b U_BN struct
+ *  @return r U_BN result of GCD
+ */
+__host__ __device__ U_BN *cu_dev_ctz_binary_gcd(U_BN *a, U_BN *b);
+
+/** @brief cu_dev_bn_pm_rshift
+ *
+ *	places |a+b| or |a-b|, whichever is divisible by 4, shifted
+ *	by its trailing zeros in b, in one pass over the words and
+ *	a second one only for a negative difference.
+ *
+ *  @param[in,out] b U_BN struct, odd, with room for the words of a
+ *  @param[in] a U_BN struct, odd
+ *  @return number of bits shifted out, 0 if the result is zero
+ */
+__host__ __device__ int cu_dev_bn_pm_rshift(U_BN *b, const U_BN *a);
+
+/** @brief cu_dev_pm_gcd
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	Brent and Kung's plus-minus algorithm on odd operands.
+ *	Every step is cu_dev_bn_pm_rshift of the operand with the
+ *	larger bound on its bit length, chosen by the bounds alone,
+ *	so the steps take the same work whatever the values. r may
+ *	be the same BIGNUM as a or b. If one of them is zero the
+ *	other one is returned.
+ *
+ *  @param[in,out] a U_BN struct
+ *  @param[in,out] b U_BN struct
+ *  @return r U_BN result of GCD
+ */
+__host__ __device__ U_BN *cu_dev_pm_gcd(U_BN *a, U_BN *b);
+
+/** @brief cu_dev_bn_abs_submul
+ *
+ *	places |a - q b 2^s| in a, multiplying, shifting and
+ *	subtracting in one pass over the words of b and a second
+ *	one only if q b 2^s is above a.
+ *
+ *  @param[in,out] a U_BN struct, |a - q b 2^s| must fit its words
+ *  @param[in] b U_BN struct
+ *  @param[in] q unsigned integer word multiplier
+ *  @param[in] s shift in bits
+ *  @return 1 on success, 0 on NULL input
+ */
+__host__ __device__ int cu_dev_bn_abs_submul(U_BN *a, const U_BN *b, unsigned q, unsigned s);
+
+/** @brief cu_dev_approximate_euclid
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	approximate Euclidean algorithm, every step is
+ *	cu_dev_bn_abs_submul of the smaller operand from the larger
+ *	one with a word quotient estimated from their leading bits.
+ *	r may be the same BIGNUM as a or b. If one of them is zero
+ *	the other one is returned.
+ *
+ *  @param[in,out] a U_BN struct
+ *  @param[in,out] b U_BN struct
+ *  @return r U_BN result of GCD
+ */
+__host__ __device__ U_BN *cu_dev_approximate_euclid(U_BN *a, U_BN *b);
+
+/** @brief cu_dev_bn_lincomb_rshift
+ *
+ *	places (x a + y b) / 2^(32 s) in a if add is set and
+ *	|x a - y b| / 2^(32 s) otherwise, in one pass over the
+ *	words and a second one only for a negative difference.
+ *	The low s words of the combination must be zero.
+ *
+ *  @param[in,out] a U_BN struct, not shorter than b, the result must fit its words
+ *  @param[in] b U_BN struct
+ *  @param[in] x unsigned integer word multiplier of a
+ *  @param[in] y unsigned integer word multiplier of b
+ *  @param[in] add 1 for the sum, 0 for the difference
+ *  @param[in] s number of words shifted out
+ *  @return 1 on success, 0 on NULL input
+ */
+__host__ __device__ int cu_dev_bn_lincomb_rshift(U_BN *a, const U_BN *b, unsigned x, unsigned y, int add, int s);
+
+/** @brief cu_dev_kary_gcd
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	Sorenson's k-ary reduction with Weber's acceleration, k
+ *	is 2^64. For odd operands of close lengths, words n and d
+ *	with n = d a / b mod 2^64 are found by half of Euclid's
+ *	algorithm on 2^64 and a / b mod 2^64, and the larger one
+ *	becomes |d a - n b| / 2^64, so a step clears about 31
+ *	bits. Longer operands lose a word per step to a - c b
+ *	with c = a / b mod 2^32. The factors brought in by d are
+ *	removed at the end by GCDs with the odd operands, kept on
+ *	the stack. Operands longer than CU_DEV_KARY_MAX_BITS are
+ *	left to cu_dev_ctz_binary_gcd. r may be the same BIGNUM
+ *	as a or b. If one of them is zero the other one is
+ *	returned.
+ *
+ *  @param[in,out] a U_BN struct
+ *  @param[in,out] b U_BN struct
+ *  @return r U_BN result of GCD
+ */
+__host__ __device__ U_BN *cu_dev_kary_gcd(U_BN *a, U_BN *b);
+
+/** @brief cu_dev_pair_binary_steps
+ *
+ *	binary GCD steps on odd x and y held as low and high 64 bit
+ *	words, the subtraction with borrow and the shift across the
+ *	words, until both fit the low word or x equals y. This is
+ *	how cu_dev_hybrid_gcd steps on the device, where there is no
+ *	unsigned __int128; on the host it keeps __int128.
+ *
+ *  @param[in,out] x odd low and high words
+ *  @param[in,out] y odd low and high words
+ *  @return Void
+ */
+__host__ __device__ void cu_dev_pair_binary_steps(unsigned long long *x, unsigned long long *y);
+
+/** @brief cu_dev_hybrid_gcd
+ *
+ *	computes the greatest common divisor of a and b switching
+ *	algorithms as the lengths of the odd operands shrink:
+ *	k-ary steps of cu_dev_kary_gcd while the longer one has
+ *	more than CU_DEV_HYBRID_NATIVE_BITS bits, then binary steps
+ *	on native integers, unsigned __int128 on the host and pairs
+ *	of 64 bit words on the device, down to single 64 bit words.
+ *	Operands longer than CU_DEV_KARY_MAX_BITS are left to
+ *	cu_dev_ctz_binary_gcd. r may be the same BIGNUM as a or b.
+ *	If one of them is zero the other one is returned.
+ *
+ *  @param[in,out] a U_BN struct
+ *  @param[in,out] b U_BN struct
+ *  @return r U_BN result of GCD
+ */
+__host__ __device__ U_BN *cu_dev_hybrid_gcd(U_BN *a, U_BN *b);
+
 /** @brief cu_dev_classic_euclid
  *
  *	computes the greatest common divisor of a and b using 
- *	Euclidean algorithm and return the result in r. 
- *	r may be the same BIGNUM as a or b.
+ *	Euclidean algorithm with remainders and return the result
+ *	in r. r may be the same BIGNUM as a or b. If one of them is
+ *	zero the other one is returned.
  *
  *  @param[in,out] a U_BN struct
  *  @param[in,out] b U_BN struct
@@ -156,11 +382,188 @@ __global__ void binEuclideanKernel(U_BN *A, U_BN *B, U_BN *C, unsigned n);
  */
 __global__ void fastBinaryKernel(U_BN *A, U_BN *B, U_BN *C, unsigned n);
 
-/* TO DO*/
-__global__ void orgEuclideanKernel_with_selection(U_BN *A, U_BN *B, U_BN *R, unsigned number_of_comutations, unsigned number_of_keys);
-/* TO DO*/
-__global__ void binEuclideanKernel_with_selection(U_BN *A, U_BN *B, U_BN *R, unsigned number_of_comutations, unsigned number_of_keys);
-/* TO DO*/
-__global__ void fastBinaryKernel_with_selection(U_BN *A, U_BN *B, U_BN *R, unsigned number_of_comutations, unsigned number_of_keys);
+/** @brief cu_dev_pair_index
+ *
+ *	maps index k of the upper triangle of number_of_keys keys, 
+ *	enumerated row by row, to the key pair (i, j) with i < j.
+ *
+ *  @param[in] k index of pair
+ *  @param[in] number_of_keys number of keys
+ *  @param[out] i index of first key
+ *  @param[out] j index of second key
+ *  @return Void
+ */
+__host__ __device__ void cu_dev_pair_index(unsigned k, unsigned number_of_keys, unsigned *i, unsigned *j);
+
+/** @brief cu_dev_scan_pair_index
+ *
+ *	maps index k of a scan to the key pair (i, j). Without corpus keys
+ *	it is the upper triangle of number_of_keys keys, otherwise the
+ *	bipartite scan of every key against every corpus key, enumerated
+ *	row by row, with corpus keys indexed after the keys.
+ *
+ *  @param[in] k index of pair
+ *  @param[in] number_of_keys number of keys
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @param[out] i index of first key
+ *  @param[out] j index of second key
+ *  @return Void
+ */
+__host__ __device__ void cu_dev_scan_pair_index(unsigned k, unsigned number_of_keys, unsigned number_of_b_keys, unsigned *i, unsigned *j);
+
+/** @brief cu_dev_weak_pairs_push
+ *
+ *	appends finding (i, j, gcd) to device weak pairs collection,
+ *	reserving its slot with a single atomicAdd.
+ *
+ *  @param[in,out] R device WEAK_PAIRS struct
+ *  @param[in] i index of first key
+ *  @param[in] j index of second key
+ *  @param[in] gcd U_BN greatest common divisor
+ *  @return 1 on success, 0 if R is full
+ */
+__device__ int cu_dev_weak_pairs_push(WEAK_PAIRS *R, unsigned i, unsigned j, const U_BN *gcd);
+
+/** @brief orgEuclideanKernel_with_selection
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	Euclidean algorithm and appends only non-trivial results
+ *	to R, so coprime pairs are never copied back.
+ *
+ *  @param[in,out] A U_BN array
+ *  @param[in,out] B U_BN array
+ *  @param[in,out] R device WEAK_PAIRS collection
+ *  @param[in] number_of_comutations A, B size 
+ *  @param[in] number_of_keys number of keys paired in A, B
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @return Void
+ */
+__global__ void orgEuclideanKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys);
+
+/** @brief binEuclideanKernel_with_selection
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	binary Euclidean algorithm and appends only non-trivial 
+ *	results to R, so coprime pairs are never copied back.
+ *
+ *  @param[in,out] A U_BN array
+ *  @param[in,out] B U_BN array
+ *  @param[in,out] R device WEAK_PAIRS collection
+ *  @param[in] number_of_comutations A, B size 
+ *  @param[in] number_of_keys number of keys paired in A, B
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @return Void
+ */
+__global__ void binEuclideanKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys);
+
+/** @brief fastBinaryKernel_with_selection
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	fast binary Euclidean algorithm and appends only non-trivial 
+ *	results to R, so coprime pairs are never copied back.
+ *
+ *  @param[in,out] A U_BN array
+ *  @param[in,out] B U_BN array
+ *  @param[in,out] R device WEAK_PAIRS collection
+ *  @param[in] number_of_comutations A, B size 
+ *  @param[in] number_of_keys number of keys paired in A, B
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @return Void
+ */
+__global__ void fastBinaryKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys);
+
+/** @brief ctzBinaryKernel_with_selection
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	binary Euclidean algorithm with trailing zero counts and
+ *	appends only non-trivial results to R.
+ *
+ *  @param[in,out] A U_BN array
+ *  @param[in,out] B U_BN array
+ *  @param[in,out] R device WEAK_PAIRS collection
+ *  @param[in] number_of_comutations A, B size 
+ *  @param[in] number_of_keys number of keys paired in A, B
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @return Void
+ */
+__global__ void ctzBinaryKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys);
+
+/** @brief pmKernel_with_selection
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	plus-minus algorithm and appends only non-trivial results
+ *	to R.
+ *
+ *  @param[in,out] A U_BN array
+ *  @param[in,out] B U_BN array
+ *  @param[in,out] R device WEAK_PAIRS collection
+ *  @param[in] number_of_comutations A, B size 
+ *  @param[in] number_of_keys number of keys paired in A, B
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @return Void
+ */
+__global__ void pmKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys);
+
+/** @brief approximateEuclideanKernel_with_selection
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	approximate Euclidean algorithm and appends only
+ *	non-trivial results to R.
+ *
+ *  @param[in,out] A U_BN array
+ *  @param[in,out] B U_BN array
+ *  @param[in,out] R device WEAK_PAIRS collection
+ *  @param[in] number_of_comutations A, B size 
+ *  @param[in] number_of_keys number of keys paired in A, B
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @return Void
+ */
+__global__ void approximateEuclideanKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys);
+
+/** @brief divstepsKernel_with_selection
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	divsteps and appends only non-trivial results to R.
+ *	Threads of a warp run the same steps for keys of one size.
+ *
+ *  @param[in,out] A U_BN array
+ *  @param[in,out] B U_BN array
+ *  @param[in,out] R device WEAK_PAIRS collection
+ *  @param[in] number_of_comutations A, B size 
+ *  @param[in] number_of_keys number of keys paired in A, B
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @return Void
+ */
+__global__ void divstepsKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys);
+
+/** @brief karyKernel_with_selection
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	k-ary algorithm and appends only non-trivial results to R.
+ *
+ *  @param[in,out] A U_BN array
+ *  @param[in,out] B U_BN array
+ *  @param[in,out] R device WEAK_PAIRS collection
+ *  @param[in] number_of_comutations A, B size 
+ *  @param[in] number_of_keys number of keys paired in A, B
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @return Void
+ */
+__global__ void karyKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys);
+
+/** @brief hybridKernel_with_selection
+ *
+ *	computes the greatest common divisor of a and b using 
+ *	hybrid algorithm and appends only non-trivial results to R.
+ *
+ *  @param[in,out] A U_BN array
+ *  @param[in,out] B U_BN array
+ *  @param[in,out] R device WEAK_PAIRS collection
+ *  @param[in] number_of_comutations A, B size 
+ *  @param[in] number_of_keys number of keys paired in A, B
+ *  @param[in] number_of_b_keys number of corpus keys, 0 for all pairs
+ *  @return Void
+ */
+__global__ void hybridKernel_with_selection(U_BN *A, U_BN *B, WEAK_PAIRS *R, unsigned number_of_comutations, unsigned number_of_keys, unsigned number_of_b_keys);
 
 #endif // #ifndef _DEVICE_CUDA_BIGNUM_H_
\ No newline at end of file
@@ -0,0 +1,333 @@
+/** @file div_mod.cu
+ *  @brief Division of word arrays
+ *
+ *	Knuth Algorithm D and Newton reciprocal Barrett division.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include "cuda_bignum.h"
+#include "div_mod.h"
+
+#ifndef MAX
+#define MAX(a,b) (a > b ? a : b)
+#endif
+
+#ifndef MIN
+#define MIN(a,b) (a < b ? a : b)
+#endif
+
+static int div_clz(unsigned w){
+
+    int n = 0;
+
+    while (!(w & 0x80000000u)) {
+        w <<= 1;
+        n++;
+    }
+    return (n);
+
+}
+
+static unsigned div_lshift(unsigned *r, const unsigned *a, int n, int s){
+
+    unsigned out;
+    int i;
+
+    /* top down, so r may alias a */
+    if (0 == s) {
+        memmove(r, a, n * sizeof(unsigned));
+        return (0);
+    }
+    out = a[n - 1] >> (32 - s);
+    for (i = n - 1; i > 0; i--)
+        r[i] = (a[i] << s) | (a[i - 1] >> (32 - s));
+    r[0] = a[0] << s;
+    return (out);
+
+}
+
+static void div_rshift(unsigned *r, const unsigned *a, int n, int s){
+
+    int i;
+
+    if (0 == s) {
+        memmove(r, a, n * sizeof(unsigned));
+        return;
+    }
+    for (i = 0; i < n - 1; i++)
+        r[i] = (a[i] >> s) | (a[i + 1] << (32 - s));
+    r[n - 1] = a[n - 1] >> s;
+
+}
+
+static int div_cmp(const unsigned *a, int na, const unsigned *b, int nb){
+
+    int i;
+
+    for (i = MAX(na, nb) - 1; i >= 0; i--) {
+        unsigned x = (i < na) ? a[i] : 0, y = (i < nb) ? b[i] : 0;
+        if (x != y)
+            return ((x > y) ? 1 : -1);
+    }
+    return (0);
+
+}
+
+static void div_inc(unsigned *a, int n){
+
+    int i;
+
+    for (i = 0; i < n && ++a[i] == 0; i++)
+        ;
+
+}
+
+static void div_dec(unsigned *a, int n){
+
+    int i;
+
+    for (i = 0; i < n && a[i]-- == 0; i++)
+        ;
+
+}
+
+static void div_sub(unsigned *a, int na, const unsigned *b, int nb){
+
+    /* a -= b for a >= b */
+    if (cu_bn_sub_words(a, a, b, nb))
+        div_dec(a + nb, na - nb);
+
+}
+
+static unsigned div_word(unsigned *q, const unsigned *a, int n, unsigned d){
+
+    unsigned long long t;
+    unsigned rem = 0;
+    int i;
+
+    for (i = n - 1; i >= 0; i--) {
+        t = ((unsigned long long)rem << 32) | a[i];
+        rem = (unsigned)(t % d);
+        if (NULL != q)
+            q[i] = (unsigned)(t / d);
+    }
+    return (rem);
+
+}
+
+static void div_knuth(unsigned *q, unsigned *u, int m, const unsigned *v, int n){
+
+    unsigned long long qhat, rhat, p;
+    long long t, k;
+    int i, j;
+
+    /* u has m + 1 words, v has n >= 2 words with the top bit set, the remainder is left in u */
+    for (j = m - n; j >= 0; j--) {
+        p = ((unsigned long long)u[j + n] << 32) | u[j + n - 1];
+        qhat = p / v[n - 1];
+        rhat = p - qhat * v[n - 1];
+        while (qhat > 0xffffffffULL || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2])) {
+            qhat--;
+            rhat += v[n - 1];
+            if (rhat > 0xffffffffULL)
+                break;
+        }
+
+        k = 0;
+        for (i = 0; i < n; i++) {
+            p = qhat * v[i];
+            t = (long long)u[i + j] - k - (long long)(p & 0xffffffffULL);
+            u[i + j] = (unsigned)t;
+            k = (long long)(p >> 32) - (t >> 32);
+        }
+        t = (long long)u[j + n] - k;
+        u[j + n] = (unsigned)t;
+
+        /* qhat was one too large, rare */
+        if (t < 0) {
+            qhat--;
+            p = 0;
+            for (i = 0; i < n; i++) {
+                p += (unsigned long long)u[i + j] + v[i];
+                u[i + j] = Lw(p);
+                p >>= 32;
+            }
+            u[j + n] += (unsigned)p;
+        }
+        if (NULL != q)
+            q[j] = (unsigned)qhat;
+    }
+
+}
+
+static int div_reciprocal(unsigned *x, const unsigned *v, int n){
+
+    unsigned *u, *s, *p, *w;
+    int h, i, ok, neg;
+
+    /* x = floor(B^2n / v) in n + 1 words, v normalized */
+    if (n < MAX(CU_BN_DIV_NEWTON_THRESHOLD, 2)) {
+        if ((u = (unsigned *)calloc(2 * n + 1, sizeof(unsigned))) == NULL)
+            return 0;
+        u[2 * n] = 1;
+        div_knuth(x, u, 2 * n, v, n);
+        free(u);
+        return (1);
+    }
+
+    /* Newton step from the reciprocal y of the top h words: x = 2 y B^(n-h) - floor(v y^2 / B^2h) */
+    h = (n + 1) / 2;
+    if ((u = (unsigned *)malloc((h + 1 + 2 * h + 2 + n + 2 * h + 2 + n + 2 + 2 * n + 3) * sizeof(unsigned))) == NULL)
+        return 0;
+    s = u + h + 1;
+    p = s + 2 * h + 2;
+    w = p + n + 2 * h + 2;
+    ok = div_reciprocal(u, v + n - h, h)
+        && cu_bn_sqr_limbs(s, u, h + 1)
+        && cu_bn_mul_limbs(p, v, n, s, 2 * h + 2);
+    if (!ok) {
+        free(u);
+        return 0;
+    }
+    memset(w, 0, (n + 2) * sizeof(unsigned));
+    memcpy(w + n - h, u, (h + 1) * sizeof(unsigned));
+    div_lshift(w, w, n + 2, 1);
+    cu_bn_sub_words(w, w, p + 2 * h, n + 2);
+
+    /* the estimate is a few units off, the exact remainder B^2n - v x settles it */
+    p = w + n + 2;
+    if (!cu_bn_mul_limbs(p, v, n, w, n + 2)) {
+        free(u);
+        return 0;
+    }
+    neg = (p[2 * n + 1] != 0 || p[2 * n] != 0);
+    if (neg) {
+        div_dec(p + 2 * n, 2);
+        neg = (div_cmp(p, 2 * n + 2, NULL, 0) != 0);
+    } else {
+        /* B^2n - p by two's complement of the low 2n words */
+        for (i = 0; i < 2 * n; i++)
+            p[i] = ~p[i];
+        div_inc(p, 2 * n + 1);
+    }
+    while (neg) {
+        div_dec(w, n + 2);
+        if (div_cmp(p, 2 * n + 2, v, n) <= 0) {
+            cu_bn_sub_words(p, v, p, n);
+            neg = 0;
+        } else {
+            div_sub(p, 2 * n + 2, v, n);
+        }
+    }
+    while (div_cmp(p, 2 * n + 2, v, n) >= 0) {
+        div_inc(w, n + 2);
+        div_sub(p, 2 * n + 2, v, n);
+    }
+    memcpy(x, w, (n + 1) * sizeof(unsigned));
+    free(u);
+    return (1);
+
+}
+
+static int div_barrett(unsigned *q, int qn, unsigned *u, int m, const unsigned *v, int n){
+
+    unsigned *x, *y, *p, *e;
+    int c, i, len, ret = 1;
+
+    /* u has m words, v has n words with the top bit set, the remainder is left in u */
+    if ((x = (unsigned *)malloc((n + 1 + 2 * n + 2 * n + 2 + 2 * n) * sizeof(unsigned))) == NULL)
+        return 0;
+    y = x + n + 1;
+    p = y + 2 * n;
+    e = p + 2 * n + 2;
+    if (!div_reciprocal(x, v, n)) {
+        free(x);
+        return 0;
+    }
+
+    /* the words of u above the last full chunk are below v and start the remainder */
+    len = m % n;
+    memset(y + n, 0, n * sizeof(unsigned));
+    memcpy(y + n, u + m - len, len * sizeof(unsigned));
+
+    /* n words of quotient per step, y = r B^n + next n words of u stays below v B^n */
+    for (c = m / n - 1; c >= 0 && ret; c--) {
+        memcpy(y, u + c * n, n * sizeof(unsigned));
+
+        /* q' = floor(floor(y / B^(n-1)) x / B^(n+1)) is at most two below the quotient */
+        ret = cu_bn_mul_limbs(p, y + n - 1, n + 1, x, n + 1)
+            && cu_bn_mul_limbs(e, p + n + 1, n, v, n);
+        if (!ret)
+            break;
+        cu_bn_sub_words(y, y, e, 2 * n);
+        while (y[n] != 0 || div_cmp(y, n, v, n) >= 0) {
+            div_sub(y, n + 1, v, n);
+            div_inc(p + n + 1, n + 1);
+        }
+        memmove(y + n, y, n * sizeof(unsigned));
+        for (i = 0; i < n && c * n + i < qn; i++)
+            q[c * n + i] = p[n + 1 + i];
+    }
+    if (ret)
+        memcpy(u, y + n, n * sizeof(unsigned));
+    free(x);
+    return (ret);
+
+}
+
+int cu_bn_divmod_limbs(unsigned *q, unsigned *r, const unsigned *a, int na, const unsigned *d, int nd){
+
+    unsigned *u, *v, *qt;
+    int m, s, qn, ret = 1;
+
+    if (nd <= 0 || 0 == d[nd - 1])
+        return 0;
+    if (na < nd) {
+        if (NULL != r) {
+            memmove(r, a, MAX(na, 0) * sizeof(unsigned));
+            memset(r + MAX(na, 0), 0, (nd - MAX(na, 0)) * sizeof(unsigned));
+        }
+        return (1);
+    }
+
+    /* leading zero words of a only give zero quotient words */
+    for (m = na; m > nd && 0 == a[m - 1]; m--)
+        ;
+    qn = na - nd + 1;
+    if (1 == nd) {
+        s = div_word(q, a, m, d[0]);
+        if (NULL != q)
+            memset(q + m, 0, (qn - m) * sizeof(unsigned));
+        if (NULL != r)
+            r[0] = s;
+        return (1);
+    }
+
+    /* the divisor is shifted until its top bit is set, the dividend by as much */
+    if ((u = (unsigned *)malloc((m + 1 + nd) * sizeof(unsigned))) == NULL)
+        return 0;
+    v = u + m + 1;
+    s = div_clz(d[nd - 1]);
+    div_lshift(v, d, nd, s);
+    u[m] = div_lshift(u, a, m, s);
+    qt = q;
+    if (NULL != q)
+        memset(q + m - nd + 1, 0, (qn - (m - nd + 1)) * sizeof(unsigned));
+
+    if (nd < CU_BN_DIV_NEWTON_THRESHOLD)
+        div_knuth(qt, u, m, v, nd);
+    else
+        ret = div_barrett(qt, (NULL != q) ? m - nd + 1 : 0, u, m + 1, v, nd);
+    if (ret && NULL != r)
+        div_rshift(r, u, nd, s);
+    free(u);
+    return (ret);
+
+}
+
+int cu_bn_mod_limbs(unsigned *r, const unsigned *a, int na, const unsigned *d, int nd){
+
+    return (cu_bn_divmod_limbs(NULL, r, a, na, d, nd));
+
+}
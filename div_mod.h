@@ -0,0 +1,47 @@
+/** @file div_mod.h
+ *  @brief Division of word arrays
+ *
+ *	Divides little-endian arrays of 32 bit words. Divisors shorter than
+ *	CU_BN_DIV_NEWTON_THRESHOLD words (cuda_bignum.h) are handled by
+ *	Knuth's Algorithm D, longer ones by Barrett reduction with a
+ *	reciprocal of the divisor computed by Newton iteration, so the cost
+ *	of a division follows the cost of multiplication rather than
+ *	growing with the square of the divisor.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef DIV_MOD_H
+#define DIV_MOD_H
+
+/** @brief Divides word arrays
+ *
+ *	Places the quotient of a by d in na - nd + 1 words of q and the
+ *	remainder in nd words of r, either may be NULL. If na < nd the
+ *	quotient is zero, nothing is written to q and a is copied to r.
+ *	The outputs may alias the inputs.
+ *
+ *  @param[out] q unsigned integer array quotient
+ *  @param[out] r unsigned integer array remainder
+ *  @param[in] a unsigned integer array dividend
+ *  @param na words of a
+ *  @param[in] d unsigned integer array divisor
+ *  @param nd words of d, the top one nonzero
+ *  @return 1 on success, 0 on division by zero or out of memory
+ */
+int cu_bn_divmod_limbs(unsigned *q, unsigned *r, const unsigned *a, int na, const unsigned *d, int nd);
+
+/** @brief Reduces a word array modulo another
+ *
+ *	Places a mod d in nd words of r, r may alias a.
+ *
+ *  @param[out] r unsigned integer array remainder
+ *  @param[in] a unsigned integer array dividend
+ *  @param na words of a
+ *  @param[in] d unsigned integer array divisor
+ *  @param nd words of d, the top one nonzero
+ *  @return 1 on success, 0 on division by zero or out of memory
+ */
+int cu_bn_mod_limbs(unsigned *r, const unsigned *a, int na, const unsigned *d, int nd);
+
+#endif /* DIV_MOD_H */
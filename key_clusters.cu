@@ -0,0 +1,269 @@
+/** @file key_clusters.cu
+ *  @brief Clusters of keys sharing primes
+ *
+ *	Union-find over the weak pairs stream.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include "key_clusters.h"
+
+static int key_clusters_copy(U_BN *r, const U_BN *a, int words){
+
+    if ((r->d = (unsigned *)malloc(words * sizeof(unsigned))) == NULL)
+        return 0;
+    memset(r->d, 0, words * sizeof(unsigned));
+    memcpy(r->d, a->d, a->top * sizeof(unsigned));
+    r->top = a->top;
+    return (1);
+
+}
+
+KEY_CLUSTERS *key_clusters_new(unsigned n){
+
+    KEY_CLUSTERS *c;
+    unsigned i;
+
+    if ((c = (KEY_CLUSTERS *)calloc(1, sizeof(*c))) == NULL)
+        return (NULL);
+    c->n = n;
+    c->parent = (unsigned *)malloc(n * sizeof(unsigned));
+    c->size = (unsigned *)malloc(n * sizeof(unsigned));
+    c->factored = (unsigned *)calloc(n, sizeof(unsigned));
+    c->p = (U_BN *)calloc(n, sizeof(U_BN));
+    c->q = (U_BN *)calloc(n, sizeof(U_BN));
+    if (NULL == c->parent || NULL == c->size || NULL == c->factored || NULL == c->p || NULL == c->q) {
+        key_clusters_free(c);
+        return (NULL);
+    }
+    for (i = 0; i < n; i++) {
+        c->parent[i] = i;
+        c->size[i] = 1;
+    }
+    return (c);
+
+}
+
+void key_clusters_free(KEY_CLUSTERS *c){
+
+    unsigned i;
+
+    if (c == NULL)
+        return;
+    for (i = 0; c->p != NULL && c->q != NULL && i < c->n; i++) {
+        free(c->p[i].d);
+        free(c->q[i].d);
+    }
+    for (i = 0; i < c->primes_count; i++)
+        free(c->primes[i].p.d);
+    free(c->primes);
+    free(c->parent);
+    free(c->size);
+    free(c->factored);
+    free(c->p);
+    free(c->q);
+    free(c);
+
+}
+
+unsigned key_clusters_find(KEY_CLUSTERS *c, unsigned i){
+
+    while (c->parent[i] != i) {
+        c->parent[i] = c->parent[c->parent[i]];
+        i = c->parent[i];
+    }
+    return (i);
+
+}
+
+static void key_clusters_union(KEY_CLUSTERS *c, unsigned i, unsigned j){
+
+    unsigned ri = key_clusters_find(c, i);
+    unsigned rj = key_clusters_find(c, j);
+    unsigned t;
+
+    if (ri == rj)
+        return;
+    if (c->size[ri] < c->size[rj]) {
+        t = ri;
+        ri = rj;
+        rj = t;
+    }
+    c->parent[rj] = ri;
+    c->size[ri] += c->size[rj];
+    c->factored[ri] += c->factored[rj];
+
+}
+
+int key_clusters_factor(KEY_CLUSTERS *c, unsigned i, const U_BN *n_i, const U_BN *gcd){
+
+    if(NULL == c || NULL == n_i || NULL == gcd || i >= c->n)
+        return 0;
+
+    if (key_clusters_is_factored(c, i) || !cu_bn_ucmp(gcd, n_i) || cu_bn_is_one(gcd))
+        return 0;
+
+    /* a proper divisor of a two-prime modulus is one of its primes */
+    if (!key_clusters_copy(&c->p[i], gcd, n_i->top) || !key_clusters_copy(&c->q[i], n_i, n_i->top))
+        return 0;
+    if (!cu_bn_div(&c->q[i], NULL, n_i, gcd))
+        return 0;
+    c->factored[key_clusters_find(c, i)]++;
+    return (1);
+
+}
+
+int key_clusters_add(KEY_CLUSTERS *c, unsigned i, unsigned j, const U_BN *n_i, const U_BN *n_j, const U_BN *gcd){
+
+    KEY_PRIME *primes;
+    unsigned capacity;
+
+    if(NULL == c || NULL == n_i || NULL == n_j || NULL == gcd || i >= c->n || j >= c->n)
+        return 0;
+
+    key_clusters_union(c, i, j);
+    key_clusters_factor(c, i, n_i, gcd);
+    key_clusters_factor(c, j, n_j, gcd);
+
+    /* identical moduli share both primes, there is no single shared prime to record */
+    if (!cu_bn_ucmp(gcd, n_i) || !cu_bn_ucmp(gcd, n_j))
+        return (1);
+
+    if (c->primes_count == c->primes_capacity) {
+        capacity = c->primes_capacity ? 2 * c->primes_capacity : 64;
+        if ((primes = (KEY_PRIME *)realloc(c->primes, capacity * sizeof(KEY_PRIME))) == NULL)
+            return 0;
+        c->primes = primes;
+        c->primes_capacity = capacity;
+    }
+    if (!key_clusters_copy(&c->primes[c->primes_count].p, gcd, gcd->top))
+        return 0;
+    c->primes[c->primes_count].key = i;
+    c->primes_count++;
+    return (1);
+
+}
+
+int key_clusters_is_factored(const KEY_CLUSTERS *c, unsigned i){
+
+    return (NULL != c->p[i].d);
+
+}
+
+const U_BN *key_clusters_known_gcd(const KEY_CLUSTERS *c, unsigned i, unsigned j, const U_BN *n_i){
+
+    const U_BN *shared = NULL;
+    int matches = 0;
+
+    if (!key_clusters_is_factored(c, i) || !key_clusters_is_factored(c, j))
+        return (NULL);
+
+    if (!cu_bn_ucmp(&c->p[i], &c->p[j]) || !cu_bn_ucmp(&c->p[i], &c->q[j])) {
+        shared = &c->p[i];
+        matches++;
+    }
+    if (!cu_bn_ucmp(&c->q[i], &c->p[j]) || !cu_bn_ucmp(&c->q[i], &c->q[j])) {
+        shared = &c->q[i];
+        matches++;
+    }
+    return ((matches == 2) ? n_i : shared);
+
+}
+
+const U_BN *key_clusters_trial_gcd(const KEY_CLUSTERS *c, unsigned f, const U_BN *n_x){
+
+    U_BN *rem;
+    int p_divides, q_divides;
+
+    if (!key_clusters_is_factored(c, f) || NULL == n_x)
+        return (NULL);
+
+    if ((rem = cu_bn_pool_new()) == NULL)
+        return (NULL);
+    p_divides = cu_bn_div(NULL, rem, n_x, &c->p[f]) && cu_bn_is_zero(rem);
+    q_divides = cu_bn_div(NULL, rem, n_x, &c->q[f]) && cu_bn_is_zero(rem);
+
+    if (p_divides && q_divides)
+        return (n_x);
+    if (p_divides)
+        return (&c->p[f]);
+    if (q_divides)
+        return (&c->q[f]);
+    return (NULL);
+
+}
+
+unsigned key_clusters_summary(KEY_CLUSTERS *c, const char *unit, char **key_paths, REPORT_WRITER *report){
+
+    unsigned *order, *start;
+    unsigned i, k, m, r, components = 0;
+    int duplicate;
+    char *line = NULL;
+    size_t len = 0;
+    FILE *out;
+
+    if(NULL == c)
+        return 0;
+
+    /* counting sort of keys by component root */
+    order = (unsigned *)malloc(c->n * sizeof(unsigned));
+    start = (unsigned *)calloc(c->n + 1, sizeof(unsigned));
+    if (NULL == order || NULL == start) {
+        free(order);
+        free(start);
+        return 0;
+    }
+    for (i = 0; i < c->n; i++)
+        start[key_clusters_find(c, i) + 1]++;
+    for (i = 0; i < c->n; i++)
+        start[i + 1] += start[i];
+    for (i = 0; i < c->n; i++)
+        order[start[key_clusters_find(c, i)]++] = i;
+    for (i = c->n; i > 0; i--)
+        start[i] = start[i - 1];
+    start[0] = 0;
+
+    for (r = 0; r < c->n; r++) {
+        if (key_clusters_find(c, r) != r || c->size[r] < 2)
+            continue;
+        components++;
+
+        printf("%s Cluster %u: %u keys, %u factored:", unit, components, c->size[r], c->factored[r]);
+        for (k = start[r]; k < start[r] + c->size[r]; k++)
+            printf(" %s", key_paths[order[k]]);
+        printf("\n");
+
+        if ((out = open_memstream(&line, &len)) == NULL)
+            continue;
+        fprintf(out, "{\"component\":%u,\"factored\":%u,\"keys\":[", components, c->factored[r]);
+        for (k = start[r]; k < start[r] + c->size[r]; k++) {
+            if (k != start[r])
+                fputc(',', out);
+            report_writer_quote(out, REPORT_JSONL, key_paths[order[k]]);
+        }
+        fprintf(out, "],\"primes\":[");
+        for (k = 0, m = 0; k < c->primes_count; k++) {
+            if (key_clusters_find(c, c->primes[k].key) != r)
+                continue;
+            for (i = 0, duplicate = 0; i < k && !duplicate; i++)
+                duplicate = (key_clusters_find(c, c->primes[i].key) == r && !cu_bn_ucmp(&c->primes[i].p, &c->primes[k].p));
+            if (duplicate)
+                continue;
+            printf("%s Cluster %u: shared prime %s\n", unit, components, cu_bn_bn2hex(&c->primes[k].p));
+            fprintf(out, "%s\"%s\"", m++ ? "," : "", cu_bn_bn2hex(&c->primes[k].p));
+            cu_bn_pool_reset();
+        }
+        fprintf(out, "]}\n");
+        fclose(out);
+        if (report)
+            report_writer_append(report, line, len);
+        free(line);
+        line = NULL;
+    }
+    printf("%s Clusters: %u\n", unit, components);
+
+    free(order);
+    free(start);
+    return (components);
+
+}
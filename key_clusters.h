@@ -0,0 +1,143 @@
+/** @file key_clusters.h
+ *  @brief Clusters of keys sharing primes
+ *
+ *	Union-find over the weak pairs stream. Keys sharing a prime are
+ *	grouped into components, every component records the primes its
+ *	keys share and how many of its keys are fully factored.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef KEY_CLUSTERS_H
+#define KEY_CLUSTERS_H
+
+#include "cuda_bignum.h"
+#include "report_writer.h"
+
+struct   __KEY_PRIME__{
+    unsigned key;
+    U_BN     p;
+};
+
+typedef struct __KEY_PRIME__     KEY_PRIME;
+
+struct   __KEY_CLUSTERS__{
+    unsigned   n;
+    unsigned*  parent;
+    unsigned*  size;
+    unsigned*  factored;
+    U_BN*      p;
+    U_BN*      q;
+    KEY_PRIME* primes;
+    unsigned   primes_count;
+    unsigned   primes_capacity;
+};
+
+typedef struct __KEY_CLUSTERS__     KEY_CLUSTERS;
+
+
+/** @brief Allocates clusters of n keys
+ *
+ *	Allocates n singleton components.
+ *
+ *  @param[in] n number of keys
+ *  @return KEY_CLUSTERS or NULL on failure
+ */
+KEY_CLUSTERS *key_clusters_new(unsigned n);
+
+/** @brief Frees clusters
+ *
+ *	Frees clusters and all recorded primes.
+ *
+ *  @param[in] c KEY_CLUSTERS structure
+ *  @return Void
+ */
+void key_clusters_free(KEY_CLUSTERS *c);
+
+/** @brief Finds component of key i
+ *
+ *	Returns root of component of key i, halving the path on the way.
+ *
+ *  @param[in,out] c KEY_CLUSTERS structure
+ *  @param[in] i index of key
+ *  @return index of component root
+ */
+unsigned key_clusters_find(KEY_CLUSTERS *c, unsigned i);
+
+/** @brief Adds a weak pair to the clusters
+ *
+ *	Joins components of keys i and j, records the shared factor gcd
+ *	and marks a key as factored when gcd is a proper divisor of it.
+ *
+ *  @param[in,out] c KEY_CLUSTERS structure
+ *  @param[in] i index of first key
+ *  @param[in] j index of second key
+ *  @param[in] n_i modulus of first key
+ *  @param[in] n_j modulus of second key
+ *  @param[in] gcd shared factor of both moduli
+ *  @return 1 on success
+ */
+int key_clusters_add(KEY_CLUSTERS *c, unsigned i, unsigned j, const U_BN *n_i, const U_BN *n_j, const U_BN *gcd);
+
+/** @brief Factors key i with a known factor
+ *
+ *	Marks key i as factored when gcd is a proper divisor of n_i,
+ *	storing gcd and n_i/gcd as its primes.
+ *
+ *  @param[in,out] c KEY_CLUSTERS structure
+ *  @param[in] i index of key
+ *  @param[in] n_i modulus of key
+ *  @param[in] gcd factor of n_i
+ *  @return 1 if key i became factored
+ */
+int key_clusters_factor(KEY_CLUSTERS *c, unsigned i, const U_BN *n_i, const U_BN *gcd);
+
+/** @brief Returns 1 if key i is fully factored
+ *
+ *	Returns 1 if both primes of key i are known.
+ *
+ *  @param[in] c KEY_CLUSTERS structure
+ *  @param[in] i index of key
+ *  @return 1 if key i is factored
+ */
+int key_clusters_is_factored(const KEY_CLUSTERS *c, unsigned i);
+
+/** @brief Computes gcd of two factored keys from their primes
+ *
+ *	Computes gcd of two factored keys by comparing their primes,
+ *	without running a GCD algorithm.
+ *
+ *  @param[in] c KEY_CLUSTERS structure
+ *  @param[in] i index of first factored key
+ *  @param[in] j index of second factored key
+ *  @param[in] n_i modulus of first key
+ *  @return shared factor, or NULL if keys are coprime or not factored
+ */
+const U_BN *key_clusters_known_gcd(const KEY_CLUSTERS *c, unsigned i, unsigned j, const U_BN *n_i);
+
+/** @brief Computes gcd of a key with a factored key by trial division
+ *
+ *	Divides n_x by both primes of factored key f, which is much cheaper
+ *	than a GCD of two full-size moduli.
+ *
+ *  @param[in] c KEY_CLUSTERS structure
+ *  @param[in] f index of factored key
+ *  @param[in] n_x modulus of tested key
+ *  @return shared factor, or NULL if n_x is coprime to key f
+ */
+const U_BN *key_clusters_trial_gcd(const KEY_CLUSTERS *c, unsigned f, const U_BN *n_x);
+
+/** @brief Prints and reports per-component summaries
+ *
+ *	Prints one line per component with more than one key and, if
+ *	report is not NULL, writes it as a JSON line.
+ *
+ *  @param[in,out] c KEY_CLUSTERS structure
+ *  @param[in] unit processing unit prefix
+ *  @param[in] key_paths names of keys
+ *  @param[in,out] report REPORT_WRITER or NULL
+ *  @return number of components with more than one key
+ */
+unsigned key_clusters_summary(KEY_CLUSTERS *c, const char *unit, char **key_paths, REPORT_WRITER *report);
+
+#endif /* KEY_CLUSTERS_H */
@@ -0,0 +1,130 @@
+/** @file key_corpus.cu
+ *  @brief Resident corpus of moduli
+ *
+ *	Corpus of moduli with their product for single modulus checks.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include "key_corpus.h"
+
+static int key_corpus_append(KEY_CORPUS *c, const U_BN *n){
+
+    U_BN *keys;
+    unsigned capacity;
+
+    if (c->n == c->capacity) {
+        capacity = c->capacity ? 2 * c->capacity : 1024;
+        if ((keys = (U_BN *)realloc(c->keys, capacity * sizeof(U_BN))) == NULL)
+            return 0;
+        c->keys = keys;
+        c->capacity = capacity;
+    }
+    if ((c->keys[c->n].d = (unsigned *)malloc(n->top * sizeof(unsigned))) == NULL)
+        return 0;
+    memcpy(c->keys[c->n].d, n->d, n->top * sizeof(unsigned));
+    c->keys[c->n].top = n->top;
+    cu_bn_correct_top(&c->keys[c->n]);
+    c->n++;
+    return (1);
+
+}
+
+KEY_CORPUS *key_corpus_new(const U_BN *keys, unsigned n){
+
+    KEY_CORPUS *c;
+    PRODUCT_TREE *t = NULL;
+    const U_BN *root;
+    unsigned k;
+
+    if ((c = (KEY_CORPUS *)calloc(1, sizeof(*c))) == NULL)
+        return (NULL);
+    for (k = 0; k < n; k++) {
+        if (!key_corpus_append(c, &keys[k])) {
+            key_corpus_free(c);
+            return (NULL);
+        }
+    }
+
+    /* empty corpus has product one */
+    if (n && (t = product_tree_new(c->keys, c->n)) == NULL) {
+        key_corpus_free(c);
+        return (NULL);
+    }
+    root = product_tree_root(t);
+    c->product_words = root ? root->top : 1;
+    if ((c->product.d = (unsigned *)malloc(c->product_words * sizeof(unsigned))) == NULL) {
+        product_tree_free(t);
+        key_corpus_free(c);
+        return (NULL);
+    }
+    if (root) {
+        memcpy(c->product.d, root->d, root->top * sizeof(unsigned));
+        c->product.top = root->top;
+    } else {
+        c->product.d[0] = 1;
+        c->product.top = 1;
+    }
+    product_tree_free(t);
+    return (c);
+
+}
+
+void key_corpus_free(KEY_CORPUS *c){
+
+    unsigned k;
+
+    if (c == NULL)
+        return;
+    for (k = 0; k < c->n; k++)
+        free(c->keys[k].d);
+    free(c->keys);
+    free(c->product.d);
+    free(c);
+
+}
+
+int key_corpus_query(const KEY_CORPUS *c, const U_BN *n, U_BN *(*gcd)(U_BN *, U_BN *), U_BN *factor){
+
+    const U_BN *g;
+
+    if(NULL == c || NULL == n || NULL == gcd || NULL == factor || cu_bn_is_zero(n))
+        return 0;
+
+    if (!cu_bn_div(NULL, factor, &c->product, n))
+        return 0;
+
+    /* n divides the product when both of its primes are in the corpus */
+    g = cu_bn_is_zero(factor) ? n : gcd(cu_bn_pool_dup(n), cu_bn_pool_dup(factor));
+    memcpy(factor->d, g->d, g->top * sizeof(unsigned));
+    factor->top = g->top;
+    return (!cu_bn_is_one(factor));
+
+}
+
+int key_corpus_insert(KEY_CORPUS *c, const U_BN *n){
+
+    U_BN product;
+    unsigned words;
+
+    if(NULL == c || NULL == n || cu_bn_is_zero(n))
+        return 0;
+
+    /* grow geometrically, the product is rewritten on every insert */
+    words = c->product.top + n->top;
+    if (words > c->product_words)
+        words = (2 * c->product_words > words) ? 2 * c->product_words : words;
+    else
+        words = c->product_words;
+    if ((product.d = (unsigned *)malloc(words * sizeof(unsigned))) == NULL)
+        return 0;
+    if (!cu_bn_mul(&product, &c->product, n) || !key_corpus_append(c, n)) {
+        free(product.d);
+        return 0;
+    }
+    free(c->product.d);
+    c->product = product;
+    c->product_words = words;
+    return (1);
+
+}
@@ -0,0 +1,69 @@
+/** @file key_corpus.h
+ *  @brief Resident corpus of moduli
+ *
+ *	Keeps moduli of a corpus together with their product, so a single
+ *	modulus n is checked against the whole corpus with one reduction
+ *	of the product modulo n and one GCD: gcd(n, product mod n).
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef KEY_CORPUS_H
+#define KEY_CORPUS_H
+
+#include "product_tree.h"
+
+struct   __KEY_CORPUS__{
+    unsigned   n;
+    unsigned   capacity;
+    U_BN*      keys;
+    U_BN       product;
+    unsigned   product_words;
+};
+
+typedef struct __KEY_CORPUS__     KEY_CORPUS;
+
+
+/** @brief Builds corpus of n moduli
+ *
+ *	Copies moduli and computes their product with a product tree.
+ *
+ *  @param[in] keys array of moduli
+ *  @param[in] n number of moduli
+ *  @return KEY_CORPUS or NULL on failure
+ */
+KEY_CORPUS *key_corpus_new(const U_BN *keys, unsigned n);
+
+/** @brief Frees corpus
+ *
+ *	Frees all moduli and the product of the corpus.
+ *
+ *  @param[in] c KEY_CORPUS structure
+ *  @return Void
+ */
+void key_corpus_free(KEY_CORPUS *c);
+
+/** @brief Checks modulus against the corpus
+ *
+ *	Places gcd(n, product mod n) in factor, which is one if n shares
+ *	no prime with the corpus. factor must have room for n->top words.
+ *
+ *  @param[in] c KEY_CORPUS structure
+ *  @param[in] n U_BN modulus
+ *  @param[in] gcd GCD algorithm
+ *  @param[out] factor U_BN shared factor
+ *  @return 1 if n shares a factor with the corpus, 0 otherwise
+ */
+int key_corpus_query(const KEY_CORPUS *c, const U_BN *n, U_BN *(*gcd)(U_BN *, U_BN *), U_BN *factor);
+
+/** @brief Inserts modulus into the corpus
+ *
+ *	Appends n to the corpus and multiplies it into the product.
+ *
+ *  @param[in,out] c KEY_CORPUS structure
+ *  @param[in] n U_BN modulus
+ *  @return 1 on success
+ */
+int key_corpus_insert(KEY_CORPUS *c, const U_BN *n);
+
+#endif /* KEY_CORPUS_H */
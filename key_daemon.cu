@@ -0,0 +1,216 @@
+/** @file key_daemon.cu
+ *  @brief Daemon answering weak key queries
+ *
+ *	Framed protocol over Unix socket or local TCP.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "key_daemon.h"
+
+typedef struct {
+    int            fd;
+    unsigned       got;
+    unsigned       len;
+    unsigned char  header[4];
+    unsigned char* request;
+} KEY_DAEMON_CLIENT;
+
+static int key_daemon_write(int fd, const unsigned char *buf, unsigned len){
+
+    ssize_t r;
+
+    while (len) {
+        if ((r = write(fd, buf, len)) <= 0)
+            return 0;
+        buf += r;
+        len -= r;
+    }
+    return (1);
+
+}
+
+int key_daemon_listen(const char *address){
+
+    struct sockaddr_un un;
+    struct sockaddr_in in;
+    char *end;
+    long port;
+    int fd, one = 1;
+
+    if(NULL == address)
+        return (-1);
+
+    port = strtol(address, &end, 10);
+    if (*address && *end == '\0') {
+        if (port <= 0 || port > 65535 || (fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+            return (-1);
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        memset(&in, 0, sizeof(in));
+        in.sin_family = AF_INET;
+        in.sin_port = htons((unsigned short)port);
+        in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(fd, (struct sockaddr *)&in, sizeof(in)) < 0 || listen(fd, KEY_DAEMON_BACKLOG) < 0) {
+            close(fd);
+            return (-1);
+        }
+        return (fd);
+    }
+
+    if (strlen(address) >= sizeof(un.sun_path) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return (-1);
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strcpy(un.sun_path, address);
+    unlink(address);
+    if (bind(fd, (struct sockaddr *)&un, sizeof(un)) < 0 || listen(fd, KEY_DAEMON_BACKLOG) < 0) {
+        close(fd);
+        return (-1);
+    }
+    return (fd);
+
+}
+
+unsigned key_daemon_handle(KEY_CORPUS *c, U_BN *(*gcd)(U_BN *, U_BN *), const unsigned char *request, unsigned len, unsigned char *response){
+
+    U_BN n = {NULL, 0}, factor = {NULL, 0};
+    unsigned out = 1;
+    int weak;
+
+    response[0] = KEY_DAEMON_ERROR;
+    if (len < 2 || (request[0] != KEY_DAEMON_QUERY && request[0] != KEY_DAEMON_INSERT))
+        return (1);
+
+    /* factor is sized like n, it receives product mod n; both live only for this request */
+    if (cu_bn_bin2bn(&n, request + 1, len - 1) && !cu_bn_is_zero(&n) && cu_bn_bin2bn(&factor, request + 1, len - 1)) {
+        weak = key_corpus_query(c, &n, gcd, &factor);
+        response[0] = weak ? KEY_DAEMON_WEAK : KEY_DAEMON_COPRIME;
+        if (weak)
+            out += cu_bn_bn2bin(&factor, response + 1);
+        if (request[0] == KEY_DAEMON_INSERT && !key_corpus_insert(c, &n)) {
+            response[0] = KEY_DAEMON_ERROR;
+            out = 1;
+        }
+        cu_bn_pool_reset();
+    }
+    free(n.d);
+    free(factor.d);
+    return (out);
+
+}
+
+static int key_daemon_receive(KEY_DAEMON_CLIENT *cl){
+
+    ssize_t r;
+
+    /* one read per wakeup, a slow client never blocks the others */
+    if (cl->got < 4)
+        r = read(cl->fd, cl->header + cl->got, 4 - cl->got);
+    else
+        r = read(cl->fd, cl->request + cl->got - 4, cl->len - (cl->got - 4));
+    if (r < 0 && errno == EINTR)
+        return 0;
+    if (r <= 0)
+        return (-1);
+    cl->got += r;
+    if (cl->got == 4) {
+        cl->len = ((unsigned)cl->header[0] << 24) | ((unsigned)cl->header[1] << 16) | ((unsigned)cl->header[2] << 8) | cl->header[3];
+        if (cl->len > KEY_DAEMON_MAX_FRAME)
+            return (-1);
+    }
+    return (cl->got >= 4 && cl->got == 4 + cl->len);
+
+}
+
+static int key_daemon_answer(KEY_DAEMON_CLIENT *cl, KEY_CORPUS *c, U_BN *(*gcd)(U_BN *, U_BN *), unsigned char *response){
+
+    unsigned char header[4];
+    unsigned out;
+
+    out = key_daemon_handle(c, gcd, cl->request, cl->len, response);
+    cl->got = 0;
+    header[0] = (unsigned char)(out >> 24);
+    header[1] = (unsigned char)(out >> 16);
+    header[2] = (unsigned char)(out >> 8);
+    header[3] = (unsigned char)out;
+    return (key_daemon_write(cl->fd, header, 4) && key_daemon_write(cl->fd, response, out));
+
+}
+
+int key_daemon_serve(int fd, KEY_CORPUS *c, U_BN *(*gcd)(U_BN *, U_BN *)){
+
+    KEY_DAEMON_CLIENT clients[KEY_DAEMON_CLIENTS];
+    struct pollfd fds[KEY_DAEMON_CLIENTS + 1];
+    struct timeval timeout;
+    unsigned char *response;
+    unsigned count = 0, k, nfds;
+    int client, r;
+
+    if ((response = (unsigned char *)malloc(KEY_DAEMON_MAX_FRAME)) == NULL)
+        return 0;
+
+    /* a client closing early must not kill the daemon */
+    signal(SIGPIPE, SIG_IGN);
+    for (;;) {
+        /* a full table leaves new connections waiting in the backlog */
+        for (k = 0; k < count; k++) {
+            fds[k].fd = clients[k].fd;
+            fds[k].events = POLLIN;
+        }
+        nfds = count;
+        if (count < KEY_DAEMON_CLIENTS) {
+            fds[nfds].fd = fd;
+            fds[nfds++].events = POLLIN;
+        }
+        if (poll(fds, nfds, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        /* backwards, so a closed client swapped with the last one was already served */
+        for (k = count; k-- > 0;) {
+            if (!(fds[k].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            r = key_daemon_receive(&clients[k]);
+            if (r > 0 && !key_daemon_answer(&clients[k], c, gcd, response))
+                r = -1;
+            if (r < 0) {
+                close(clients[k].fd);
+                free(clients[k].request);
+                clients[k] = clients[--count];
+            }
+        }
+
+        if (nfds > count && (fds[nfds - 1].revents & POLLIN)) {
+            if ((client = accept(fd, NULL, NULL)) < 0)
+                break;
+            /* answers are written whole, a client that stops reading is dropped */
+            timeout.tv_sec = KEY_DAEMON_TIMEOUT;
+            timeout.tv_usec = 0;
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            memset(&clients[count], 0, sizeof(clients[count]));
+            clients[count].fd = client;
+            if ((clients[count].request = (unsigned char *)malloc(KEY_DAEMON_MAX_FRAME)) == NULL)
+                close(client);
+            else
+                count++;
+        }
+    }
+
+    for (k = 0; k < count; k++) {
+        close(clients[k].fd);
+        free(clients[k].request);
+    }
+    free(response);
+    return 0;
+
+}
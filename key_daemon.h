@@ -0,0 +1,73 @@
+/** @file key_daemon.h
+ *  @brief Daemon answering weak key queries
+ *
+ *	Keeps a KEY_CORPUS resident and answers queries over a Unix
+ *	socket or local TCP. Every frame starts with a 4 byte big-endian
+ *	payload length. A request payload is one command byte followed by
+ *	the big-endian modulus, a response payload is one status byte
+ *	followed by the big-endian shared factor of a weak key.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef KEY_DAEMON_H
+#define KEY_DAEMON_H
+
+#include <unistd.h>
+#include "key_corpus.h"
+
+#define KEY_DAEMON_MAX_FRAME 65536
+#define KEY_DAEMON_BACKLOG   16
+#define KEY_DAEMON_CLIENTS   64
+#define KEY_DAEMON_TIMEOUT   5
+
+#define KEY_DAEMON_QUERY     'Q'
+#define KEY_DAEMON_INSERT    'I'
+
+#define KEY_DAEMON_COPRIME   0x00
+#define KEY_DAEMON_WEAK      0x01
+#define KEY_DAEMON_ERROR     0xFF
+
+
+/** @brief Opens listening socket
+ *
+ *	Listens on local TCP port if address is a number, otherwise on
+ *	a Unix socket at path address, replacing a stale socket file.
+ *
+ *  @param[in] address port number or Unix socket path
+ *  @return listening socket or -1 on failure
+ */
+int key_daemon_listen(const char *address);
+
+/** @brief Handles one request payload
+ *
+ *	Checks modulus of the request against the corpus and, for insert
+ *	requests, inserts it afterwards.
+ *
+ *  @param[in,out] c KEY_CORPUS structure
+ *  @param[in] gcd GCD algorithm
+ *  @param[in] request request payload
+ *  @param[in] len length of request payload
+ *  @param[out] response response payload of KEY_DAEMON_MAX_FRAME bytes
+ *  @return length of response payload
+ */
+unsigned key_daemon_handle(KEY_CORPUS *c, U_BN *(*gcd)(U_BN *, U_BN *), const unsigned char *request, unsigned len, unsigned char *response);
+
+/** @brief Serves queries
+ *
+ *	Polls listening socket fd and up to KEY_DAEMON_CLIENTS open
+ *	connections, reading whatever a ready client sent and answering
+ *	every completed frame, so connections kept open or idle do not
+ *	delay other clients. Further connections wait in the backlog
+ *	until a client closes. A client that does not read an answer
+ *	for KEY_DAEMON_TIMEOUT seconds is dropped. Returns only if poll
+ *	or accept fails.
+ *
+ *  @param[in] fd listening socket
+ *  @param[in,out] c KEY_CORPUS structure
+ *  @param[in] gcd GCD algorithm
+ *  @return 0 on poll or accept failure
+ */
+int key_daemon_serve(int fd, KEY_CORPUS *c, U_BN *(*gcd)(U_BN *, U_BN *));
+
+#endif /* KEY_DAEMON_H */
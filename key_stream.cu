@@ -0,0 +1,200 @@
+/** @file key_stream.cu
+ *  @brief Log-structured segments of product trees
+ *
+ *	Buffered ingestion of moduli into merged segment trees.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include "key_stream.h"
+
+static void key_stream_pair(KEY_STREAM *s, unsigned i, const U_BN *x, unsigned j, const U_BN *y){
+
+    U_BN *g;
+
+    g = s->gcd(cu_bn_pool_dup(x), cu_bn_pool_dup(y));
+    if (cu_bn_is_one(g))
+        return;
+    if (i < j)
+        weak_pairs_push(s->out, i, j, g);
+    else
+        weak_pairs_push(s->out, j, i, g);
+
+}
+
+static int key_stream_check(KEY_STREAM *s, const PRODUCT_TREE *t, unsigned first){
+
+    unsigned *leaves, found, k, m;
+
+    if ((leaves = (unsigned *)malloc(t->n * sizeof(unsigned))) == NULL)
+        return 0;
+
+    /* every key finds itself, leaves after it are its weak pairs */
+    for (k = 0; k < t->n; k++) {
+        found = product_tree_find(t, &t->nodes[0][k], s->gcd, leaves, t->n);
+        for (m = 0; m < found && m < t->n; m++) {
+            if (leaves[m] > k)
+                key_stream_pair(s, first + k, &t->nodes[0][k], first + leaves[m], &t->nodes[0][leaves[m]]);
+        }
+        cu_bn_pool_reset();
+    }
+    free(leaves);
+    return (1);
+
+}
+
+static int key_stream_cross(KEY_STREAM *s, const PRODUCT_TREE *a, unsigned first_a, const PRODUCT_TREE *b, unsigned first_b){
+
+    U_BN *rem, *g;
+    unsigned *leaves, found, k, m;
+    int ret = 1;
+
+    /* reduce the product of b down the tree of a, then descend b only for flagged keys */
+    rem = (U_BN *)calloc(a->n, sizeof(U_BN));
+    leaves = (unsigned *)malloc(b->n * sizeof(unsigned));
+    for (k = 0; NULL != rem && k < a->n; k++) {
+        if ((rem[k].d = (unsigned *)calloc(a->nodes[0][k].top, sizeof(unsigned))) == NULL)
+            ret = 0;
+        rem[k].top = 1;
+    }
+    if (NULL == rem || NULL == leaves || !ret || !product_tree_remainders(a, product_tree_root(b), rem))
+        ret = 0;
+
+    for (k = 0; ret && k < a->n; k++) {
+        g = cu_bn_is_zero(&rem[k]) ? &a->nodes[0][k] : s->gcd(cu_bn_pool_dup(&a->nodes[0][k]), cu_bn_pool_dup(&rem[k]));
+        if (!cu_bn_is_one(g)) {
+            found = product_tree_find(b, &a->nodes[0][k], s->gcd, leaves, b->n);
+            for (m = 0; m < found && m < b->n; m++)
+                key_stream_pair(s, first_a + k, &a->nodes[0][k], first_b + leaves[m], &b->nodes[0][leaves[m]]);
+        }
+        cu_bn_pool_reset();
+    }
+
+    for (k = 0; NULL != rem && k < a->n; k++)
+        free(rem[k].d);
+    free(rem);
+    free(leaves);
+    return (ret);
+
+}
+
+static PRODUCT_TREE *key_stream_seal(KEY_STREAM *s){
+
+    PRODUCT_TREE *t;
+    unsigned k;
+
+    t = product_tree_new(s->buffer, s->buffered);
+    for (k = 0; k < s->buffered; k++) {
+        free(s->buffer[k].d);
+        s->buffer[k].d = NULL;
+    }
+    if (t != NULL && !key_stream_check(s, t, s->n - s->buffered)) {
+        product_tree_free(t);
+        t = NULL;
+    }
+    s->buffered = 0;
+    return (t);
+
+}
+
+KEY_STREAM *key_stream_new(WEAK_PAIRS *out, U_BN *(*gcd)(U_BN *, U_BN *)){
+
+    KEY_STREAM *s;
+
+    if(NULL == out || NULL == gcd)
+        return (NULL);
+
+    if ((s = (KEY_STREAM *)calloc(1, sizeof(*s))) == NULL)
+        return (NULL);
+    s->out = out;
+    s->gcd = gcd;
+    return (s);
+
+}
+
+void key_stream_free(KEY_STREAM *s){
+
+    unsigned k;
+
+    if (s == NULL)
+        return;
+    for (k = 0; k < s->buffered; k++)
+        free(s->buffer[k].d);
+    for (k = 0; k < KEY_STREAM_LEVELS; k++)
+        product_tree_free(s->segments[k]);
+    free(s);
+
+}
+
+int key_stream_insert(KEY_STREAM *s, const U_BN *n){
+
+    PRODUCT_TREE *t, *merged;
+    unsigned first, l;
+
+    if(NULL == s || NULL == n || cu_bn_is_zero(n))
+        return 0;
+
+    if ((s->buffer[s->buffered].d = (unsigned *)malloc(n->top * sizeof(unsigned))) == NULL)
+        return 0;
+    memcpy(s->buffer[s->buffered].d, n->d, n->top * sizeof(unsigned));
+    s->buffer[s->buffered].top = n->top;
+    cu_bn_correct_top(&s->buffer[s->buffered]);
+    s->buffered++;
+    s->n++;
+    if (s->buffered < KEY_STREAM_BUFFER)
+        return (1);
+
+    first = s->n - s->buffered;
+    if ((t = key_stream_seal(s)) == NULL)
+        return 0;
+
+    /* carry: an older segment of equal size is cross-checked and merged in front */
+    for (l = 0; l < KEY_STREAM_LEVELS && NULL != s->segments[l]; l++) {
+        if (!key_stream_cross(s, s->segments[l], s->first[l], t, first)
+            || (merged = product_tree_merge(s->segments[l], t)) == NULL) {
+            product_tree_free(t);
+            return 0;
+        }
+        t = merged;
+        first = s->first[l];
+        s->segments[l] = NULL;
+        s->merges++;
+    }
+    if (l == KEY_STREAM_LEVELS) {
+        product_tree_free(t);
+        return 0;
+    }
+    s->segments[l] = t;
+    s->first[l] = first;
+    return (1);
+
+}
+
+int key_stream_finish(KEY_STREAM *s){
+
+    PRODUCT_TREE *tail = NULL;
+    unsigned tail_first, l, m;
+    int ret = 1;
+
+    if(NULL == s)
+        return 0;
+
+    tail_first = s->n - s->buffered;
+    if (s->buffered && (tail = key_stream_seal(s)) == NULL)
+        return 0;
+
+    /* segments never merged with each other still have to meet once */
+    for (l = 0; ret && l < KEY_STREAM_LEVELS; l++) {
+        if (NULL == s->segments[l])
+            continue;
+        if (NULL != tail)
+            ret = key_stream_cross(s, tail, tail_first, s->segments[l], s->first[l]);
+        for (m = l + 1; ret && m < KEY_STREAM_LEVELS; m++) {
+            if (NULL != s->segments[m])
+                ret = key_stream_cross(s, s->segments[l], s->first[l], s->segments[m], s->first[m]);
+        }
+    }
+    product_tree_free(tail);
+    return (ret);
+
+}
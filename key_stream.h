@@ -0,0 +1,87 @@
+/** @file key_stream.h
+ *  @brief Log-structured segments of product trees
+ *
+ *	Ingests a stream of moduli without rebuilding a product tree per
+ *	key. New keys are buffered and sealed into a segment tree of
+ *	KEY_STREAM_BUFFER leaves. Segments of equal size are merged like
+ *	carries of a binary counter, so there is at most one segment per
+ *	size and every key takes part in a logarithmic number of merges.
+ *
+ *	Every segment is checked within itself when it is sealed, and two
+ *	segments are cross-checked against each other when they merge.
+ *	Pairs spread over segments that did not merge yet are checked by
+ *	key_stream_finish(). A pair of keys is thus reported once the
+ *	aligned run of KEY_STREAM_BUFFER * 2^k keys holding both is
+ *	complete, which for keys on either side of a large power of two
+ *	may be as late as the end of the stream.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef KEY_STREAM_H
+#define KEY_STREAM_H
+
+#include "product_tree.h"
+#include "weak_pairs.h"
+
+#define KEY_STREAM_BUFFER 64
+#define KEY_STREAM_LEVELS 32
+
+struct   __KEY_STREAM__{
+    unsigned      n;
+    unsigned      buffered;
+    unsigned      merges;
+    U_BN          buffer[KEY_STREAM_BUFFER];
+    PRODUCT_TREE* segments[KEY_STREAM_LEVELS];
+    unsigned      first[KEY_STREAM_LEVELS];
+    WEAK_PAIRS*   out;
+    U_BN *(*gcd)(U_BN *, U_BN *);
+};
+
+typedef struct __KEY_STREAM__     KEY_STREAM;
+
+
+/** @brief Allocates empty stream
+ *
+ *	Allocates stream reporting weak pairs to out. Keys are numbered
+ *	from 0 in the order they are inserted.
+ *
+ *  @param[in,out] out WEAK_PAIRS collection of findings
+ *  @param[in] gcd GCD algorithm
+ *  @return KEY_STREAM or NULL on failure
+ */
+KEY_STREAM *key_stream_new(WEAK_PAIRS *out, U_BN *(*gcd)(U_BN *, U_BN *));
+
+/** @brief Frees stream
+ *
+ *	Frees buffered keys and all segments.
+ *
+ *  @param[in] s KEY_STREAM structure
+ *  @return Void
+ */
+void key_stream_free(KEY_STREAM *s);
+
+/** @brief Inserts modulus into the stream
+ *
+ *	Buffers a copy of n. A full buffer is sealed into a segment and
+ *	merged with segments of equal size, reporting weak pairs found
+ *	on the way. Resets the pool of temporaries.
+ *
+ *  @param[in,out] s KEY_STREAM structure
+ *  @param[in] n U_BN modulus
+ *  @return 1 on success
+ */
+int key_stream_insert(KEY_STREAM *s, const U_BN *n);
+
+/** @brief Checks all pairs not checked yet
+ *
+ *	Checks buffered keys and cross-checks all segments, so every pair
+ *	of inserted keys has been checked exactly once. No keys may be
+ *	inserted afterwards. Resets the pool of temporaries.
+ *
+ *  @param[in,out] s KEY_STREAM structure
+ *  @return 1 on success
+ */
+int key_stream_finish(KEY_STREAM *s);
+
+#endif /* KEY_STREAM_H */
@@ -8,21 +8,275 @@
 
 
 #include "device_cuda_bignum.h"
+#include "report_writer.h"
+#include "key_clusters.h"
+#include "product_tree.h"
+#include "prime_blacklist.h"
+#include "key_daemon.h"
+#include "key_stream.h"
+#include "spill_tree.h"
+
+#ifndef MIN
+#define MIN(a,b) (a < b ? a : b)
+#endif
 
 typedef enum {
     EUCLIDEAN=0,
     BINARY_EUCLIDEAN,
     FAST_BINARY_EUCLIDEAN,
+    CTZ_BINARY_EUCLIDEAN,
+    PLUS_MINUS,
+    APPROXIMATE_EUCLIDEAN,
+    DIVSTEPS,
+    KARY,
+    HYBRID,
     UNKNOWN
 } algorithms;
 
 
+typedef U_BN *(*gcdFunction)(U_BN *a, U_BN *b);
+
 typedef enum {
     CPU=0,
     GPU,
     BOTH
 } procUnit;
 
+typedef enum {
+    PLAIN_REMAINDERS=0,
+    SCALED_REMAINDERS,
+    CHECK_REMAINDERS,
+    UNKNOWN_REMAINDERS
+} remainderTree;
+
+/**
+ * \brief Print out weak pairs found by processing unit
+ *
+ * \param[in] unit processing unit prefix
+ * \param[in] pairs collected weak pairs
+ * \param[in] key_paths names of keys
+ */
+
+void print_weak_pairs(const char *unit, WEAK_PAIRS *pairs, char **key_paths){
+    unsigned k;
+    WEAK_PAIR *p;
+
+    for(k=0; k<weak_pairs_size(pairs); k++){
+        p = &pairs->pairs[k];
+        printf("%s Weak pair: %s %s gcd: %s\n", unit, key_paths[p->i], key_paths[p->j], cu_bn_bn2hex(&p->gcd));
+        cu_bn_pool_reset();
+    }
+    if(weak_pairs_dropped(pairs)){
+        printf("%s Weak pairs not stored: %u\n", unit, weak_pairs_dropped(pairs));
+    }
+    printf("%s Weak keys: %u\n", unit, pairs->count);
+}
+
+/**
+ * \brief State of CPU scan shared by its engines
+ */
+
+typedef struct {
+    WEAK_PAIRS_STAGE *stage;
+    REPORT_WRITER *report;
+    KEY_CLUSTERS *clusters;
+    char **key_paths;
+    U_BN *keys;
+    unsigned number_of_keys;
+    unsigned total_keys;
+    int bipartite;
+    char *propagated;
+    unsigned *factored;
+    unsigned trial_divisions;
+} CPU_SCAN;
+
+/**
+ * \brief Record weak pair found on CPU
+ *
+ * \param[in, out] scan CPU scan state
+ * \param[in] i index of first key
+ * \param[in] j index of second key
+ * \param[in] r shared factor of both keys
+ */
+
+void record_weak_pair(CPU_SCAN *scan, unsigned i, unsigned j, const U_BN *r){
+    weak_pairs_stage_push(scan->stage, i, j, r);
+    if(scan->report){
+        report_writer_finding(scan->report, scan->key_paths[i], scan->key_paths[j], &scan->keys[i], &scan->keys[j], r);
+    }
+    key_clusters_add(scan->clusters, i, j, &scan->keys[i], &scan->keys[j], r);
+}
+
+/**
+ * \brief Replace remaining pairs of a newly factored key with one
+ * trial division pass against its primes
+ *
+ * Keys factored by the pass are queued for their own pass. Pairs up to
+ * and including (i, j), in row order, are already scanned.
+ *
+ * \param[in, out] scan CPU scan state
+ * \param[in] key index of key to propagate if factored
+ * \param[in] i first key of last scanned pair
+ * \param[in] j second key of last scanned pair
+ */
+
+void propagate_factors(CPU_SCAN *scan, unsigned key, unsigned i, unsigned j){
+    unsigned factored_count = 0, f, x, a, b;
+    const U_BN *r;
+
+    if(!key_clusters_is_factored(scan->clusters, key) || scan->propagated[key]){
+        return;
+    }
+    scan->factored[factored_count++] = key;
+    scan->propagated[key] = 1;
+    while(factored_count){
+        f = scan->factored[--factored_count];
+        scan->propagated[f] = 2;
+        for(x=0; x<scan->total_keys; x++){
+            a = MIN(f, x);
+            b = (f < x) ? x : f;
+            /* skip pairs already scanned or covered by an earlier pass */
+            if(x==f || scan->propagated[x]==2 || a<i || (a==i && b<=j)){
+                continue;
+            }
+            /* bipartite scan pairs only across sources */
+            if(scan->bipartite && ((f < scan->number_of_keys) == (x < scan->number_of_keys))){
+                continue;
+            }
+            if(key_clusters_is_factored(scan->clusters, x)){
+                /* primes of both keys are known, compare them instead of dividing */
+                r = key_clusters_known_gcd(scan->clusters, f, x, &scan->keys[f]);
+            } else {
+                scan->trial_divisions++;
+                r = key_clusters_trial_gcd(scan->clusters, f, &scan->keys[x]);
+            }
+            if(r){
+                record_weak_pair(scan, a, b, r);
+                if(key_clusters_is_factored(scan->clusters, x) && !scan->propagated[x]){
+                    scan->factored[factored_count++] = x;
+                    scan->propagated[x] = 1;
+                }
+            }
+            cu_bn_pool_reset();
+        }
+    }
+}
+
+/**
+ * \brief Test one pair of keys and propagate factors it recovers
+ *
+ * \param[in, out] scan CPU scan state
+ * \param[in] gcd GCD algorithm
+ * \param[in] i index of first key
+ * \param[in] j index of second key
+ * \return an integer 1 if the pair was tested, 0 if trial division
+ * already replaced it
+ */
+
+int scan_pair(CPU_SCAN *scan, gcdFunction gcd, unsigned i, unsigned j){
+    const U_BN *r;
+
+    /* pairs of a factored key were already tested against its primes */
+    if(scan->propagated[i] || scan->propagated[j]){
+        return 0;
+    }
+    r = gcd(cu_bn_pool_dup(&scan->keys[i]), cu_bn_pool_dup(&scan->keys[j]));
+    if(!cu_bn_is_one(r)){
+        record_weak_pair(scan, i, j, r);
+    }
+    cu_bn_pool_reset();
+    propagate_factors(scan, i, i, j);
+    propagate_factors(scan, j, i, j);
+    return 1;
+}
+
+/**
+ * \brief Pairwise scan filtered by products of blocks of keys
+ *
+ * Keys are split into aligned blocks of block keys whose products are
+ * computed once. Every key reduces the product of each block after it
+ * and runs one GCD per block; pairs of a block are tested one by one
+ * only when that GCD is not one. Pairs up to the first aligned block
+ * of a row are tested directly.
+ *
+ * \param[in, out] scan CPU scan state
+ * \param[in] gcd GCD algorithm
+ * \param[in] block number of keys in a block
+ * \param[in] L size of keys in words
+ * \param[in, out] skipped pairs replaced by trial division
+ * \return an integer 1 on success
+ */
+
+int block_product_scan(CPU_SCAN *scan, gcdFunction gcd, unsigned block, int L, unsigned *skipped){
+    U_BN *products, product, rem;
+    unsigned blocks, block_gcds = 0, expanded = 0, pairs = 0, end, b, i, j;
+    int shared, ret = 1;
+
+    blocks = (scan->total_keys + block - 1) / block;
+    products = (U_BN*)calloc(blocks, sizeof(U_BN));
+    rem.d = (unsigned*)malloc(L*sizeof(unsigned));
+    rem.top = 1;
+    if(!products || !rem.d){
+        free(products);
+        free(rem.d);
+        return 0;
+    }
+    for(b=0; b<blocks; b++){
+        end = MIN((b+1)*block, scan->total_keys);
+        products[b].d = (unsigned*)malloc(scan->keys[b*block].top*sizeof(unsigned));
+        memcpy(products[b].d, scan->keys[b*block].d, scan->keys[b*block].top*sizeof(unsigned));
+        products[b].top = scan->keys[b*block].top;
+        for(j=b*block+1; j<end; j++){
+            product.d = (unsigned*)calloc(products[b].top + scan->keys[j].top, sizeof(unsigned));
+            product.top = 1;
+            cu_bn_mul(&product, &products[b], &scan->keys[j]);
+            free(products[b].d);
+            products[b] = product;
+        }
+    }
+
+    for(i=0; ret && i<scan->number_of_keys; i++){
+        j = scan->bipartite ? scan->number_of_keys : i+1;
+        for(; j<scan->total_keys && j%block; j++){
+            *skipped += !scan_pair(scan, gcd, i, j);
+        }
+        for(b=(j+block-1)/block; b<blocks; b++){
+            end = MIN((b+1)*block, scan->total_keys);
+            /* rest of the row of a factored key was already tested against its primes */
+            if(scan->propagated[i]){
+                *skipped += end - b*block;
+                continue;
+            }
+            block_gcds++;
+            pairs += end - b*block;
+            if(!cu_bn_div(NULL, &rem, &products[b], &scan->keys[i])){
+                ret = 0;
+                break;
+            }
+            shared = cu_bn_is_zero(&rem) || !cu_bn_is_one(gcd(cu_bn_pool_dup(&scan->keys[i]), cu_bn_pool_dup(&rem)));
+            cu_bn_pool_reset();
+            if(!shared){
+                for(j=b*block; j<end; j++){
+                    *skipped += scan->propagated[j] ? 1 : 0;
+                }
+                continue;
+            }
+            expanded++;
+            for(j=b*block; j<end; j++){
+                *skipped += !scan_pair(scan, gcd, i, j);
+            }
+        }
+    }
+    printf("[CPU] Block GCDs: %u for %u pairs, blocks expanded: %u\n", block_gcds, pairs, expanded);
+
+    for(b=0; b<blocks; b++){
+        free(products[b].d);
+    }
+    free(products);
+    free(rem.d);
+    return ret;
+}
+
 /**
  * \brief Select enum algorithms value based on string algorithm
  *
@@ -37,11 +291,186 @@ algorithms set_enum_algorithm(char * algorithm){
         return BINARY_EUCLIDEAN;
     } else if(!strcmp( "fast", algorithm)) {
         return FAST_BINARY_EUCLIDEAN;
+    } else if(!strcmp( "ctz", algorithm)) {
+        return CTZ_BINARY_EUCLIDEAN;
+    } else if(!strcmp( "pm", algorithm)) {
+        return PLUS_MINUS;
+    } else if(!strcmp( "approx", algorithm)) {
+        return APPROXIMATE_EUCLIDEAN;
+    } else if(!strcmp( "divsteps", algorithm)) {
+        return DIVSTEPS;
+    } else if(!strcmp( "kary", algorithm)) {
+        return KARY;
+    } else if(!strcmp( "hybrid", algorithm)) {
+        return HYBRID;
     } else {
         return UNKNOWN;
     }
 }
 
+/**
+ * \brief Select enum remainderTree value based on string name
+ *
+ * \param[in] name remainder tree as a string
+ * \return remainderTree value
+ */
+
+remainderTree set_remainder_tree(char * name){
+    if(!strcmp( "plain", name)){
+        return PLAIN_REMAINDERS;
+    } else if(!strcmp( "scaled", name)) {
+        return SCALED_REMAINDERS;
+    } else if(!strcmp( "check", name)) {
+        return CHECK_REMAINDERS;
+    } else {
+        return UNKNOWN_REMAINDERS;
+    }
+}
+
+/**
+ * \brief Reduce x modulo every leaf with the selected remainder tree
+ *
+ * Check mode runs both trees, reports leaves where they differ and
+ * keeps remainders of the plain tree.
+ *
+ * \param[in] tree product tree
+ * \param[in] x number to reduce
+ * \param[out] remainders remainders of x modulo leaves
+ * \param[in] engine remainderTree value
+ * \param[in] L size of leaves in words
+ * \return an integer 1 on success
+ */
+
+int reduce_product(const PRODUCT_TREE *tree, const U_BN *x, U_BN *remainders, remainderTree engine, int L){
+    U_BN *scaled;
+    unsigned i, mismatches = 0;
+    int ret;
+
+    if(SCALED_REMAINDERS == engine){
+        return product_tree_scaled_remainders(tree, x, remainders);
+    }
+    clock_t start = clock();
+    ret = product_tree_remainders(tree, x, remainders);
+    clock_t stop = clock();
+    if(CHECK_REMAINDERS != engine || !ret){
+        return ret;
+    }
+
+    scaled = (U_BN*)malloc(tree->n*sizeof(U_BN));
+    for(i=0; i<tree->n; i++){
+        scaled[i].d = (unsigned*)malloc(L*sizeof(unsigned));
+        scaled[i].top = 1;
+    }
+    clock_t scaled_start = clock();
+    ret = product_tree_scaled_remainders(tree, x, scaled);
+    clock_t scaled_stop = clock();
+    for(i=0; ret && i<tree->n; i++){
+        if(cu_bn_ucmp(&remainders[i], &scaled[i])){
+            mismatches++;
+        }
+    }
+    printf("[CPU] Remainder tree check: %u mismatches of %u, plain in ms: %f, scaled in ms: %f\n", mismatches, tree->n,
+        (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC, (double)(scaled_stop - scaled_start) * 1000.0 / CLOCKS_PER_SEC);
+    for(i=0; i<tree->n; i++){
+        free(scaled[i].d);
+    }
+    free(scaled);
+    return ret;
+}
+
+/**
+ * \brief Flag keys sharing a factor with another key with the selected batch GCD
+ *
+ * Check mode runs both descents, reports keys they flag differently
+ * and keeps flags of the plain descent.
+ *
+ * \param[in] tree product tree of keys
+ * \param[in] gcd GCD algorithm
+ * \param[out] flagged flags of keys
+ * \param[in] engine remainderTree value
+ * \return an integer 1 on success
+ */
+
+int batch_product(const PRODUCT_TREE *tree, gcdFunction gcd, char *flagged, remainderTree engine){
+    char *scaled;
+    unsigned i, mismatches = 0;
+    int ret;
+
+    if(SCALED_REMAINDERS == engine){
+        return product_tree_scaled_batch_gcd(tree, gcd, flagged);
+    }
+    clock_t start = clock();
+    ret = product_tree_batch_gcd(tree, gcd, flagged);
+    clock_t stop = clock();
+    if(CHECK_REMAINDERS != engine || !ret){
+        return ret;
+    }
+
+    scaled = (char*)malloc(tree->n*sizeof(char));
+    clock_t scaled_start = clock();
+    ret = (NULL != scaled) && product_tree_scaled_batch_gcd(tree, gcd, scaled);
+    clock_t scaled_stop = clock();
+    for(i=0; ret && i<tree->n; i++){
+        mismatches += (flagged[i] != scaled[i]);
+    }
+    printf("[CPU] Batch GCD check: %u mismatches of %u, plain in ms: %f, scaled in ms: %f\n", mismatches, tree->n,
+        (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC, (double)(scaled_stop - scaled_start) * 1000.0 / CLOCKS_PER_SEC);
+    free(scaled);
+    return ret;
+}
+
+/**
+ * \brief Select host GCD function based on enum algorithms value
+ *
+ * \param[in] gcd_kind algorithms value
+ * \return GCD function or NULL for unknown algorithm
+ */
+
+gcdFunction select_gcd(algorithms gcd_kind){
+    switch(gcd_kind){
+        case EUCLIDEAN:
+            return cu_dev_classic_euclid;
+        case BINARY_EUCLIDEAN:
+            return cu_dev_binary_gcd;
+        case FAST_BINARY_EUCLIDEAN:
+            return cu_dev_fast_binary_euclid;
+        case CTZ_BINARY_EUCLIDEAN:
+            return cu_dev_ctz_binary_gcd;
+        case PLUS_MINUS:
+            return cu_dev_pm_gcd;
+        case APPROXIMATE_EUCLIDEAN:
+            return cu_dev_approximate_euclid;
+        case DIVSTEPS:
+            return cu_dev_divsteps_gcd;
+        case KARY:
+            return cu_dev_kary_gcd;
+        case HYBRID:
+            return cu_dev_hybrid_gcd;
+        default:
+            return NULL;
+    }
+}
+
+/**
+ * \brief Add primes of every factored key to the blacklist
+ *
+ * \param[in, out] blacklist known weak primes
+ * \param[in] clusters clusters of keys sharing primes
+ * \return number of new primes
+ */
+
+unsigned blacklist_factored_keys(PRIME_BLACKLIST *blacklist, KEY_CLUSTERS *clusters){
+    unsigned k, added = 0;
+
+    for(k=0; blacklist && k<clusters->n; k++){
+        if(key_clusters_is_factored(clusters, k)){
+            added += prime_blacklist_add(blacklist, &clusters->p[k]);
+            added += prime_blacklist_add(blacklist, &clusters->q[k]);
+        }
+    }
+    return added;
+}
+
 /**
  * \brief Select enum procUnit value based on string cpu_gpu
  *
@@ -60,6 +489,448 @@ procUnit set_proc_unit(char * cpu_gpu){
     return BOTH;
 }
 
+/**
+ * \brief Print out command line usage
+ */
+
+void print_usage(void){
+    printf("\nFind weak keys\n\rUsage:\n\r ./GCD_RSA number_of_keys key_size threads_per_block directory_name kind_of_algorithm CPU_or_GPU [options]\n\rAlgorithms:\n\r\t-\"euclid\"\n\r\t-\"binary\"\n\r\t-\"fast\"\n\r\t-\"ctz\"\n\r\t-\"pm\"\n\r\t-\"approx\"\n\r\t-\"divsteps\"\n\r\t-\"kary\"\n\r\t-\"hybrid\"\n\r\n\rCPU_or_GPU:\n\r\t-\"CPU\"\n\r\t-\"GPU\"\n\r\t-\"CPU_GPU\"\n\r\n\rOptions:\n\r\t--report file\tstream findings as JSON lines, or CSV if file ends with .csv\n\r\t--clusters file\twrite clusters of keys sharing primes as JSON lines\n\r\t--corpus directory number_of_keys\tscan only pairs of keys against keys of corpus\n\r\t--product\treduce product of corpus modulo each key on CPU with --corpus, batch GCD of keys and pairwise GCDs of flagged keys without it\n\r\t--sparse k\tstore only every k-th level of product trees and recompute the others, with --product but not --spill\n\r\t--remainders plain|scaled|check\tremainder tree of --product and of its batch GCD, check runs both and compares them, --spill is plain only\n\r\t--spill directory\tkeep product and remainder trees in files of directory, with --product also for the batch GCD\n\r\t--memory megabytes\tkeep levels of spilled trees in memory up to megabytes per tree\n\r\t--block keys\tone GCD per product of a block of keys, pairs of a block only if it shares a factor\n\r\t--blacklist file\tflag keys sharing a known weak prime and store recovered primes, with --product keys are only flagged\n\r\n\rDaemon:\n\r ./GCD_RSA daemon port_or_socket_path directory_name number_of_keys key_size [kind_of_algorithm]\n\r\n\rSingle key query:\n\r ./GCD_RSA tree tree_file directory_name number_of_keys key_size\n\r ./GCD_RSA query tree_file key_file key_size [kind_of_algorithm]\n\r\n\rStream of hexadecimal moduli from standard input:\n\r ./GCD_RSA --stream key_size [kind_of_algorithm]\n\r\tpairs within one block of %d keys are reported once the block is read, pairs spanning blocks only once the aligned run of %d * 2^k keys holding both is read, at the latest at the end of the input\n\r", KEY_STREAM_BUFFER, KEY_STREAM_BUFFER);
+}
+
+/**
+ * \brief Load moduli of keys directory/1.pem ... directory/n.pem
+ *
+ * \param[in]  directory A name of keys directory
+ * \param[in]  number_of_keys A number of keys
+ * \param[in]  key_size A size of keys in bits
+ * \return an array of moduli
+ */
+
+U_BN *load_keys(const char *directory, unsigned number_of_keys, unsigned key_size){
+    char *tmp_path;
+    unsigned i;
+    int L = ((key_size+31) / (8*sizeof(unsigned)));
+    U_BN *keys = (U_BN*)malloc(number_of_keys*sizeof(U_BN));
+
+    for(i=0; i<number_of_keys; i++){
+        keys[i].d = (unsigned*)calloc(L, sizeof(unsigned));
+        keys[i].top = L;
+        asprintf(&tmp_path, "%s/%d.pem", directory, (i+1));
+        get_u_bn_from_mod_PEM(tmp_path, &keys[i]);
+        free(tmp_path);
+    }
+    return keys;
+}
+
+void free_keys(U_BN *keys, unsigned number_of_keys){
+    unsigned i;
+
+    for(i=0; i<number_of_keys; i++){
+        free(keys[i].d);
+    }
+    free(keys);
+}
+
+/**
+ * \brief Run daemon answering weak key queries against a resident corpus
+ *
+ * \param[in]  argc An integer argument count of the command line arguments
+ * \param[in]  argv An argument vector of the command line arguments
+ * \return an integer 0 upon exit success
+ */
+
+int run_daemon(int argc, char* argv[]){
+    char *address, *directory;
+    unsigned number_of_keys, key_size;
+    int fd;
+    U_BN *keys;
+    KEY_CORPUS *corpus;
+    gcdFunction gcd;
+
+    if(argc<6){
+        print_usage();
+        return 0;
+    }
+    address = argv[2];
+    directory = argv[3];
+    number_of_keys = atoi(argv[4]);
+    key_size = atoi(argv[5]);
+    gcd = select_gcd(set_enum_algorithm((argc>6) ? argv[6] : (char*)"binary"));
+    if(!gcd){
+        printf("Unknown GCD algorithm\n");
+        return 1;
+    }
+    cu_bn_pool_init(key_size);
+
+    keys = load_keys(directory, number_of_keys, key_size);
+    clock_t start = clock();
+    corpus = key_corpus_new(keys, number_of_keys);
+    clock_t stop = clock();
+    free_keys(keys, number_of_keys);
+    if(!corpus){
+        printf("Cannot build corpus\n");
+        return 1;
+    }
+    printf("Corpus of %u keys, product of %d bits built in ms: %f\n", corpus->n, cu_bn_num_bits(&corpus->product), (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC);
+
+    if((fd = key_daemon_listen(address)) < 0){
+        printf("Cannot listen on %s\n", address);
+        key_corpus_free(corpus);
+        return 1;
+    }
+    printf("Listening on %s\n", address);
+    fflush(stdout);
+    key_daemon_serve(fd, corpus, gcd);
+    close(fd);
+    key_corpus_free(corpus);
+    cu_bn_pool_release();
+    return 0;
+}
+
+/**
+ * \brief Build product tree of a corpus and save it to a file
+ *
+ * \param[in]  argc An integer argument count of the command line arguments
+ * \param[in]  argv An argument vector of the command line arguments
+ * \return an integer 0 upon exit success
+ */
+
+int run_tree(int argc, char* argv[]){
+    char *tree_path, *directory;
+    unsigned number_of_keys, key_size;
+    U_BN *keys;
+    PRODUCT_TREE *tree;
+    int saved;
+
+    if(argc<6){
+        print_usage();
+        return 0;
+    }
+    tree_path = argv[2];
+    directory = argv[3];
+    number_of_keys = atoi(argv[4]);
+    key_size = atoi(argv[5]);
+    cu_bn_pool_init(key_size);
+
+    keys = load_keys(directory, number_of_keys, key_size);
+    clock_t start = clock();
+    tree = product_tree_new(keys, number_of_keys);
+    clock_t stop = clock();
+    free_keys(keys, number_of_keys);
+    if(!tree){
+        printf("Cannot build product tree\n");
+        return 1;
+    }
+    printf("Product tree of %u keys, %d levels, root of %d bits built in ms: %f\n", tree->n, tree->levels, cu_bn_num_bits(product_tree_root(tree)), (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC);
+    saved = product_tree_save(tree, tree_path);
+    product_tree_free(tree);
+    cu_bn_pool_release();
+    return saved ? 0 : 1;
+}
+
+/**
+ * \brief Check a single key against a saved product tree
+ *
+ * \param[in]  argc An integer argument count of the command line arguments
+ * \param[in]  argv An argument vector of the command line arguments
+ * \return an integer 0 if the key is coprime to the corpus, 2 if it is weak
+ */
+
+int run_query(int argc, char* argv[]){
+    char *tree_path, *key_path;
+    unsigned key_size, *leaves, found, k;
+    int L;
+    U_BN key, *factor;
+    PRODUCT_TREE *tree;
+    gcdFunction gcd;
+
+    if(argc<5){
+        print_usage();
+        return 0;
+    }
+    tree_path = argv[2];
+    key_path = argv[3];
+    key_size = atoi(argv[4]);
+    gcd = select_gcd(set_enum_algorithm((argc>5) ? argv[5] : (char*)"binary"));
+    if(!gcd){
+        printf("Unknown GCD algorithm\n");
+        return 1;
+    }
+    L = ((key_size+31) / (8*sizeof(unsigned)));
+    cu_bn_pool_init(key_size);
+
+    key.d = (unsigned*)calloc(L, sizeof(unsigned));
+    key.top = L;
+    if(!get_u_bn_from_mod_PEM(key_path, &key) || (tree = product_tree_load(tree_path)) == NULL){
+        free(key.d);
+        return 1;
+    }
+    leaves = (unsigned*)malloc(tree->n*sizeof(unsigned));
+    factor = cu_bn_pool_new();
+    clock_t start = clock();
+    found = product_tree_query(tree, &key, gcd, factor, leaves, tree->n);
+    clock_t stop = clock();
+
+    if(found){
+        printf("Weak key: %s factor: %s\n", key_path, cu_bn_bn2hex(factor));
+        for(k=0; k<found; k++){
+            printf("Matching corpus key: %u.pem\n", leaves[k]+1);
+        }
+    } else {
+        printf("Key %s shares no factor with %u corpus keys\n", key_path, tree->n);
+    }
+    printf("Query time in ms: %f\n", (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC);
+
+    free(leaves);
+    free(key.d);
+    product_tree_free(tree);
+    cu_bn_pool_release();
+    return found ? 2 : 0;
+}
+
+/**
+ * \brief Resolve keys flagged by a batch GCD with pairwise GCDs
+ *
+ * Tests only pairs of flagged keys, across sources in a bipartite
+ * scan, so the quadratic stage runs on the flagged subset and every
+ * finding names both keys and their shared factor.
+ *
+ * \param[in, out] scan CPU scan state
+ * \param[in] gcd GCD algorithm
+ * \param[in] flagged flags of scan->total_keys keys
+ * \return number of tested pairs
+ */
+
+unsigned resolve_flagged_pairs(CPU_SCAN *scan, gcdFunction gcd, const char *flagged){
+    unsigned *subset, count = 0, tested = 0, a, b, i, j;
+    const U_BN *r;
+
+    subset = (unsigned*)malloc(scan->total_keys*sizeof(unsigned));
+    for(i=0; i<scan->total_keys; i++){
+        if(flagged[i]){
+            subset[count++] = i;
+        }
+    }
+    for(a=0; a<count; a++){
+        for(b=a+1; b<count; b++){
+            i = subset[a];
+            j = subset[b];
+            if(scan->bipartite && ((i < scan->number_of_keys) == (j < scan->number_of_keys))){
+                continue;
+            }
+            tested++;
+            r = gcd(cu_bn_pool_dup(&scan->keys[i]), cu_bn_pool_dup(&scan->keys[j]));
+            if(!cu_bn_is_one(r)){
+                record_weak_pair(scan, i, j, r);
+            }
+            cu_bn_pool_reset();
+        }
+    }
+    free(subset);
+    return tested;
+}
+
+/**
+ * \brief Product engine with product and remainder trees spilled to disk
+ *
+ * Flags keys sharing a factor with the product of the corpus and corpus
+ * keys sharing a factor with the product of the keys, then tests only
+ * pairs of flagged keys.
+ *
+ * \param[in, out] scan CPU scan state
+ * \param[in] gcd GCD algorithm
+ * \param[in] L size of keys in words
+ * \param[in] spill_directory directory of level files
+ * \param[in] memory budget for resident levels of each tree in bytes
+ * \return an integer 1 on success
+ */
+
+int spill_product_scan(CPU_SCAN *scan, gcdFunction gcd, int L, const char *spill_directory, size_t memory){
+    SPILL_TREE *keys_tree = NULL, *corpus_tree = NULL;
+    U_BN *remainders;
+    char *flagged, *prefix;
+    unsigned corpus_keys = scan->total_keys - scan->number_of_keys, i;
+    int ret = 0;
+
+    remainders = (U_BN*)malloc(scan->total_keys*sizeof(U_BN));
+    flagged = (char*)calloc(scan->total_keys, sizeof(char));
+    for(i=0; i<scan->total_keys; i++){
+        remainders[i].d = (unsigned*)malloc(L*sizeof(unsigned));
+        remainders[i].top = 1;
+    }
+    if(asprintf(&prefix, "%s/keys", spill_directory) >= 0){
+        keys_tree = spill_tree_new(scan->keys, scan->number_of_keys, prefix, memory);
+        free(prefix);
+    }
+    if(keys_tree && asprintf(&prefix, "%s/corpus", spill_directory) >= 0){
+        corpus_tree = spill_tree_new(&scan->keys[scan->number_of_keys], corpus_keys, prefix, memory);
+        free(prefix);
+    }
+
+    if(keys_tree && corpus_tree
+        && spill_tree_remainders(keys_tree, spill_tree_root(corpus_tree), remainders)
+        && spill_tree_remainders(corpus_tree, spill_tree_root(keys_tree), &remainders[scan->number_of_keys])){
+        for(i=0; i<scan->total_keys; i++){
+            flagged[i] = cu_bn_is_zero(&remainders[i]) || !cu_bn_is_one(gcd(cu_bn_pool_dup(&scan->keys[i]), cu_bn_pool_dup(&remainders[i])));
+            cu_bn_pool_reset();
+        }
+        resolve_flagged_pairs(scan, gcd, flagged);
+        printf("[CPU] Spilled levels: %u of %d and %u of %d, peak resident tree memory in bytes: %zu and %zu\n",
+            keys_tree->spilled, keys_tree->levels, corpus_tree->spilled, corpus_tree->levels, keys_tree->peak, corpus_tree->peak);
+        ret = 1;
+    } else {
+        printf("[CPU] Cannot build product trees in %s\n", spill_directory);
+    }
+
+    for(i=0; i<scan->total_keys; i++){
+        free(remainders[i].d);
+    }
+    free(remainders);
+    free(flagged);
+    spill_tree_free(keys_tree);
+    spill_tree_free(corpus_tree);
+    return ret;
+}
+
+/**
+ * \brief Batch GCD of keys with the product tree spilled to disk
+ *
+ * Flags keys sharing a factor with any other key, then tests only
+ * pairs of flagged keys.
+ *
+ * \param[in, out] scan CPU scan state
+ * \param[in] gcd GCD algorithm
+ * \param[in] spill_directory directory of level files
+ * \param[in] memory budget for resident levels of the tree in bytes
+ * \return an integer 1 on success
+ */
+
+int spill_batch_scan(CPU_SCAN *scan, gcdFunction gcd, const char *spill_directory, size_t memory){
+    SPILL_TREE *keys_tree = NULL;
+    char *flagged, *prefix;
+    unsigned flagged_keys = 0, tested, i;
+    int ret = 0;
+
+    clock_t start = clock();
+    flagged = (char*)calloc(scan->total_keys, sizeof(char));
+    if(asprintf(&prefix, "%s/keys", spill_directory) >= 0){
+        keys_tree = spill_tree_new(scan->keys, scan->number_of_keys, prefix, memory);
+        free(prefix);
+    }
+
+    if(keys_tree && flagged && spill_tree_batch_gcd(keys_tree, gcd, flagged)){
+        for(i=0; i<scan->number_of_keys; i++){
+            flagged_keys += flagged[i];
+        }
+        tested = resolve_flagged_pairs(scan, gcd, flagged);
+        printf("[CPU] Batch GCD flagged %u of %u keys, pairwise GCDs of flagged keys: %u, time in ms: %f\n",
+            flagged_keys, scan->number_of_keys, tested, (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+        printf("[CPU] Spilled levels: %u of %d, peak resident tree memory in bytes: %zu\n",
+            keys_tree->spilled, keys_tree->levels, keys_tree->peak);
+        ret = 1;
+    } else {
+        printf("[CPU] Cannot build product tree in %s\n", spill_directory);
+    }
+
+    free(flagged);
+    spill_tree_free(keys_tree);
+    return ret;
+}
+
+/**
+ * \brief Print weak pairs of a stream and empty the collection
+ *
+ * \param[in,out]  pairs A collection of weak pairs
+ */
+
+void print_stream_pairs(WEAK_PAIRS *pairs){
+    unsigned k;
+    WEAK_PAIR *p;
+
+    for(k=0; k<weak_pairs_size(pairs); k++){
+        p = &pairs->pairs[k];
+        printf("Weak pair: %u %u gcd: %s\n", p->i+1, p->j+1, cu_bn_bn2hex(&p->gcd));
+        cu_bn_pool_reset();
+    }
+    if(weak_pairs_dropped(pairs)){
+        printf("Dropped weak pairs: %u\n", weak_pairs_dropped(pairs));
+    }
+    /* printed findings are not kept, the stream may run indefinitely */
+    pairs->count = 0;
+    fflush(stdout);
+}
+
+/**
+ * \brief Check moduli read from the standard input as they arrive
+ *
+ * \param[in]  argc An integer argument count of the command line arguments
+ * \param[in]  argv An argument vector of the command line arguments
+ * \return an integer 0 upon exit success
+ */
+
+int run_stream(int argc, char* argv[]){
+    unsigned key_size, weak = 0, invalid = 0;
+    char *line = NULL;
+    size_t len = 0;
+    U_BN *key;
+    WEAK_PAIRS *pairs;
+    KEY_STREAM *stream;
+    gcdFunction gcd;
+    int ret = 0;
+
+    if(argc<3){
+        print_usage();
+        return 0;
+    }
+    key_size = atoi(argv[2]);
+    gcd = select_gcd(set_enum_algorithm((argc>3) ? argv[3] : (char*)"binary"));
+    if(!gcd){
+        printf("Unknown GCD algorithm\n");
+        return 1;
+    }
+    cu_bn_pool_init(key_size);
+    key = cu_bn_new();
+    pairs = weak_pairs_new(WEAK_PAIRS_DEFAULT_SIZE, ((key_size+31) / (8*sizeof(unsigned))));
+    if((stream = key_stream_new(pairs, gcd)) == NULL){
+        cu_bn_free(key);
+        weak_pairs_free(pairs);
+        return 1;
+    }
+
+    clock_t start = clock();
+    while(getline(&line, &len, stdin) > 0){
+        if('\n' == line[0] || '#' == line[0]){
+            continue;
+        }
+        if(!cu_bn_hex2bn(key, line) || cu_bn_num_bits(key) > (int)key_size){
+            invalid++;
+            continue;
+        }
+        if(!key_stream_insert(stream, key)){
+            ret = 1;
+            break;
+        }
+        weak += weak_pairs_size(pairs);
+        print_stream_pairs(pairs);
+    }
+    if(!ret && !key_stream_finish(stream)){
+        ret = 1;
+    }
+    weak += weak_pairs_size(pairs);
+    print_stream_pairs(pairs);
+    clock_t stop = clock();
+
+    printf("Stream of %u keys (%u invalid lines), %u merges, weak pairs: %u\n", stream->n, invalid, stream->merges, weak);
+    printf("Time in ms: %f, per key: %f\n", (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC, stream->n ? (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC / stream->n : 0.0);
+
+    free(line);
+    cu_bn_free(key);
+    key_stream_free(stream);
+    weak_pairs_free(pairs);
+    cu_bn_pool_release();
+    return ret;
+}
+
 /**
  * \brief  Main function
  *
@@ -74,17 +945,49 @@ int main(int argc, char* argv[]){
     unsigned key_size;
     unsigned thread_per_block;
     unsigned number_of_comutations;
+    unsigned number_of_pair_lists;
     char *keys_directory;
     int counter;
     algorithms gcd_kind;
     procUnit cpu_gpu;
+    char *report_path = NULL;
+    REPORT_WRITER *report = NULL;
+    char *clusters_path = NULL;
+    REPORT_WRITER *clusters_report = NULL;
+    char *corpus_directory = NULL;
+    unsigned corpus_keys = 0;
+    unsigned total_keys;
+    int product = 0;
+    char *spill_directory = NULL;
+    int sparse = 1;
+    unsigned block = 0;
+    remainderTree remainder_tree = PLAIN_REMAINDERS;
+    size_t spill_memory = 0;
+    char *blacklist_path = NULL;
+    PRIME_BLACKLIST *blacklist = NULL;
+    U_BN *blacklist_factors = NULL;
+    const U_BN *blacklist_prime = NULL;
+    unsigned blacklisted = 0, blacklist_new = 0;
+
+    if(argc>=2 && !strcmp("daemon", argv[1])){
+        return run_daemon(argc, argv);
+    }
+    if(argc>=2 && !strcmp("--stream", argv[1])){
+        return run_stream(argc, argv);
+    }
+    if(argc>=2 && !strcmp("tree", argv[1])){
+        return run_tree(argc, argv);
+    }
+    if(argc>=2 && !strcmp("query", argv[1])){
+        return run_query(argc, argv);
+    }
 
     /**
     	Get command line arguments and set appropriate program parameters
     */
 
-    if(argc==7) {
-        for(counter=0;counter<argc;counter++){
+    if(argc>=7) {
+        for(counter=0;counter<7;counter++){
             switch(counter){
                 case 1:
                     printf("\nnumber_of_keys argv[%d]: %s\n",counter,argv[counter]);
@@ -114,20 +1017,76 @@ int main(int argc, char* argv[]){
                     break;
             }
         }
+        for(counter=7;counter<argc;counter++){
+            if(!strcmp("--report", argv[counter]) && (counter+1)<argc){
+                report_path=argv[++counter];
+                printf("\nreport file argv[%d]: %s\n",counter,report_path);
+            } else if(!strcmp("--clusters", argv[counter]) && (counter+1)<argc){
+                clusters_path=argv[++counter];
+                printf("\nclusters file argv[%d]: %s\n",counter,clusters_path);
+            } else if(!strcmp("--corpus", argv[counter]) && (counter+2)<argc){
+                corpus_directory=argv[++counter];
+                corpus_keys=atoi(argv[++counter]);
+                printf("\ncorpus argv[%d]: %s %u\n",counter,corpus_directory,corpus_keys);
+            } else if(!strcmp("--blacklist", argv[counter]) && (counter+1)<argc){
+                blacklist_path=argv[++counter];
+                printf("\nblacklist file argv[%d]: %s\n",counter,blacklist_path);
+            } else if(!strcmp("--spill", argv[counter]) && (counter+1)<argc){
+                spill_directory=argv[++counter];
+                printf("\nspill directory argv[%d]: %s\n",counter,spill_directory);
+            } else if(!strcmp("--memory", argv[counter]) && (counter+1)<argc){
+                spill_memory=(size_t)atoi(argv[++counter]) << 20;
+                printf("\nmemory of spilled trees argv[%d]: %zu\n",counter,spill_memory);
+            } else if(!strcmp("--block", argv[counter]) && (counter+1)<argc){
+                block=atoi(argv[++counter]);
+                printf("\nkeys per block product argv[%d]: %u\n",counter,block);
+            } else if(!strcmp("--sparse", argv[counter]) && (counter+1)<argc){
+                sparse=atoi(argv[++counter]);
+                printf("\nstored levels of product trees argv[%d]: every %d\n",counter,sparse);
+            } else if(!strcmp("--remainders", argv[counter]) && (counter+1)<argc && UNKNOWN_REMAINDERS != set_remainder_tree(argv[counter+1])){
+                remainder_tree=set_remainder_tree(argv[++counter]);
+                printf("\nremainder tree argv[%d]: %s\n",counter,argv[counter]);
+            } else if(!strcmp("--product", argv[counter])){
+                product=1;
+                printf("\nproduct of corpus argv[%d]\n",counter);
+            } else {
+                print_usage();
+                return 0;
+            }
+        }
     } else {
-        printf("\nFind weak keys\n\rUsage:\n\r ./GCD_RSA number_of_keys key_size threads_per_block directory_name kind_of_algorithm CPU_or_GPU\n\rAlgorithms:\n\r\t-\"euclid\"\n\r\t-\"binary\"\n\r\t-\"fast\"\n\r\n\rCPU_or_GPU:\n\r\t-\"CPU\"\n\r\t-\"GPU\"\n\r\t-\"CPU_GPU\"\n\r");
+        print_usage();
         return 0;
     }
+    if(spill_directory && (1 != sparse || PLAIN_REMAINDERS != remainder_tree)){
+        printf("Spilled trees store every level and use plain remainder trees, --spill takes neither --sparse nor --remainders scaled|check\n");
+        return 1;
+    }
+    if(sparse < 1){
+        printf("--sparse takes a positive number of levels\n");
+        return 1;
+    }
 
-    number_of_comutations=((number_of_keys/2)*(number_of_keys-1));
+    /**
+    	Bipartite scan pairs every key only with every corpus key, corpus
+    	keys are indexed after the keys
+    */
+    if(corpus_directory){
+        number_of_comutations=number_of_keys*corpus_keys;
+    } else {
+        number_of_comutations=((number_of_keys*(number_of_keys-1))/2);
+    }
+    total_keys=number_of_keys+corpus_keys;
 
-    U_BN tmp;
     int L = ((key_size+31) / (8*sizeof(unsigned)));
     unsigned i, j;
     unsigned k = 0, l=0;
-    U_BN   *A, *B, *C;
-    U_BN   *device_U_BN_A, *device_U_BN_B, *device_U_BN_C;
+    U_BN   *A, *B;
+    U_BN   *device_U_BN_A, *device_U_BN_B;
     U_BN   *cu_PEMs;
+    char  **key_paths;
+    WEAK_PAIRS *cpu_pairs, *gpu_pairs, *device_pairs;
+    KEY_CLUSTERS *clusters;
     char *tmp_path;
     cudaError_t cudaStatus;
 
@@ -136,28 +1095,43 @@ int main(int argc, char* argv[]){
     */
 
     unit_test();
+    cu_bn_pool_init(key_size);
     //OpenSSL_GCD(number_of_keys, key_size, keys_directory);
 
+    /**
+    	Open reports before any work, a report that cannot be written ends the run
+    */
+
+    if(report_path && (report = report_writer_open(report_path)) == NULL){
+        printf("Cannot write report %s\n", report_path);
+        return 1;
+    }
+    if(clusters_path && (clusters_report = report_writer_open(clusters_path)) == NULL){
+        printf("Cannot write clusters %s\n", clusters_path);
+        report_writer_close(report);
+        return 1;
+    }
+
     /**
     	Allocate memory for RSA public key modulus
     */
 
-    A    = (U_BN*)malloc(number_of_comutations*sizeof(U_BN));
-    B    = (U_BN*)malloc(number_of_comutations*sizeof(U_BN));
-    C    = (U_BN*)malloc(number_of_comutations*sizeof(U_BN));
-    cu_PEMs = (U_BN*)malloc(number_of_keys*sizeof(U_BN));
+    cu_PEMs = (U_BN*)malloc(total_keys*sizeof(U_BN));
+    key_paths = (char**)malloc(total_keys*sizeof(char*));
+
+    /* only GPU consumes pair lists */
+    number_of_pair_lists = (cpu_gpu==CPU) ? 0 : number_of_comutations;
+    A    = (U_BN*)malloc(number_of_pair_lists*sizeof(U_BN));
+    B    = (U_BN*)malloc(number_of_pair_lists*sizeof(U_BN));
 
-    for(i=0; i<number_of_comutations; i++){
+    for(i=0; i<number_of_pair_lists; i++){
 
         U_BN a;
         U_BN b;
-        U_BN c;
         a.d = (unsigned*)malloc(L*sizeof(unsigned));
         b.d = (unsigned*)malloc(L*sizeof(unsigned));
-        c.d = (unsigned*)malloc(L*sizeof(unsigned));
         a.top =   L;
         b.top =   L;
-        c.top =   L;
 
         for(j=0; j<L; j++)
             a.d[j]=0;
@@ -165,16 +1139,12 @@ int main(int argc, char* argv[]){
         for(j=0; j<L; j++)
             b.d[j]=0;
 
-        for(j=0; j<L; j++)
-            c.d[j]=0;
-
         A[i] = a;
         B[i] = b;
-        C[i] = c;
 
     }
 
-    for(i=0; i<number_of_keys; i++){
+    for(i=0; i<total_keys; i++){
 
         U_BN d;
         d.d = (unsigned*)malloc(L*sizeof(unsigned));
@@ -191,23 +1161,60 @@ int main(int argc, char* argv[]){
     	Get RSA public keys from files 
     */
 
-    for(i=0; i<number_of_keys; i++){
-        cu_PEMs[i] = tmp;
-        asprintf(&tmp_path, "%s/%d.pem", keys_directory, (i+1));
+    for(i=0; i<total_keys; i++){
+        if(i<number_of_keys){
+            asprintf(&tmp_path, "%s/%d.pem", keys_directory, (i+1));
+        } else {
+            asprintf(&tmp_path, "%s/%d.pem", corpus_directory, (i-number_of_keys+1));
+        }
         get_u_bn_from_mod_PEM(tmp_path, &cu_PEMs[i]);
+        key_paths[i] = tmp_path;
+    }
+
+    /**
+    	Flag keys sharing a known weak prime before any pairwise work
+    */
+
+    if(blacklist_path){
+        blacklist = prime_blacklist_load(blacklist_path);
+        blacklist_factors = (U_BN*)malloc(total_keys*sizeof(U_BN));
+        for(i=0; i<total_keys; i++){
+            blacklist_factors[i].d = (unsigned*)malloc(L*sizeof(unsigned));
+            blacklist_factors[i].top = 1;
+        }
+        blacklisted = prime_blacklist_screen(blacklist, cu_PEMs, total_keys, select_gcd(gcd_kind) ? select_gcd(gcd_kind) : cu_dev_binary_gcd, blacklist_factors);
+        printf("Blacklist primes: %u\n", blacklist ? blacklist->count : 0);
+        for(i=0; blacklisted && i<total_keys; i++){
+            if(!cu_bn_is_one(&blacklist_factors[i])){
+                /* both primes blacklisted, the gcd is the modulus, keep one of them */
+                if(!cu_bn_ucmp(&blacklist_factors[i], &cu_PEMs[i])){
+                    blacklist_prime = prime_blacklist_find(blacklist, &cu_PEMs[i], select_gcd(gcd_kind) ? select_gcd(gcd_kind) : cu_dev_binary_gcd);
+                    if(blacklist_prime){
+                        cu_ubn_copy(&blacklist_factors[i], blacklist_prime);
+                    }
+                }
+                printf("Blacklisted key: %s factor: %s\n", key_paths[i], cu_bn_bn2hex(&blacklist_factors[i]));
+                cu_bn_pool_reset();
+                /* the blacklist has no modulus, the key's own cofactor stands for both */
+                if(report){
+                    report_writer_finding(report, key_paths[i], blacklist_path, &cu_PEMs[i], &cu_PEMs[i], &blacklist_factors[i]);
+                }
+            }
+        }
+        printf("Blacklisted keys: %u\n", blacklisted);
     }
 
     /**
     	Collect list A and B for computing
     */
 
-    for(i=0, k=0; i<number_of_keys; i++){
-        for(j=(i+1); j<number_of_keys; j++, k++){
+    for(i=0, k=0; k<number_of_pair_lists && i<number_of_keys; i++){
+        for(j=(corpus_directory ? number_of_keys : i+1); j<total_keys; j++, k++){
             A[k].top = cu_PEMs[i].top;
             B[k].top = cu_PEMs[j].top;
             for(l=0;l<L;l++){
-                A[k].d[l] = cu_PEMs[i].d[l];
-                B[k].d[l] = cu_PEMs[j].d[l];
+                A[k].d[l] = (l < cu_PEMs[i].top) ? cu_PEMs[i].d[l] : 0;
+                B[k].d[l] = (l < cu_PEMs[j].top) ? cu_PEMs[j].d[l] : 0;
             }
         }
     }
@@ -216,17 +1223,13 @@ int main(int argc, char* argv[]){
     	Execute if GPU is command line argument
     */
 
-    int sum=0;
-
     if(cpu_gpu==GPU || cpu_gpu==BOTH) {
 
         cudaDeviceReset();
         cudaStatus = cudaMalloc((void**)&device_U_BN_A, number_of_comutations*sizeof(U_BN));    
         cudaStatus = cudaMalloc((void**)&device_U_BN_B, number_of_comutations*sizeof(U_BN));
-        cudaStatus = cudaMalloc((void**)&device_U_BN_C, number_of_comutations*sizeof(U_BN));
         cudaStatus = cudaMemcpy(device_U_BN_A, A, number_of_comutations*sizeof(U_BN), cudaMemcpyHostToDevice);
         cudaStatus = cudaMemcpy(device_U_BN_B, B, number_of_comutations*sizeof(U_BN), cudaMemcpyHostToDevice);
-        cudaStatus = cudaMemcpy(device_U_BN_C, C, number_of_comutations*sizeof(U_BN), cudaMemcpyHostToDevice);
 
         unsigned long *out;
 
@@ -238,9 +1241,14 @@ int main(int argc, char* argv[]){
             cudaMalloc(&out, L*sizeof(unsigned));
             cudaMemcpy(out, B[i].d, L*sizeof(unsigned), cudaMemcpyHostToDevice);
             cudaMemcpy(&device_U_BN_B[i].d, &out, sizeof(void*), cudaMemcpyHostToDevice);
-            cudaMalloc(&out, L*sizeof(unsigned));
-            cudaMemcpy(out, C[i].d, L*sizeof(unsigned), cudaMemcpyHostToDevice);
-            cudaMemcpy(&device_U_BN_C[i].d, &out, sizeof(void*), cudaMemcpyHostToDevice);
+        }
+
+        gpu_pairs = weak_pairs_new(MIN(number_of_comutations, WEAK_PAIRS_DEFAULT_SIZE), L);
+        device_pairs = gpu_pairs ? weak_pairs_to_device(gpu_pairs) : NULL;
+        if (device_pairs == NULL) {
+            fprintf(stderr, "\n Cannot allocate weak pairs in device memory\n");
+            weak_pairs_free(gpu_pairs);
+            return 1;
         }
 
         float time;
@@ -254,15 +1262,39 @@ int main(int argc, char* argv[]){
         switch(gcd_kind){
             case EUCLIDEAN:
                 printf("[GPU] Euclidean algorithm\n");
-                orgEuclideanKernel<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_U_BN_C, number_of_comutations);
+                orgEuclideanKernel_with_selection<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_pairs, number_of_comutations, number_of_keys, corpus_keys);
                 break;
             case BINARY_EUCLIDEAN:
                 printf("[GPU] Binary algorithm\n");
-                binEuclideanKernel<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_U_BN_C, number_of_comutations);
+                binEuclideanKernel_with_selection<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_pairs, number_of_comutations, number_of_keys, corpus_keys);
                 break;
             case FAST_BINARY_EUCLIDEAN:
                 printf("[GPU] Fast Binary algorithm\n");
-                fastBinaryKernel<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_U_BN_C, number_of_comutations);
+                fastBinaryKernel_with_selection<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_pairs, number_of_comutations, number_of_keys, corpus_keys);
+                break;
+            case CTZ_BINARY_EUCLIDEAN:
+                printf("[GPU] Binary algorithm with trailing zero counts\n");
+                ctzBinaryKernel_with_selection<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_pairs, number_of_comutations, number_of_keys, corpus_keys);
+                break;
+            case PLUS_MINUS:
+                printf("[GPU] Plus-minus algorithm\n");
+                pmKernel_with_selection<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_pairs, number_of_comutations, number_of_keys, corpus_keys);
+                break;
+            case APPROXIMATE_EUCLIDEAN:
+                printf("[GPU] Approximate Euclidean algorithm\n");
+                approximateEuclideanKernel_with_selection<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_pairs, number_of_comutations, number_of_keys, corpus_keys);
+                break;
+            case DIVSTEPS:
+                printf("[GPU] Divsteps algorithm\n");
+                divstepsKernel_with_selection<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_pairs, number_of_comutations, number_of_keys, corpus_keys);
+                break;
+            case KARY:
+                printf("[GPU] k-ary algorithm\n");
+                karyKernel_with_selection<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_pairs, number_of_comutations, number_of_keys, corpus_keys);
+                break;
+            case HYBRID:
+                printf("[GPU] Hybrid algorithm\n");
+                hybridKernel_with_selection<<<((number_of_comutations + thread_per_block -1)/thread_per_block), thread_per_block>>>(device_U_BN_A, device_U_BN_B, device_pairs, number_of_comutations, number_of_keys, corpus_keys);
                 break;
             default:
                 printf("[GPU] Unknown GCD algorithm\n");
@@ -280,91 +1312,226 @@ int main(int argc, char* argv[]){
             return 1;
         }
 
-        cudaStatus = cudaMemcpy(A, device_U_BN_A, number_of_comutations*sizeof(U_BN), cudaMemcpyDeviceToHost);
-        cudaStatus = cudaMemcpy(B, device_U_BN_B, number_of_comutations*sizeof(U_BN), cudaMemcpyDeviceToHost);
-        cudaStatus = cudaMemcpy(C, device_U_BN_C, number_of_comutations*sizeof(U_BN), cudaMemcpyDeviceToHost);
-
-
-        unsigned *array_A;
-        unsigned *array_B;
-        unsigned *array_C;
-
-        for(i = 0; i < number_of_comutations; ++i) {
-            array_A = (unsigned*)malloc(L*sizeof(unsigned));
-            cudaMemcpy(array_A, A[i].d, L*sizeof(unsigned), cudaMemcpyDeviceToHost);
-            A[i].d = array_A;
-            array_B = (unsigned*)malloc(L*sizeof(unsigned));
-            cudaMemcpy(array_B, B[i].d, L*sizeof(unsigned), cudaMemcpyDeviceToHost);
-            B[i].d = array_B;
-            array_C = (unsigned*)malloc(L*sizeof(unsigned));
-            cudaMemcpy(array_C, C[i].d, L*sizeof(unsigned), cudaMemcpyDeviceToHost);
-            C[i].d = array_C;
-
-        }
-
-        cudaStatus = cudaGetLastError();
-        if (cudaStatus != cudaSuccess) {
-            fprintf(stderr, "\n testKernel launch failed: %s\n", cudaGetErrorString(cudaStatus));
+        /**
+    		Copy back only the non-trivial results
+    	*/
+        if (!weak_pairs_from_device(gpu_pairs, device_pairs)) {
+            fprintf(stderr, "\n Cannot copy weak pairs from device memory\n");
+            weak_pairs_device_free(device_pairs);
+            weak_pairs_free(gpu_pairs);
             return 1;
         }
-
-        sum=0;
-        for (k = 0; k < number_of_comutations; k++){
-            if( strcmp( "1", cu_bn_bn2hex(&C[k]))){
-                sum += 1;
+        weak_pairs_device_free(device_pairs);
+        weak_pairs_sort(gpu_pairs);
+        print_weak_pairs("[GPU]", gpu_pairs, key_paths);
+        clusters = key_clusters_new(total_keys);
+        for(k=0; k<weak_pairs_size(gpu_pairs); k++){
+            i = gpu_pairs->pairs[k].i;
+            j = gpu_pairs->pairs[k].j;
+            key_clusters_add(clusters, i, j, &cu_PEMs[i], &cu_PEMs[j], &gpu_pairs->pairs[k].gcd);
+            if(report && cpu_gpu==GPU){
+                report_writer_finding(report, key_paths[i], key_paths[j], &cu_PEMs[i], &cu_PEMs[j], &gpu_pairs->pairs[k].gcd);
+                cu_bn_pool_reset();
             }
         }
-        printf("[GPU] Weak keys: %d\n", sum);
+        key_clusters_summary(clusters, "[GPU]", key_paths, (cpu_gpu==GPU) ? clusters_report : NULL);
+        blacklist_new += blacklist_factored_keys(blacklist, clusters);
+        key_clusters_free(clusters);
+        weak_pairs_free(gpu_pairs);
     }
 
-    sum=0;
     /**
 		Select algorithm passed as command line argument
 	*/
     if(cpu_gpu==CPU || cpu_gpu==BOTH){
+        gcdFunction gcd;
+        WEAK_PAIRS_STAGE stage;
+        CPU_SCAN scan;
+        const U_BN *r;
+        unsigned skipped = 0;
+
+        gcd = select_gcd(gcd_kind);
+        if(!gcd){
+            printf("[CPU] Unknown GCD algorithm");
+        }
+
+        cpu_pairs = weak_pairs_new(MIN(number_of_comutations, WEAK_PAIRS_DEFAULT_SIZE), L);
+        weak_pairs_stage_init(&stage, cpu_pairs);
+        clusters = key_clusters_new(total_keys);
+        scan.stage = &stage;
+        scan.report = report;
+        scan.clusters = clusters;
+        scan.key_paths = key_paths;
+        scan.keys = cu_PEMs;
+        scan.number_of_keys = number_of_keys;
+        scan.total_keys = total_keys;
+        scan.bipartite = (corpus_directory != NULL);
+        scan.factored = (unsigned*)malloc(total_keys*sizeof(unsigned));
+        scan.propagated = (char*)calloc(total_keys, sizeof(char));
+        scan.trial_divisions = 0;
         clock_t start = clock();
-        switch(gcd_kind){
-            case EUCLIDEAN:
-                for(i=0, k=0; i<number_of_keys; i++){
-                    for(j=(i+1); j<number_of_keys; j++, k++){
-                        if( strcmp( "1", cu_bn_bn2hex(cu_dev_classic_euclid(&A[k], &B[k])))){
-                            sum+=1;
-                        }
+
+        /**
+            Blacklisted keys start factored, their pairs are replaced by
+            trial division. Product trees cover every pair of a key at
+            once, so with --product the keys are only flagged above
+        */
+        for(i=0; gcd && blacklist_factors && !product && i<total_keys; i++){
+            if(cu_bn_is_one(&blacklist_factors[i]) || !cu_bn_ucmp(&blacklist_factors[i], &cu_PEMs[i])){
+                continue;
+            }
+            r = &blacklist_factors[i];
+            if(key_clusters_factor(clusters, i, &cu_PEMs[i], r)){
+                propagate_factors(&scan, i, 0, 0);
+            }
+            cu_bn_pool_reset();
+        }
+
+        /**
+            Reduce product of corpus modulo each key, then descend the
+            corpus tree only for keys sharing a factor with it
+        */
+        if(gcd && product && corpus_directory && spill_directory){
+            printf("[CPU] Product of corpus modulo each key, trees spilled to %s\n", spill_directory);
+            spill_product_scan(&scan, gcd, L, spill_directory, spill_memory);
+            gcd = NULL;
+        }
+        if(gcd && product && corpus_directory){
+            PRODUCT_TREE *keys_tree, *corpus_tree;
+            U_BN *remainders;
+            unsigned *leaves, found, m;
+
+            printf("[CPU] Product of corpus modulo each key\n");
+            clock_t product_start = clock();
+            keys_tree = product_tree_new_sparse(cu_PEMs, number_of_keys, sparse);
+            corpus_tree = product_tree_new_sparse(&cu_PEMs[number_of_keys], corpus_keys, sparse);
+            remainders = (U_BN*)malloc(number_of_keys*sizeof(U_BN));
+            leaves = (unsigned*)malloc(corpus_keys*sizeof(unsigned));
+            for(i=0; i<number_of_keys; i++){
+                remainders[i].d = (unsigned*)malloc(L*sizeof(unsigned));
+                remainders[i].top = 1;
+            }
+            if(keys_tree && corpus_tree && reduce_product(keys_tree, product_tree_root(corpus_tree), remainders, remainder_tree, L)){
+                for(i=0; i<number_of_keys; i++){
+                    if(!cu_bn_is_zero(&remainders[i]) && cu_bn_is_one(gcd(cu_bn_pool_dup(&cu_PEMs[i]), cu_bn_pool_dup(&remainders[i])))){
+                        cu_bn_pool_reset();
+                        continue;
                     }
-                }
-                break;
-            case BINARY_EUCLIDEAN:
-                for(i=0, k=0; i<number_of_keys; i++){
-                    for(j=(i+1); j<number_of_keys; j++, k++){
-                        if( strcmp( "1", cu_bn_bn2hex(cu_dev_binary_gcd(&A[k], &B[k])))){
-                            sum+=1;
+                    cu_bn_pool_reset();
+                    found = product_tree_find(corpus_tree, &cu_PEMs[i], gcd, leaves, corpus_keys);
+                    cu_bn_pool_reset();
+                    for(m=0; m<found; m++){
+                        j = number_of_keys + leaves[m];
+                        r = gcd(cu_bn_pool_dup(&cu_PEMs[i]), cu_bn_pool_dup(&cu_PEMs[j]));
+                        if(!cu_bn_is_one(r)){
+                            record_weak_pair(&scan, i, j, r);
                         }
+                        cu_bn_pool_reset();
                     }
                 }
-                break;
-            case FAST_BINARY_EUCLIDEAN:
-                for(i=0, k=0; i<number_of_keys; i++){
-                    for(j=(i+1); j<number_of_keys; j++, k++){
-                        if( strcmp( "1", cu_bn_bn2hex(cu_dev_fast_binary_euclid(&A[k], &B[k])))){
-                            sum+=1;
-                        }
-                    }
+                printf("[CPU] Product trees: stored every %d of %d and %d levels, memory in bytes: %zu, time in ms: %f\n",
+                    sparse, keys_tree->levels, corpus_tree->levels, product_tree_bytes(keys_tree) + product_tree_bytes(corpus_tree),
+                    (double)(clock() - product_start) * 1000.0 / CLOCKS_PER_SEC);
+            } else {
+                printf("[CPU] Cannot build product trees\n");
+            }
+            for(i=0; i<number_of_keys; i++){
+                free(remainders[i].d);
+            }
+            free(remainders);
+            free(leaves);
+            product_tree_free(keys_tree);
+            product_tree_free(corpus_tree);
+            gcd = NULL;
+        }
+
+        /**
+            Batch GCD of the keys among themselves, then pairwise GCDs
+            only between keys it flagged
+        */
+        if(gcd && product && spill_directory){
+            printf("[CPU] Batch GCD of keys, tree spilled to %s\n", spill_directory);
+            spill_batch_scan(&scan, gcd, spill_directory, spill_memory);
+            gcd = NULL;
+        }
+        if(gcd && product){
+            PRODUCT_TREE *keys_tree;
+            char *flagged;
+            unsigned flagged_keys = 0, tested;
+
+            printf("[CPU] Batch GCD of keys\n");
+            clock_t product_start = clock();
+            keys_tree = product_tree_new_sparse(cu_PEMs, number_of_keys, sparse);
+            flagged = (char*)calloc(number_of_keys, sizeof(char));
+            if(keys_tree && flagged && batch_product(keys_tree, gcd, flagged, remainder_tree)){
+                for(i=0; i<number_of_keys; i++){
+                    flagged_keys += flagged[i];
                 }
-                break;
-            default:
-                printf("[CPU] Unknown GCD algorithm");
-                break;
+                tested = resolve_flagged_pairs(&scan, gcd, flagged);
+                printf("[CPU] Batch GCD flagged %u of %u keys, pairwise GCDs of flagged keys: %u, time in ms: %f\n",
+                    flagged_keys, number_of_keys, tested, (double)(clock() - product_start) * 1000.0 / CLOCKS_PER_SEC);
+                printf("[CPU] Product tree: stored every %d of %d levels, memory in bytes: %zu\n",
+                    sparse, keys_tree->levels, product_tree_bytes(keys_tree));
+            } else {
+                printf("[CPU] Cannot build product tree\n");
+            }
+            free(flagged);
+            product_tree_free(keys_tree);
+            gcd = NULL;
         }
+
+        /**
+            One GCD per block of keys, pairs of a block are tested only
+            if the block product shares a factor with the key
+        */
+        if(gcd && block > 1){
+            printf("[CPU] Block products of %u keys\n", block);
+            block_product_scan(&scan, gcd, block, L, &skipped);
+            gcd = NULL;
+        }
+
+        for(i=0; gcd && i<number_of_keys; i++){
+            for(j=(corpus_directory ? number_of_keys : i+1); j<total_keys; j++){
+                skipped += !scan_pair(&scan, gcd, i, j);
+            }
+        }
+        weak_pairs_stage_free(&stage);
         clock_t stop = clock();
         double elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
         printf("[CPU] Time elapsed in ms: %f\n", elapsed);
-        printf("[CPU] Weak keys: %d\n", sum);
+        weak_pairs_sort(cpu_pairs);
+        print_weak_pairs("[CPU]", cpu_pairs, key_paths);
+        printf("[CPU] Pairs replaced by trial division: %u (%u divisions)\n", skipped, scan.trial_divisions);
+        key_clusters_summary(clusters, "[CPU]", key_paths, clusters_report);
+        blacklist_new += blacklist_factored_keys(blacklist, clusters);
+        key_clusters_free(clusters);
+        free(scan.factored);
+        free(scan.propagated);
+        weak_pairs_free(cpu_pairs);
     } 
 
 
+    if(report){
+        printf("Findings reported: %u\n", report_writer_close(report));
+    }
+    if(clusters_report){
+        report_writer_close(clusters_report);
+    }
+    if(blacklist){
+        printf("Blacklist primes: %u (%u new)\n", blacklist->count, blacklist_new);
+        if(blacklist_new && !prime_blacklist_save(blacklist)){
+            printf("Cannot save blacklist\n");
+        }
+        prime_blacklist_free(blacklist);
+    }
+    for(i=0; blacklist_factors && i<total_keys; i++){
+        free(blacklist_factors[i].d);
+    }
+    free(blacklist_factors);
+
     free(A);
     free(B);
-    free(C);
     free(cu_PEMs);
+    cu_bn_pool_release();
     return (0);
 }
\ No newline at end of file
@@ -0,0 +1,276 @@
+/** @file ntt_mul.cu
+ *  @brief Number theoretic transform multiplication
+ *
+ *	Three prime NTT convolution of word arrays with CRT recombination.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ntt_mul.h"
+
+/* c 2^k + 1 with k >= NTT_MUL_MAX_LOG, ascending, with primitive roots */
+static const unsigned ntt_primes[NTT_MUL_PRIMES][2] = {
+    {469762049u, 3},
+    {998244353u, 3},
+    {2013265921u, 31}
+};
+
+typedef struct {
+    NTT_PRIME      q;
+    const unsigned *a;
+    int            na;
+    const unsigned *b;
+    int            nb;
+    int            log;
+    unsigned       *out;
+} NTT_JOB;
+
+static void ntt_prime_init(NTT_PRIME *q, unsigned p, unsigned g){
+
+    unsigned inv = p;
+    unsigned long long r;
+    int i;
+
+    /* Newton iteration doubles the correct low bits of p^-1 mod 2^32 */
+    for (i = 0; i < 5; i++)
+        inv *= 2 - p * inv;
+    q->p = p;
+    q->g = g;
+    q->pinv = 0 - inv;
+    r = (1ULL << 32) % p;
+    q->r2 = (unsigned)((r * r) % p);
+
+}
+
+static unsigned ntt_mont(unsigned a, unsigned b, const NTT_PRIME *q){
+
+    unsigned long long t = (unsigned long long)a * b;
+    unsigned m = (unsigned)t * q->pinv;
+    unsigned long long u = (t + (unsigned long long)m * q->p) >> 32;
+
+    return ((u >= q->p) ? (unsigned)(u - q->p) : (unsigned)u);
+
+}
+
+static unsigned ntt_add(unsigned a, unsigned b, unsigned p){
+
+    unsigned s = a + b;
+
+    return ((s >= p) ? s - p : s);
+
+}
+
+static unsigned ntt_sub(unsigned a, unsigned b, unsigned p){
+
+    return ((a >= b) ? a - b : a + p - b);
+
+}
+
+static unsigned ntt_pow(unsigned x, unsigned e, const NTT_PRIME *q){
+
+    unsigned r = ntt_mont(1, q->r2, q);
+
+    /* x and the result in Montgomery form */
+    while (e) {
+        if (e & 1)
+            r = ntt_mont(r, x, q);
+        x = ntt_mont(x, x, q);
+        e >>= 1;
+    }
+    return (r);
+
+}
+
+static void ntt_twiddles(unsigned *tw, int n, int inverse, const NTT_PRIME *q){
+
+    unsigned g = ntt_mont(q->g, q->r2, q), w;
+    int len, j;
+
+    /* roots of order 2 len at tw + len, one table for every level */
+    for (len = 1; len < n; len <<= 1) {
+        w = ntt_pow(g, inverse ? (q->p - 1) - (q->p - 1) / (2 * len) : (q->p - 1) / (2 * len), q);
+        tw[len] = ntt_mont(1, q->r2, q);
+        for (j = 1; j < len; j++)
+            tw[len + j] = ntt_mont(tw[len + j - 1], w, q);
+    }
+
+}
+
+static void ntt_forward(unsigned *f, int n, const unsigned *tw, const NTT_PRIME *q){
+
+    unsigned u, v;
+    int len, i, j;
+
+    /* decimation in frequency, natural order in, bit reversed order out */
+    for (len = n >> 1; len >= 1; len >>= 1) {
+        for (i = 0; i < n; i += 2 * len) {
+            for (j = 0; j < len; j++) {
+                u = f[i + j];
+                v = f[i + j + len];
+                f[i + j] = ntt_add(u, v, q->p);
+                f[i + j + len] = ntt_mont(ntt_sub(u, v, q->p), tw[len + j], q);
+            }
+        }
+        /* halves are finished depth first once the top level is done, while they fit in cache */
+        if (len == (n >> 1) && n > NTT_MUL_BLOCK) {
+            ntt_forward(f, len, tw, q);
+            ntt_forward(f + len, len, tw, q);
+            return;
+        }
+    }
+
+}
+
+static void ntt_inverse(unsigned *f, int n, const unsigned *tw, const NTT_PRIME *q){
+
+    unsigned u, v;
+    int len, i, j;
+
+    /* decimation in time with inverse roots, bit reversed order in, natural order out */
+    if (n > NTT_MUL_BLOCK) {
+        ntt_inverse(f, n >> 1, tw, q);
+        ntt_inverse(f + (n >> 1), n >> 1, tw, q);
+    }
+    for (len = (n > NTT_MUL_BLOCK) ? n >> 1 : 1; len < n; len <<= 1) {
+        for (i = 0; i < n; i += 2 * len) {
+            for (j = 0; j < len; j++) {
+                u = f[i + j];
+                v = ntt_mont(f[i + j + len], tw[len + j], q);
+                f[i + j] = ntt_add(u, v, q->p);
+                f[i + j + len] = ntt_sub(u, v, q->p);
+            }
+        }
+    }
+
+}
+
+static void ntt_load(unsigned *f, int n, const unsigned *a, int na, const NTT_PRIME *q){
+
+    int i;
+
+    for (i = 0; i < na; i++)
+        f[i] = ntt_mont(a[i] % q->p, q->r2, q);
+    memset(f + na, 0, (n - na) * sizeof(unsigned));
+
+}
+
+static void *ntt_job_run(void *arg){
+
+    NTT_JOB *job = (NTT_JOB *)arg;
+    const NTT_PRIME *q = &job->q;
+    unsigned *f, *g = NULL, *tw, scale;
+    int n = 1 << job->log, i;
+
+    f = (unsigned *)malloc(n * sizeof(unsigned));
+    tw = (unsigned *)malloc((n + 1) * sizeof(unsigned));
+    if (job->a != job->b || job->na != job->nb)
+        g = (unsigned *)malloc(n * sizeof(unsigned));
+    if (NULL == f || NULL == tw || (NULL == g && (job->a != job->b || job->na != job->nb))) {
+        free(f);
+        free(g);
+        free(tw);
+        return (NULL);
+    }
+
+    ntt_twiddles(tw, n, 0, q);
+    ntt_load(f, n, job->a, job->na, q);
+    ntt_forward(f, n, tw, q);
+    if (NULL == g) {
+        for (i = 0; i < n; i++)
+            f[i] = ntt_mont(f[i], f[i], q);
+    } else {
+        ntt_load(g, n, job->b, job->nb, q);
+        ntt_forward(g, n, tw, q);
+        for (i = 0; i < n; i++)
+            f[i] = ntt_mont(f[i], g[i], q);
+        free(g);
+    }
+    ntt_twiddles(tw, n, 1, q);
+    ntt_inverse(f, n, tw, q);
+
+    /* 1 / n in plain form takes the coefficients out of Montgomery form */
+    scale = ntt_mont(ntt_pow(ntt_mont(n % q->p, q->r2, q), q->p - 2, q), 1, q);
+    for (i = 0; i < n; i++)
+        f[i] = ntt_mont(f[i], scale, q);
+    free(tw);
+    job->out = f;
+    return (NULL);
+
+}
+
+static void ntt_crt(unsigned *r, int words, NTT_JOB *job){
+
+    const NTT_PRIME *q2 = &job[1].q, *q3 = &job[2].q;
+    unsigned long long p12, x12, lo, sum, m0, m1, carry = 0;
+    unsigned inv12, p1_3, inv123, carry_hi = 0, r1, t, v;
+    int k;
+
+    /* Garner: x = r1 + p1 t + p1 p2 v, constants in Montgomery form */
+    p12 = (unsigned long long)job[0].q.p * q2->p;
+    inv12 = ntt_pow(ntt_mont(job[0].q.p % q2->p, q2->r2, q2), q2->p - 2, q2);
+    p1_3 = ntt_mont(job[0].q.p % q3->p, q3->r2, q3);
+    inv123 = ntt_pow(ntt_mont((unsigned)(p12 % q3->p), q3->r2, q3), q3->p - 2, q3);
+
+    for (k = 0; k < words; k++) {
+        r1 = job[0].out[k];
+        t = ntt_mont(ntt_sub(job[1].out[k], r1, q2->p), inv12, q2);
+        x12 = r1 + (unsigned long long)job[0].q.p * t;
+        v = ntt_mont(ntt_sub(job[2].out[k], ntt_add(r1, ntt_mont(t, p1_3, q3), q3->p), q3->p), inv123, q3);
+
+        /* coefficient of up to 90 bits added to the running carry */
+        m0 = (p12 & 0xffffffffULL) * v;
+        m1 = (p12 >> 32) * v;
+        lo = x12 + m0;
+        sum = lo + (m1 << 32);
+        carry_hi += (unsigned)(m1 >> 32) + (sum < lo);
+        lo = carry + sum;
+        carry_hi += (lo < sum);
+        r[k] = (unsigned)lo;
+        carry = (lo >> 32) | ((unsigned long long)carry_hi << 32);
+        carry_hi = 0;
+    }
+    /* the product has one word more than its convolution */
+    r[words] = (unsigned)carry;
+
+}
+
+int cu_bn_mul_ntt(unsigned *r, const unsigned *a, int na, const unsigned *b, int nb){
+
+    NTT_JOB job[NTT_MUL_PRIMES];
+    pthread_t thread[NTT_MUL_PRIMES];
+    int started[NTT_MUL_PRIMES], log = 0, i, ret = 1;
+
+    if (na <= 0 || nb <= 0 || na + nb > NTT_MUL_MAX_WORDS)
+        return 0;
+    while ((1 << log) < na + nb - 1)
+        log++;
+
+    /* one thread per prime, a prime whose thread cannot start runs here */
+    for (i = 0; i < NTT_MUL_PRIMES; i++) {
+        ntt_prime_init(&job[i].q, ntt_primes[i][0], ntt_primes[i][1]);
+        job[i].a = a;
+        job[i].na = na;
+        job[i].b = b;
+        job[i].nb = nb;
+        job[i].log = log;
+        job[i].out = NULL;
+        started[i] = (0 == pthread_create(&thread[i], NULL, ntt_job_run, &job[i]));
+    }
+    for (i = 0; i < NTT_MUL_PRIMES; i++) {
+        if (started[i])
+            pthread_join(thread[i], NULL);
+        else
+            ntt_job_run(&job[i]);
+        if (NULL == job[i].out)
+            ret = 0;
+    }
+
+    if (ret)
+        ntt_crt(r, na + nb - 1, job);
+    for (i = 0; i < NTT_MUL_PRIMES; i++)
+        free(job[i].out);
+    return (ret);
+
+}
@@ -0,0 +1,52 @@
+/** @file ntt_mul.h
+ *  @brief Number theoretic transform multiplication
+ *
+ *	Multiplies word arrays of millions of words by convolution of their
+ *	32 bit words. The convolution is computed with number theoretic
+ *	transforms modulo three primes below 2^31, each in its own thread,
+ *	and its coefficients, below 2^87, are recovered by the Chinese
+ *	remainder theorem. Arithmetic modulo the primes uses Montgomery
+ *	multiplication, so no division is left in the transforms.
+ *
+ *	The transform length is limited by the primes of the form c 2^k + 1
+ *	to NTT_MUL_MAX_WORDS words of product.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef NTT_MUL_H
+#define NTT_MUL_H
+
+#include <pthread.h>
+
+#define NTT_MUL_PRIMES    3
+#define NTT_MUL_MAX_LOG   23
+#define NTT_MUL_MAX_WORDS (1 << NTT_MUL_MAX_LOG)
+#define NTT_MUL_BLOCK     4096
+
+struct   __NTT_PRIME__{
+    unsigned p;
+    unsigned g;
+    unsigned pinv;
+    unsigned r2;
+};
+
+typedef struct __NTT_PRIME__     NTT_PRIME;
+
+
+/** @brief Multiplies word arrays with number theoretic transforms
+ *
+ *	Places a * b in na + nb words of r, r must not alias a or b. If
+ *	a and b are the same array of equal length only one transform
+ *	per prime is computed before the pointwise squaring.
+ *
+ *  @param[out] r unsigned integer array product
+ *  @param[in] a unsigned integer array multiplicand
+ *  @param na words of a
+ *  @param[in] b unsigned integer array multiplier
+ *  @param nb words of b
+ *  @return 1 on success, 0 if out of memory or na + nb exceeds NTT_MUL_MAX_WORDS
+ */
+int cu_bn_mul_ntt(unsigned *r, const unsigned *a, int na, const unsigned *b, int nb);
+
+#endif /* NTT_MUL_H */
@@ -0,0 +1,173 @@
+/** @file prime_blacklist.cu
+ *  @brief Blacklist of known weak primes
+ *
+ *	Persistent store of recovered primes and screening of moduli
+ *	against their product.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include "prime_blacklist.h"
+
+#define PRIME_BLACKLIST_LINE 4096
+
+PRIME_BLACKLIST *prime_blacklist_load(const char *path){
+
+    PRIME_BLACKLIST *bl;
+    FILE *f;
+    char line[PRIME_BLACKLIST_LINE];
+    U_BN *p;
+
+    if(NULL == path)
+        return (NULL);
+
+    if ((bl = (PRIME_BLACKLIST *)calloc(1, sizeof(*bl))) == NULL)
+        return (NULL);
+    if ((bl->path = strdup(path)) == NULL) {
+        free(bl);
+        return (NULL);
+    }
+
+    if ((f = fopen(path, "r")) == NULL)
+        return (bl);
+    p = cu_bn_new();
+    while (NULL != p && NULL != fgets(line, sizeof(line), f)) {
+        if (cu_bn_hex2bn(p, line) && !cu_bn_is_zero(p) && !cu_bn_is_one(p))
+            prime_blacklist_add(bl, p);
+    }
+    cu_bn_free(p);
+    fclose(f);
+    bl->loaded = bl->count;
+    return (bl);
+
+}
+
+void prime_blacklist_free(PRIME_BLACKLIST *bl){
+
+    unsigned k;
+
+    if (bl == NULL)
+        return;
+    for (k = 0; k < bl->count; k++)
+        free(bl->primes[k].d);
+    free(bl->primes);
+    product_tree_free(bl->tree);
+    free(bl->path);
+    free(bl);
+
+}
+
+int prime_blacklist_add(PRIME_BLACKLIST *bl, const U_BN *p){
+
+    U_BN *primes;
+    unsigned k, capacity;
+
+    if(NULL == bl || NULL == p)
+        return 0;
+
+    for (k = 0; k < bl->count; k++)
+        if (!cu_bn_ucmp(&bl->primes[k], p))
+            return 0;
+
+    if (bl->count == bl->capacity) {
+        capacity = bl->capacity ? 2 * bl->capacity : 64;
+        if ((primes = (U_BN *)realloc(bl->primes, capacity * sizeof(U_BN))) == NULL)
+            return 0;
+        bl->primes = primes;
+        bl->capacity = capacity;
+    }
+    if ((bl->primes[bl->count].d = (unsigned *)malloc(p->top * sizeof(unsigned))) == NULL)
+        return 0;
+    memcpy(bl->primes[bl->count].d, p->d, p->top * sizeof(unsigned));
+    bl->primes[bl->count].top = p->top;
+    bl->count++;
+
+    /* product tree is rebuilt by the next screen */
+    product_tree_free(bl->tree);
+    bl->tree = NULL;
+    return (1);
+
+}
+
+int prime_blacklist_save(const PRIME_BLACKLIST *bl){
+
+    FILE *f;
+    char *tmp_path;
+    unsigned k;
+    int ret = 1;
+
+    if(NULL == bl)
+        return 0;
+
+    if (asprintf(&tmp_path, "%s.tmp", bl->path) < 0)
+        return 0;
+    if ((f = fopen(tmp_path, "w")) == NULL) {
+        fprintf(stderr,"Cannot write blacklist \"%s\".\n", tmp_path);
+        free(tmp_path);
+        return 0;
+    }
+    for (k = 0; ret && k < bl->count; k++) {
+        ret = (fprintf(f, "%s\n", cu_bn_bn2hex(&bl->primes[k])) > 0);
+        cu_bn_pool_reset();
+    }
+    ret &= (0 == fclose(f));
+    ret = ret && (0 == rename(tmp_path, bl->path));
+    if (!ret)
+        remove(tmp_path);
+    free(tmp_path);
+    return (ret);
+
+}
+
+unsigned prime_blacklist_screen(PRIME_BLACKLIST *bl, const U_BN *keys, unsigned n, U_BN *(*gcd)(U_BN *, U_BN *), U_BN *factors){
+
+    PRODUCT_TREE *keys_tree;
+    const U_BN *g;
+    unsigned k, flagged = 0;
+
+    if(NULL == bl || NULL == keys || NULL == gcd || NULL == factors || 0 == n)
+        return 0;
+
+    for (k = 0; k < n; k++)
+        cu_bn_set_word(&factors[k], 1);
+    if (0 == bl->count)
+        return 0;
+
+    if (NULL == bl->tree && (bl->tree = product_tree_new(bl->primes, bl->count)) == NULL)
+        return 0;
+    if ((keys_tree = product_tree_new(keys, n)) == NULL)
+        return 0;
+
+    /* factors[k] holds product of primes mod n_k before gcd replaces it */
+    if (product_tree_remainders(keys_tree, product_tree_root(bl->tree), factors)) {
+        for (k = 0; k < n; k++) {
+            g = cu_bn_is_zero(&factors[k]) ? &keys[k] : gcd(cu_bn_pool_dup(&keys[k]), cu_bn_pool_dup(&factors[k]));
+            memcpy(factors[k].d, g->d, g->top * sizeof(unsigned));
+            factors[k].top = g->top;
+            if (!cu_bn_is_one(&factors[k]))
+                flagged++;
+            cu_bn_pool_reset();
+        }
+    } else {
+        for (k = 0; k < n; k++)
+            cu_bn_set_word(&factors[k], 1);
+    }
+    product_tree_free(keys_tree);
+    return (flagged);
+
+}
+
+const U_BN *prime_blacklist_find(PRIME_BLACKLIST *bl, const U_BN *n, U_BN *(*gcd)(U_BN *, U_BN *)){
+
+    unsigned leaf;
+
+    if(NULL == bl || NULL == n || NULL == gcd || 0 == bl->count)
+        return (NULL);
+
+    if (NULL == bl->tree && (bl->tree = product_tree_new(bl->primes, bl->count)) == NULL)
+        return (NULL);
+    if (0 == product_tree_find(bl->tree, n, gcd, &leaf, 1))
+        return (NULL);
+    return (&bl->primes[leaf]);
+
+}
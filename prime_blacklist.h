@@ -0,0 +1,96 @@
+/** @file prime_blacklist.h
+ *  @brief Blacklist of known weak primes
+ *
+ *	Persistent store of every recovered prime. Incoming moduli are
+ *	screened against the whole set at once: the product of all primes
+ *	is reduced modulo every modulus through a remainder tree, and a
+ *	modulus is blacklisted if it shares a factor with that product.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef PRIME_BLACKLIST_H
+#define PRIME_BLACKLIST_H
+
+#include "product_tree.h"
+
+struct   __PRIME_BLACKLIST__{
+    char*          path;
+    unsigned       count;
+    unsigned       capacity;
+    unsigned       loaded;
+    U_BN*          primes;
+    PRODUCT_TREE*  tree;
+};
+
+typedef struct __PRIME_BLACKLIST__     PRIME_BLACKLIST;
+
+
+/** @brief Loads blacklist of known weak primes
+ *
+ *	Reads one hexadecimal prime per line. A missing file gives an
+ *	empty blacklist that is created on save.
+ *
+ *  @param[in] path blacklist file path
+ *  @return PRIME_BLACKLIST or NULL on failure
+ */
+PRIME_BLACKLIST *prime_blacklist_load(const char *path);
+
+/** @brief Frees blacklist
+ *
+ *	Frees all primes and the product tree of the blacklist.
+ *
+ *  @param[in] bl PRIME_BLACKLIST structure
+ *  @return Void
+ */
+void prime_blacklist_free(PRIME_BLACKLIST *bl);
+
+/** @brief Adds a recovered prime to the blacklist
+ *
+ *	Appends p unless it is already known.
+ *
+ *  @param[in,out] bl PRIME_BLACKLIST structure
+ *  @param[in] p U_BN recovered prime
+ *  @return 1 if p was added, 0 if it was known or on failure
+ */
+int prime_blacklist_add(PRIME_BLACKLIST *bl, const U_BN *p);
+
+/** @brief Saves blacklist
+ *
+ *	Writes all primes to the blacklist file, replacing it only once
+ *	the new file is complete.
+ *
+ *  @param[in] bl PRIME_BLACKLIST structure
+ *  @return 1 on success
+ */
+int prime_blacklist_save(const PRIME_BLACKLIST *bl);
+
+/** @brief Screens moduli against the blacklist
+ *
+ *	Reduces the product of all primes modulo every modulus and
+ *	places gcd(n_i, product mod n_i) in factors[i], which is one for
+ *	keys sharing no prime with the blacklist. factors[i] must have
+ *	room for the words of keys[i].
+ *
+ *  @param[in,out] bl PRIME_BLACKLIST structure
+ *  @param[in] keys array of moduli
+ *  @param[in] n number of moduli
+ *  @param[in] gcd GCD algorithm
+ *  @param[out] factors array of n shared factors
+ *  @return number of blacklisted moduli
+ */
+unsigned prime_blacklist_screen(PRIME_BLACKLIST *bl, const U_BN *keys, unsigned n, U_BN *(*gcd)(U_BN *, U_BN *), U_BN *factors);
+
+/** @brief Finds a blacklisted prime dividing n
+ *
+ *	Descends the product tree of the blacklist towards a prime
+ *	sharing a factor with n.
+ *
+ *  @param[in,out] bl PRIME_BLACKLIST structure
+ *  @param[in] n U_BN modulus
+ *  @param[in] gcd GCD algorithm
+ *  @return blacklisted prime dividing n, or NULL if there is none
+ */
+const U_BN *prime_blacklist_find(PRIME_BLACKLIST *bl, const U_BN *n, U_BN *(*gcd)(U_BN *, U_BN *));
+
+#endif /* PRIME_BLACKLIST_H */
@@ -0,0 +1,771 @@
+/** @file product_tree.cu
+ *  @brief Product and remainder trees
+ *
+ *	Product tree of moduli, remainder tree descent and search
+ *	for leaves sharing a factor.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include "product_tree.h"
+
+static int product_tree_node_alloc(U_BN *r, int words){
+
+    if ((r->d = (unsigned *)calloc(words ? words : 1, sizeof(unsigned))) == NULL)
+        return 0;
+    r->top = 1;
+    return (1);
+
+}
+
+static void product_tree_level_free(U_BN *level, unsigned count){
+
+    unsigned k;
+
+    if (level == NULL)
+        return;
+    for (k = 0; k < count; k++)
+        free(level[k].d);
+    free(level);
+
+}
+
+static U_BN *product_tree_level_alloc(const PRODUCT_TREE *t, int l){
+
+    U_BN *level;
+    unsigned k;
+
+    if ((level = (U_BN *)calloc(t->count[l], sizeof(U_BN))) == NULL)
+        return (NULL);
+    for (k = 0; k < t->count[l]; k++) {
+        if (!product_tree_node_alloc(&level[k], t->nodes[l][k].top)) {
+            product_tree_level_free(level, t->count[l]);
+            return (NULL);
+        }
+    }
+    return (level);
+
+}
+
+static int product_tree_stored(const PRODUCT_TREE *t, int l, int every){
+
+    return (l == 0 || l == t->levels - 1 || l % every == 0);
+
+}
+
+static PRODUCT_TREE *product_tree_build(const U_BN *keys, unsigned n, int every){
+
+    PRODUCT_TREE *t;
+    U_BN *a, *b, *r;
+    unsigned count, k;
+    int l;
+
+    if(NULL == keys || 0 == n)
+        return (NULL);
+
+    if ((t = (PRODUCT_TREE *)calloc(1, sizeof(*t))) == NULL)
+        return (NULL);
+    t->n = n;
+    for (count = n, t->levels = 1; count > 1; count = (count + 1) / 2)
+        t->levels++;
+    t->count = (unsigned *)calloc(t->levels, sizeof(unsigned));
+    t->nodes = (U_BN **)calloc(t->levels, sizeof(U_BN *));
+    if (NULL == t->count || NULL == t->nodes) {
+        product_tree_free(t);
+        return (NULL);
+    }
+
+    t->count[0] = n;
+    if ((t->nodes[0] = (U_BN *)calloc(n, sizeof(U_BN))) == NULL) {
+        product_tree_free(t);
+        return (NULL);
+    }
+    for (k = 0; k < n; k++) {
+        if (!product_tree_node_alloc(&t->nodes[0][k], keys[k].top)) {
+            product_tree_free(t);
+            return (NULL);
+        }
+        memcpy(t->nodes[0][k].d, keys[k].d, keys[k].top * sizeof(unsigned));
+        t->nodes[0][k].top = keys[k].top;
+        cu_bn_correct_top(&t->nodes[0][k]);
+    }
+
+    for (l = 1; l < t->levels; l++) {
+        t->count[l] = (t->count[l - 1] + 1) / 2;
+        if ((t->nodes[l] = (U_BN *)calloc(t->count[l], sizeof(U_BN))) == NULL) {
+            product_tree_free(t);
+            return (NULL);
+        }
+        for (k = 0; k < t->count[l]; k++) {
+            a = &t->nodes[l - 1][2 * k];
+            b = (2 * k + 1 < t->count[l - 1]) ? &t->nodes[l - 1][2 * k + 1] : NULL;
+            r = &t->nodes[l][k];
+            if (!product_tree_node_alloc(r, a->top + (b ? b->top : 0))) {
+                product_tree_free(t);
+                return (NULL);
+            }
+            /* odd node is carried up unchanged */
+            if (NULL == b) {
+                memcpy(r->d, a->d, a->top * sizeof(unsigned));
+                r->top = a->top;
+            } else if (!cu_bn_mul(r, a, b)) {
+                product_tree_free(t);
+                return (NULL);
+            }
+        }
+        /* levels between stored ones are needed only to build the next level */
+        if (!product_tree_stored(t, l - 1, every)) {
+            product_tree_level_free(t->nodes[l - 1], t->count[l - 1]);
+            t->nodes[l - 1] = NULL;
+        }
+    }
+    return (t);
+
+}
+
+PRODUCT_TREE *product_tree_new(const U_BN *keys, unsigned n){
+
+    return (product_tree_build(keys, n, 1));
+
+}
+
+PRODUCT_TREE *product_tree_new_sparse(const U_BN *keys, unsigned n, int every){
+
+    if (every < 1)
+        return (NULL);
+    return (product_tree_build(keys, n, every));
+
+}
+
+static int product_tree_is_sparse(const PRODUCT_TREE *t){
+
+    int l;
+
+    for (l = 0; l < t->levels; l++) {
+        if (NULL == t->nodes[l])
+            return (1);
+    }
+    return 0;
+
+}
+
+static int product_tree_node(const PRODUCT_TREE *t, int l, unsigned k, U_BN *r, int *owned){
+
+    U_BN a, b;
+    int owned_a, owned_b, ret;
+
+    if (NULL != t->nodes[l]) {
+        *r = t->nodes[l][k];
+        *owned = 0;
+        return (1);
+    }
+
+    /* node of a dropped level is recomputed from the stored level below */
+    if (!product_tree_node(t, l - 1, 2 * k, &a, &owned_a))
+        return 0;
+    if (2 * k + 1 >= t->count[l - 1]) {
+        *r = a;
+        *owned = owned_a;
+        return (1);
+    }
+    if (!product_tree_node(t, l - 1, 2 * k + 1, &b, &owned_b)) {
+        if (owned_a)
+            free(a.d);
+        return 0;
+    }
+    ret = product_tree_node_alloc(r, a.top + b.top);
+    if (ret && !cu_bn_mul(r, &a, &b)) {
+        free(r->d);
+        ret = 0;
+    }
+    if (owned_a)
+        free(a.d);
+    if (owned_b)
+        free(b.d);
+    *owned = 1;
+    return (ret);
+
+}
+
+static int product_tree_descend(const PRODUCT_TREE *t, int l, unsigned k, const U_BN *x, U_BN *r){
+
+    U_BN node, rem;
+    int owned, ret;
+
+    if (!product_tree_node(t, l, k, &node, &owned))
+        return 0;
+    if (l == 0)
+        return (cu_bn_div(NULL, &r[k], x, &node));
+
+    ret = product_tree_node_alloc(&rem, node.top) && cu_bn_div(NULL, &rem, x, &node);
+    if (owned)
+        free(node.d);
+    /* depth first, only one path of remainders and recomputed nodes is alive */
+    ret = ret && product_tree_descend(t, l - 1, 2 * k, &rem, r)
+        && (2 * k + 1 >= t->count[l - 1] || product_tree_descend(t, l - 1, 2 * k + 1, &rem, r));
+    free(rem.d);
+    return (ret);
+
+}
+
+static int product_tree_words(U_BN *r, const U_BN *a, int from, int to){
+
+    int k;
+
+    /* r = floor(a / B^from) mod B^(to - from) */
+    if (!product_tree_node_alloc(r, to - from))
+        return 0;
+    for (k = from; k < to && k < a->top; k++)
+        r->d[k - from] = a->d[k];
+    r->top = to - from;
+    cu_bn_correct_top(r);
+    if (r->top == 0)
+        r->top = 1;
+    return (1);
+
+}
+
+static int product_tree_scale(U_BN *y, const U_BN *parent_y, int parent_words, const U_BN *sibling, int words){
+
+    U_BN z;
+    int ret;
+
+    /* {x / child} = {x / parent * sibling}, truncated to the precision of child */
+    if (!product_tree_node_alloc(&z, parent_y->top + sibling->top))
+        return 0;
+    ret = cu_bn_mul(&z, parent_y, sibling) && product_tree_words(y, &z, parent_words - words, parent_words);
+    free(z.d);
+    return (ret);
+
+}
+
+static int product_tree_scaled_leaf(U_BN *r, const U_BN *y, int words, const U_BN *leaf){
+
+    U_BN z;
+    unsigned carry;
+    int k, size;
+
+    /* x mod leaf = round(leaf * {x / leaf}) */
+    size = ((y->top + leaf->top > words) ? y->top + leaf->top : words) + 1;
+    if (!product_tree_node_alloc(&z, size))
+        return 0;
+    if (!cu_bn_mul(&z, y, leaf)) {
+        free(z.d);
+        return 0;
+    }
+    carry = 1U << (CU_BN_BITS2 - 1);
+    for (k = words - 1; carry && k < size; k++) {
+        z.d[k] += carry;
+        carry = (z.d[k] < carry);
+    }
+    /* rounded product is at most leaf, it fits in the words of leaf */
+    for (k = 0; k < leaf->top; k++)
+        r->d[k] = (words + k < size) ? z.d[words + k] : 0;
+    r->top = leaf->top;
+    cu_bn_correct_top(r);
+    if (r->top == 0 || !cu_bn_ucmp(r, leaf))
+        cu_bn_set_word(r, 0);
+    free(z.d);
+    return (1);
+
+}
+
+static int product_tree_scaled_descend(const PRODUCT_TREE *t, int l, unsigned k, const U_BN *y, int words, U_BN *r){
+
+    U_BN left, right, y_left, y_right;
+    int owned_left, owned_right, left_words, right_words, ret;
+
+    if (l == 0)
+        return (product_tree_scaled_leaf(&r[k], y, words, &t->nodes[0][k]));
+    /* odd node is carried up unchanged, so is its fraction */
+    if (2 * k + 1 >= t->count[l - 1])
+        return (product_tree_scaled_descend(t, l - 1, 2 * k, y, words, r));
+
+    if (!product_tree_node(t, l - 1, 2 * k, &left, &owned_left))
+        return 0;
+    if (!product_tree_node(t, l - 1, 2 * k + 1, &right, &owned_right)) {
+        if (owned_left)
+            free(left.d);
+        return 0;
+    }
+    left_words = left.top + PRODUCT_TREE_GUARD_WORDS;
+    right_words = right.top + PRODUCT_TREE_GUARD_WORDS;
+    y_left.d = y_right.d = NULL;
+    ret = product_tree_scale(&y_left, y, words, &right, left_words)
+        && product_tree_scale(&y_right, y, words, &left, right_words);
+    if (owned_left)
+        free(left.d);
+    if (owned_right)
+        free(right.d);
+    ret = ret && product_tree_scaled_descend(t, l - 1, 2 * k, &y_left, left_words, r)
+        && product_tree_scaled_descend(t, l - 1, 2 * k + 1, &y_right, right_words, r);
+    free(y_left.d);
+    free(y_right.d);
+    return (ret);
+
+}
+
+int product_tree_scaled_remainders(const PRODUCT_TREE *t, const U_BN *x, U_BN *r){
+
+    const U_BN *root;
+    U_BN shifted, q, y;
+    int words, ret;
+
+    if(NULL == t || NULL == x || NULL == r)
+        return 0;
+
+    /* the only division: {x / root} to the precision of root */
+    root = product_tree_root(t);
+    words = root->top + PRODUCT_TREE_GUARD_WORDS;
+    if (!product_tree_node_alloc(&shifted, x->top + words))
+        return 0;
+    memcpy(shifted.d + words, x->d, x->top * sizeof(unsigned));
+    shifted.top = x->top + words;
+    if (!product_tree_node_alloc(&q, shifted.top)) {
+        free(shifted.d);
+        return 0;
+    }
+    y.d = NULL;
+    ret = cu_bn_div(&q, NULL, &shifted, root) && product_tree_words(&y, &q, 0, words);
+    free(shifted.d);
+    free(q.d);
+    ret = ret && product_tree_scaled_descend(t, t->levels - 1, 0, &y, words, r);
+    free(y.d);
+    return (ret);
+
+}
+
+size_t product_tree_bytes(const PRODUCT_TREE *t){
+
+    size_t bytes = 0;
+    unsigned k;
+    int l;
+
+    if (t == NULL)
+        return 0;
+    for (l = 0; l < t->levels; l++) {
+        for (k = 0; NULL != t->nodes[l] && k < t->count[l]; k++)
+            bytes += t->nodes[l][k].top * sizeof(unsigned);
+    }
+    return (bytes);
+
+}
+
+void product_tree_free(PRODUCT_TREE *t){
+
+    int l;
+
+    if (t == NULL)
+        return;
+    for (l = 0; t->nodes != NULL && l < t->levels; l++)
+        product_tree_level_free(t->nodes[l], t->count[l]);
+    free(t->nodes);
+    free(t->count);
+    free(t);
+
+}
+
+const U_BN *product_tree_root(const PRODUCT_TREE *t){
+
+    if (t == NULL)
+        return (NULL);
+    return (&t->nodes[t->levels - 1][0]);
+
+}
+
+int product_tree_remainders(const PRODUCT_TREE *t, const U_BN *x, U_BN *r){
+
+    U_BN *upper, *lower;
+    unsigned k;
+    int l, ret = 1;
+
+    if(NULL == t || NULL == x || NULL == r)
+        return 0;
+
+    if (t->levels == 1)
+        return (cu_bn_div(NULL, &r[0], x, &t->nodes[0][0]));
+    if (product_tree_is_sparse(t))
+        return (product_tree_descend(t, t->levels - 1, 0, x, r));
+
+    if ((upper = product_tree_level_alloc(t, t->levels - 1)) == NULL)
+        return 0;
+    ret = cu_bn_div(NULL, &upper[0], x, &t->nodes[t->levels - 1][0]);
+
+    /* x mod node equals (x mod parent) mod node, every step works on parent size */
+    for (l = t->levels - 2; ret && l >= 0; l--) {
+        lower = (l == 0) ? r : product_tree_level_alloc(t, l);
+        if (lower == NULL) {
+            ret = 0;
+            break;
+        }
+        for (k = 0; ret && k < t->count[l]; k++)
+            ret = cu_bn_div(NULL, &lower[k], &upper[k / 2], &t->nodes[l][k]);
+        product_tree_level_free(upper, t->count[l + 1]);
+        upper = lower;
+    }
+    if (upper != r)
+        product_tree_level_free(upper, (l >= 0) ? t->count[l + 1] : t->count[0]);
+    return (ret);
+
+}
+
+unsigned product_tree_find(const PRODUCT_TREE *t, const U_BN *a, U_BN *(*gcd)(U_BN *, U_BN *), unsigned *leaves, unsigned capacity){
+
+    unsigned *stack, found = 0, k;
+    int *stack_level, top = 0, l;
+    U_BN rem, node;
+    int shared, owned;
+
+    if(NULL == t || NULL == a || NULL == gcd)
+        return 0;
+
+    /* depth first, every level holds at most two pending siblings */
+    stack = (unsigned *)malloc(2 * (t->levels + 1) * sizeof(unsigned));
+    stack_level = (int *)malloc(2 * (t->levels + 1) * sizeof(int));
+    if (NULL == stack || NULL == stack_level || !product_tree_node_alloc(&rem, a->top)) {
+        free(stack);
+        free(stack_level);
+        return 0;
+    }
+
+    stack[top] = 0;
+    stack_level[top++] = t->levels - 1;
+    while (top) {
+        top--;
+        k = stack[top];
+        l = stack_level[top];
+        if (!product_tree_node(t, l, k, &node, &owned))
+            continue;
+        shared = cu_bn_div(NULL, &rem, &node, a);
+        if (owned)
+            free(node.d);
+        if (!shared)
+            continue;
+        shared = cu_bn_is_zero(&rem) || !cu_bn_is_one(gcd(cu_bn_pool_dup(a), cu_bn_pool_dup(&rem)));
+        if (!shared)
+            continue;
+        if (l == 0) {
+            if (found < capacity)
+                leaves[found] = k;
+            found++;
+            continue;
+        }
+        if (2 * k + 1 < t->count[l - 1]) {
+            stack[top] = 2 * k + 1;
+            stack_level[top++] = l - 1;
+        }
+        stack[top] = 2 * k;
+        stack_level[top++] = l - 1;
+    }
+
+    free(rem.d);
+    free(stack);
+    free(stack_level);
+    return (found);
+
+}
+
+static int product_tree_cofactor(const PRODUCT_TREE *t, int l, unsigned k, const U_BN *x, U_BN *(*gcd)(U_BN *, U_BN *), char *flagged){
+
+    U_BN node, square, rem, z;
+    int owned, ret;
+
+    if (!product_tree_node(t, l, k, &node, &owned))
+        return 0;
+    /* x mod node^2 keeps the product of all other leaves modulo node */
+    ret = product_tree_node_alloc(&square, 2 * node.top);
+    if (ret && !product_tree_node_alloc(&rem, 2 * node.top)) {
+        free(square.d);
+        ret = 0;
+    }
+    if (!ret) {
+        if (owned)
+            free(node.d);
+        return 0;
+    }
+    ret = cu_bn_sqr(&square, &node) && cu_bn_div(NULL, &rem, x, &square);
+    free(square.d);
+
+    if (ret && l == 0) {
+        /* P mod n^2 / n = (P / n) mod n, zero when both primes are shared */
+        ret = product_tree_node_alloc(&z, rem.top);
+        if (ret && cu_bn_div(&z, NULL, &rem, &node))
+            flagged[k] = cu_bn_is_zero(&z) || !cu_bn_is_one(gcd(cu_bn_pool_dup(&node), cu_bn_pool_dup(&z)));
+        else
+            ret = 0;
+        free(z.d);
+        cu_bn_pool_reset();
+    } else if (ret) {
+        ret = product_tree_cofactor(t, l - 1, 2 * k, &rem, gcd, flagged)
+            && (2 * k + 1 >= t->count[l - 1] || product_tree_cofactor(t, l - 1, 2 * k + 1, &rem, gcd, flagged));
+    }
+    if (owned)
+        free(node.d);
+    free(rem.d);
+    return (ret);
+
+}
+
+int product_tree_batch_gcd(const PRODUCT_TREE *t, U_BN *(*gcd)(U_BN *, U_BN *), char *flagged){
+
+    const U_BN *root;
+    int l;
+
+    if(NULL == t || NULL == gcd || NULL == flagged)
+        return 0;
+
+    memset(flagged, 0, t->n * sizeof(char));
+    if (t->levels == 1)
+        return (1);
+    root = product_tree_root(t);
+    l = t->levels - 2;
+    return (product_tree_cofactor(t, l, 0, root, gcd, flagged)
+        && (1 >= t->count[l] || product_tree_cofactor(t, l, 1, root, gcd, flagged)));
+
+}
+
+static int product_tree_scaled_cofactor(const PRODUCT_TREE *t, int l, unsigned k, const U_BN *y, int words, U_BN *(*gcd)(U_BN *, U_BN *), char *flagged){
+
+    U_BN left, right, square, y_left, y_right, z;
+    int owned_left, owned_right, left_words, right_words, ret;
+
+    if (l == 0) {
+        /* round(n * {P / n^2}) = (P / n) mod n, zero when both primes are shared */
+        if (!product_tree_node_alloc(&z, t->nodes[0][k].top))
+            return 0;
+        ret = product_tree_scaled_leaf(&z, y, words, &t->nodes[0][k]);
+        if (ret)
+            flagged[k] = cu_bn_is_zero(&z) || !cu_bn_is_one(gcd(cu_bn_pool_dup(&t->nodes[0][k]), cu_bn_pool_dup(&z)));
+        free(z.d);
+        cu_bn_pool_reset();
+        return (ret);
+    }
+    /* odd node is carried up unchanged, so is its fraction */
+    if (2 * k + 1 >= t->count[l - 1])
+        return (product_tree_scaled_cofactor(t, l - 1, 2 * k, y, words, gcd, flagged));
+
+    if (!product_tree_node(t, l - 1, 2 * k, &left, &owned_left))
+        return 0;
+    if (!product_tree_node(t, l - 1, 2 * k + 1, &right, &owned_right)) {
+        if (owned_left)
+            free(left.d);
+        return 0;
+    }
+    /* {P / child^2} = {P / parent^2 * sibling^2}, to the precision of child^2 */
+    left_words = 2 * left.top + PRODUCT_TREE_GUARD_WORDS;
+    right_words = 2 * right.top + PRODUCT_TREE_GUARD_WORDS;
+    y_left.d = y_right.d = NULL;
+    ret = product_tree_node_alloc(&square, 2 * ((left.top > right.top) ? left.top : right.top));
+    ret = ret && cu_bn_sqr(&square, &right) && product_tree_scale(&y_left, y, words, &square, left_words)
+        && cu_bn_sqr(&square, &left) && product_tree_scale(&y_right, y, words, &square, right_words);
+    if (owned_left)
+        free(left.d);
+    if (owned_right)
+        free(right.d);
+    free(square.d);
+    ret = ret && product_tree_scaled_cofactor(t, l - 1, 2 * k, &y_left, left_words, gcd, flagged)
+        && product_tree_scaled_cofactor(t, l - 1, 2 * k + 1, &y_right, right_words, gcd, flagged);
+    free(y_left.d);
+    free(y_right.d);
+    return (ret);
+
+}
+
+int product_tree_scaled_batch_gcd(const PRODUCT_TREE *t, U_BN *(*gcd)(U_BN *, U_BN *), char *flagged){
+
+    const U_BN *root;
+    U_BN one, q, y;
+    int words, ret;
+
+    if(NULL == t || NULL == gcd || NULL == flagged)
+        return 0;
+
+    memset(flagged, 0, t->n * sizeof(char));
+    if (t->levels == 1)
+        return (1);
+
+    /* the only division: {P / P^2} = 1 / P to the precision of the root squared */
+    root = product_tree_root(t);
+    words = 2 * root->top + PRODUCT_TREE_GUARD_WORDS;
+    if (!product_tree_node_alloc(&one, words + 1))
+        return 0;
+    one.d[words] = 1;
+    one.top = words + 1;
+    if (!product_tree_node_alloc(&q, one.top)) {
+        free(one.d);
+        return 0;
+    }
+    y.d = NULL;
+    ret = cu_bn_div(&q, NULL, &one, root) && product_tree_words(&y, &q, 0, words);
+    free(one.d);
+    free(q.d);
+    ret = ret && product_tree_scaled_cofactor(t, t->levels - 1, 0, &y, words, gcd, flagged);
+    free(y.d);
+    return (ret);
+
+}
+
+static void product_tree_shell_free(PRODUCT_TREE *t){
+
+    int l;
+
+    /* frees the tree but not the nodes, which were moved to another tree */
+    for (l = 0; t->nodes != NULL && l < t->levels; l++)
+        free(t->nodes[l]);
+    free(t->nodes);
+    free(t->count);
+    free(t);
+
+}
+
+PRODUCT_TREE *product_tree_merge(PRODUCT_TREE *a, PRODUCT_TREE *b){
+
+    PRODUCT_TREE *t;
+    int l;
+
+    if(NULL == a || NULL == b || a->n != b->n || (a->n & (a->n - 1)) || product_tree_is_sparse(a) || product_tree_is_sparse(b))
+        return (NULL);
+
+    /* with a power of two leaves every level of a pairs up evenly */
+    if ((t = (PRODUCT_TREE *)calloc(1, sizeof(*t))) == NULL)
+        return (NULL);
+    t->n = a->n + b->n;
+    t->levels = a->levels + 1;
+    t->count = (unsigned *)calloc(t->levels, sizeof(unsigned));
+    t->nodes = (U_BN **)calloc(t->levels, sizeof(U_BN *));
+    if (NULL == t->count || NULL == t->nodes) {
+        product_tree_shell_free(t);
+        return (NULL);
+    }
+    for (l = 0; l < a->levels; l++) {
+        t->count[l] = a->count[l] + b->count[l];
+        if ((t->nodes[l] = (U_BN *)malloc(t->count[l] * sizeof(U_BN))) == NULL) {
+            product_tree_shell_free(t);
+            return (NULL);
+        }
+        memcpy(t->nodes[l], a->nodes[l], a->count[l] * sizeof(U_BN));
+        memcpy(t->nodes[l] + a->count[l], b->nodes[l], b->count[l] * sizeof(U_BN));
+    }
+    t->count[l] = 1;
+    if ((t->nodes[l] = (U_BN *)calloc(1, sizeof(U_BN))) == NULL
+        || !product_tree_node_alloc(t->nodes[l], product_tree_root(a)->top + product_tree_root(b)->top)) {
+        product_tree_shell_free(t);
+        return (NULL);
+    }
+    if (!cu_bn_mul(t->nodes[l], product_tree_root(a), product_tree_root(b))) {
+        free(t->nodes[l]->d);
+        product_tree_shell_free(t);
+        return (NULL);
+    }
+    product_tree_shell_free(a);
+    product_tree_shell_free(b);
+    return (t);
+
+}
+
+unsigned product_tree_query(const PRODUCT_TREE *t, const U_BN *a, U_BN *(*gcd)(U_BN *, U_BN *), U_BN *factor, unsigned *leaves, unsigned capacity){
+
+    const U_BN *g;
+
+    if(NULL == t || NULL == a || NULL == gcd || NULL == factor || cu_bn_is_zero(a))
+        return 0;
+
+    /* one reduction of the root answers coprime keys, the common case */
+    if (!cu_bn_div(NULL, factor, product_tree_root(t), a))
+        return 0;
+    g = cu_bn_is_zero(factor) ? a : gcd(cu_bn_pool_dup(a), cu_bn_pool_dup(factor));
+    memcpy(factor->d, g->d, g->top * sizeof(unsigned));
+    factor->top = g->top;
+    if (cu_bn_is_one(factor))
+        return 0;
+    return (product_tree_find(t, a, gcd, leaves, capacity));
+
+}
+
+int product_tree_save(const PRODUCT_TREE *t, const char *path){
+
+    FILE *f;
+    unsigned header[3], k;
+    int l, ret = 1;
+
+    if(NULL == t || NULL == path || product_tree_is_sparse(t))
+        return 0;
+
+    if ((f = fopen(path, "wb")) == NULL) {
+        fprintf(stderr,"Cannot write product tree \"%s\".\n", path);
+        return 0;
+    }
+    header[0] = PRODUCT_TREE_MAGIC;
+    header[1] = t->n;
+    header[2] = t->levels;
+    ret = (fwrite(header, sizeof(unsigned), 3, f) == 3);
+    for (l = 0; ret && l < t->levels; l++) {
+        for (k = 0; ret && k < t->count[l]; k++) {
+            ret = (fwrite(&t->nodes[l][k].top, sizeof(int), 1, f) == 1)
+                && (fwrite(t->nodes[l][k].d, sizeof(unsigned), t->nodes[l][k].top, f) == (size_t)t->nodes[l][k].top);
+        }
+    }
+    if (fclose(f))
+        ret = 0;
+    return (ret);
+
+}
+
+static int product_tree_read(PRODUCT_TREE *t, FILE *f){
+
+    unsigned k;
+    int l, top;
+
+    t->count = (unsigned *)calloc(t->levels, sizeof(unsigned));
+    t->nodes = (U_BN **)calloc(t->levels, sizeof(U_BN *));
+    if (NULL == t->count || NULL == t->nodes)
+        return 0;
+
+    for (l = 0; l < t->levels; l++) {
+        t->count[l] = l ? (t->count[l - 1] + 1) / 2 : t->n;
+        if ((t->nodes[l] = (U_BN *)calloc(t->count[l], sizeof(U_BN))) == NULL)
+            return 0;
+        for (k = 0; k < t->count[l]; k++) {
+            if (fread(&top, sizeof(int), 1, f) != 1 || top <= 0 || !product_tree_node_alloc(&t->nodes[l][k], top))
+                return 0;
+            if (fread(t->nodes[l][k].d, sizeof(unsigned), top, f) != (size_t)top)
+                return 0;
+            t->nodes[l][k].top = top;
+        }
+    }
+    /* a truncated or foreign file must not pass as a tree */
+    return (t->count[t->levels - 1] == 1 && fgetc(f) == EOF);
+
+}
+
+PRODUCT_TREE *product_tree_load(const char *path){
+
+    PRODUCT_TREE *t;
+    FILE *f;
+    unsigned header[3];
+
+    if(NULL == path)
+        return (NULL);
+
+    if ((f = fopen(path, "rb")) == NULL) {
+        fprintf(stderr,"Cannot read product tree \"%s\".\n", path);
+        return (NULL);
+    }
+    if (fread(header, sizeof(unsigned), 3, f) != 3 || header[0] != PRODUCT_TREE_MAGIC || 0 == header[1] || 0 == header[2]
+        || (t = (PRODUCT_TREE *)calloc(1, sizeof(*t))) == NULL) {
+        fprintf(stderr,"Corrupted product tree \"%s\".\n", path);
+        fclose(f);
+        return (NULL);
+    }
+    t->n = header[1];
+    t->levels = header[2];
+    if (!product_tree_read(t, f)) {
+        fprintf(stderr,"Corrupted product tree \"%s\".\n", path);
+        fclose(f);
+        product_tree_free(t);
+        return (NULL);
+    }
+    fclose(f);
+    return (t);
+
+}
@@ -0,0 +1,206 @@
+/** @file product_tree.h
+ *  @brief Product and remainder trees
+ *
+ *	Binary tree of products of moduli. Leaves are the moduli, every
+ *	node is the product of its children and the root is the product
+ *	of all moduli. Reducing a number down the tree gives its remainder
+ *	modulo every leaf for the cost of a few full-size divisions.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef PRODUCT_TREE_H
+#define PRODUCT_TREE_H
+
+#include "cuda_bignum.h"
+
+#define PRODUCT_TREE_MAGIC 0x31525450
+#define PRODUCT_TREE_GUARD_WORDS 1
+
+struct   __PRODUCT_TREE__{
+    unsigned   n;
+    int        levels;
+    unsigned*  count;
+    U_BN**     nodes;
+};
+
+typedef struct __PRODUCT_TREE__     PRODUCT_TREE;
+
+
+/** @brief Builds product tree of n moduli
+ *
+ *	Copies moduli into leaves and multiplies pairs of nodes level
+ *	by level up to the root.
+ *
+ *  @param[in] keys array of moduli
+ *  @param[in] n number of moduli
+ *  @return PRODUCT_TREE or NULL on failure
+ */
+PRODUCT_TREE *product_tree_new(const U_BN *keys, unsigned n);
+
+/** @brief Builds product tree storing only every k-th level
+ *
+ *	Builds the tree like product_tree_new() but keeps only leaves, the
+ *	root and levels divisible by every. Nodes of dropped levels are
+ *	recomputed from the stored level below when they are needed, which
+ *	trades time for about every times less memory. Sparse trees
+ *	cannot be saved or merged.
+ *
+ *  @param[in] keys array of moduli
+ *  @param[in] n number of moduli
+ *  @param[in] every distance between stored levels
+ *  @return PRODUCT_TREE or NULL on failure
+ */
+PRODUCT_TREE *product_tree_new_sparse(const U_BN *keys, unsigned n, int every);
+
+/** @brief Frees product tree
+ *
+ *	Frees all nodes of the tree.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @return Void
+ */
+void product_tree_free(PRODUCT_TREE *t);
+
+/** @brief Returns root of product tree
+ *
+ *	Returns the product of all moduli.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @return U_BN product of all leaves
+ */
+const U_BN *product_tree_root(const PRODUCT_TREE *t);
+
+/** @brief Returns memory of stored nodes
+ *
+ *	Returns size of all stored nodes in bytes.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @return bytes of stored nodes
+ */
+size_t product_tree_bytes(const PRODUCT_TREE *t);
+
+/** @brief Reduces x modulo every leaf
+ *
+ *	Reduces x modulo the root and then modulo every node down to the
+ *	leaves, level by level, or depth first in a sparse tree.
+ *	r[i] must have room for the words of leaf i.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @param[in] x U_BN to reduce
+ *  @param[out] r array of t->n remainders
+ *  @return 1 on success
+ */
+int product_tree_remainders(const PRODUCT_TREE *t, const U_BN *x, U_BN *r);
+
+/** @brief Reduces x modulo every leaf with a scaled remainder tree
+ *
+ *	Computes the fraction {x / root} with one division and propagates
+ *	{x / node} = {x / parent * sibling} down the tree with
+ *	multiplications only. Every fraction keeps the words of its node
+ *	plus PRODUCT_TREE_GUARD_WORDS, enough for the truncation errors
+ *	of all levels, and x mod leaf is the rounded leaf * {x / leaf}.
+ *	r[i] must have room for the words of leaf i.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @param[in] x U_BN to reduce
+ *  @param[out] r array of t->n remainders
+ *  @return 1 on success
+ */
+int product_tree_scaled_remainders(const PRODUCT_TREE *t, const U_BN *x, U_BN *r);
+
+/** @brief Finds leaves sharing a factor with a
+ *
+ *	Descends from the root into every subtree whose product is not
+ *	coprime to a, so only paths to matching leaves are visited.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @param[in] a U_BN modulus
+ *  @param[in] gcd GCD algorithm
+ *  @param[out] leaves indices of leaves sharing a factor with a
+ *  @param[in] capacity size of leaves
+ *  @return number of matching leaves, may exceed capacity
+ */
+unsigned product_tree_find(const PRODUCT_TREE *t, const U_BN *a, U_BN *(*gcd)(U_BN *, U_BN *), unsigned *leaves, unsigned capacity);
+
+/** @brief Flags leaves sharing a factor with any other leaf
+ *
+ *	Batch GCD: reduces the root modulo the square of every node down
+ *	to the leaves, so that for every leaf n with root P it computes
+ *	g = gcd(n, P / n mod n). flagged[i] is set when g is not one. A
+ *	flagged leaf whose g equals n shares both primes and this tells
+ *	neither the partner nor the prime, which is left to pairwise GCDs
+ *	of flagged leaves. Resets the pool of temporaries.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @param[in] gcd GCD algorithm
+ *  @param[out] flagged array of t->n flags
+ *  @return 1 on success
+ */
+int product_tree_batch_gcd(const PRODUCT_TREE *t, U_BN *(*gcd)(U_BN *, U_BN *), char *flagged);
+
+/** @brief Flags leaves sharing a factor with any other leaf using a scaled remainder tree
+ *
+ *	Batch GCD like product_tree_batch_gcd(), but computes 1 / P with
+ *	one division and propagates {P / node^2} = {P / parent^2 *
+ *	sibling^2} down the tree with multiplications only. Every fraction
+ *	keeps the words of its node squared plus PRODUCT_TREE_GUARD_WORDS
+ *	and P / n mod n is the rounded n * {P / n^2}. Resets the pool of
+ *	temporaries.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @param[in] gcd GCD algorithm
+ *  @param[out] flagged array of t->n flags
+ *  @return 1 on success
+ */
+int product_tree_scaled_batch_gcd(const PRODUCT_TREE *t, U_BN *(*gcd)(U_BN *, U_BN *), char *flagged);
+
+/** @brief Merges two product trees of equal power of two size
+ *
+ *	Concatenates levels of a and b and multiplies their roots into a
+ *	new root, so only one product is computed. Leaves of a come first.
+ *	On success a and b are consumed, on failure both are left intact.
+ *
+ *  @param[in] a PRODUCT_TREE structure with a power of two leaves
+ *  @param[in] b PRODUCT_TREE structure with as many leaves as a
+ *  @return merged PRODUCT_TREE or NULL on failure
+ */
+PRODUCT_TREE *product_tree_merge(PRODUCT_TREE *a, PRODUCT_TREE *b);
+
+/** @brief Checks modulus against all leaves
+ *
+ *	Places gcd(a, root mod a) in factor, which is one if a shares no
+ *	prime with any leaf, and only then descends the tree to name the
+ *	matching leaves. factor must have room for a->top words.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @param[in] a U_BN modulus
+ *  @param[in] gcd GCD algorithm
+ *  @param[out] factor U_BN shared factor
+ *  @param[out] leaves indices of leaves sharing a factor with a
+ *  @param[in] capacity size of leaves
+ *  @return number of matching leaves, may exceed capacity
+ */
+unsigned product_tree_query(const PRODUCT_TREE *t, const U_BN *a, U_BN *(*gcd)(U_BN *, U_BN *), U_BN *factor, unsigned *leaves, unsigned capacity);
+
+/** @brief Saves product tree to a file
+ *
+ *	Writes every level of the tree in host byte order, so the tree
+ *	is loaded without multiplying the moduli again.
+ *
+ *  @param[in] t PRODUCT_TREE structure
+ *  @param[in] path file path
+ *  @return 1 on success
+ */
+int product_tree_save(const PRODUCT_TREE *t, const char *path);
+
+/** @brief Loads product tree from a file
+ *
+ *	Reads a tree written by product_tree_save.
+ *
+ *  @param[in] path file path
+ *  @return PRODUCT_TREE or NULL on failure
+ */
+PRODUCT_TREE *product_tree_load(const char *path);
+
+#endif /* PRODUCT_TREE_H */
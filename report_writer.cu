@@ -0,0 +1,219 @@
+/** @file report_writer.cu
+ *  @brief Findings report
+ *
+ *	Streams findings to JSON lines or CSV from a background
+ *	writer thread.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include "report_writer.h"
+
+static void *report_writer_loop(void *arg){
+
+    REPORT_WRITER *w = (REPORT_WRITER *)arg;
+    char *tmp;
+    size_t size, used;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->front_used && !w->stop)
+            pthread_cond_wait(&w->ready, &w->lock);
+        if (!w->front_used && w->stop)
+            break;
+
+        /* swap buffers, producers keep appending while we write */
+        tmp = w->back;
+        size = w->back_size;
+        w->back = w->front;
+        w->back_size = w->front_size;
+        used = w->front_used;
+        w->front = tmp;
+        w->front_size = size;
+        w->front_used = 0;
+        pthread_mutex_unlock(&w->lock);
+
+        fwrite(w->back, 1, used, w->file);
+        fflush(w->file);
+
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return (NULL);
+
+}
+
+REPORT_WRITER *report_writer_open(const char *path){
+
+    REPORT_WRITER *w;
+    size_t len;
+
+    if(NULL == path)
+        return (NULL);
+
+    if ((w = (REPORT_WRITER *)calloc(1, sizeof(*w))) == NULL)
+        return (NULL);
+
+    len = strlen(path);
+    w->format = (len > 4 && !strcmp(".csv", path + len - 4)) ? REPORT_CSV : REPORT_JSONL;
+    w->front_size = REPORT_WRITER_BUFFER;
+    w->back_size = REPORT_WRITER_BUFFER;
+    w->front = (char *)malloc(w->front_size);
+    w->back = (char *)malloc(w->back_size);
+    if (NULL == w->front || NULL == w->back || (w->file = fopen(path, "w")) == NULL) {
+        fprintf(stderr,"Cannot open report \"%s\".\n", path);
+        free(w->front);
+        free(w->back);
+        free(w);
+        return (NULL);
+    }
+
+    if (w->format == REPORT_CSV)
+        fprintf(w->file, "key_a,key_b,prime,cofactor_a,cofactor_b\n");
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->ready, NULL);
+    if (pthread_create(&w->thread, NULL, report_writer_loop, w)) {
+        fclose(w->file);
+        free(w->front);
+        free(w->back);
+        free(w);
+        return (NULL);
+    }
+    return (w);
+
+}
+
+int report_writer_append(REPORT_WRITER *w, const char *text, size_t len){
+
+    char *buf;
+    size_t size;
+
+    if(NULL == w || NULL == text)
+        return 0;
+
+    pthread_mutex_lock(&w->lock);
+    if (w->front_used + len > w->front_size) {
+        size = w->front_size;
+        while (w->front_used + len > size)
+            size *= 2;
+        if ((buf = (char *)realloc(w->front, size)) == NULL) {
+            pthread_mutex_unlock(&w->lock);
+            return 0;
+        }
+        w->front = buf;
+        w->front_size = size;
+    }
+    memcpy(w->front + w->front_used, text, len);
+    w->front_used += len;
+    pthread_cond_signal(&w->ready);
+    pthread_mutex_unlock(&w->lock);
+    return (1);
+
+}
+
+int report_writer_quote(FILE *out, reportFormat format, const char *s){
+
+    const char *c;
+    int ret = 1;
+
+    if(NULL == out || NULL == s)
+        return 0;
+
+    if (format == REPORT_CSV) {
+        if (NULL == strpbrk(s, ",\"\r\n"))
+            return (fputs(s, out) >= 0);
+        /* RFC 4180: quote the field and double the quotes in it */
+        ret = (fputc('"', out) != EOF);
+        for (c = s; ret && *c; c++)
+            ret = (*c != '"' || fputc('"', out) != EOF) && fputc(*c, out) != EOF;
+        return (ret && fputc('"', out) != EOF);
+    }
+
+    ret = (fputc('"', out) != EOF);
+    for (c = s; ret && *c; c++) {
+        if (*c == '"' || *c == '\\')
+            ret = (fprintf(out, "\\%c", *c) > 0);
+        else if ((unsigned char)*c < 0x20)
+            ret = (fprintf(out, "\\u%04x", (unsigned char)*c) > 0);
+        else
+            ret = (fputc(*c, out) != EOF);
+    }
+    return (ret && fputc('"', out) != EOF);
+
+}
+
+int report_writer_finding(REPORT_WRITER *w, const char *key_a, const char *key_b, const U_BN *n_a, const U_BN *n_b, const U_BN *gcd){
+
+    BN_CTX *ctx;
+    BIGNUM *p, *a, *b, *rem;
+    char *p_hex = NULL, *a_hex = NULL, *b_hex = NULL, *line = NULL;
+    size_t len = 0;
+    FILE *out;
+    int ok, ret = 0;
+
+    if(NULL == w || NULL == key_a || NULL == key_b || NULL == n_a || NULL == n_b || NULL == gcd)
+        return 0;
+
+    ctx = cu_bn_pool_ctx();
+    BN_CTX_start(ctx);
+    p = BN_CTX_get(ctx);
+    a = BN_CTX_get(ctx);
+    b = BN_CTX_get(ctx);
+    rem = BN_CTX_get(ctx);
+
+    if (NULL != rem && u_bn2bignum(gcd, p) && u_bn2bignum(n_a, a) && u_bn2bignum(n_b, b)
+        && !BN_is_zero(p) && BN_div(a, rem, a, p, ctx) && BN_div(b, rem, b, p, ctx)) {
+        p_hex = BN_bn2hex(p);
+        a_hex = BN_bn2hex(a);
+        b_hex = BN_bn2hex(b);
+    }
+
+    /* key names are paths and may hold quotes, commas or line breaks */
+    if (NULL != p_hex && NULL != a_hex && NULL != b_hex && (out = open_memstream(&line, &len)) != NULL) {
+        if (w->format == REPORT_CSV)
+            ok = report_writer_quote(out, w->format, key_a) && fputc(',', out) != EOF
+                && report_writer_quote(out, w->format, key_b) && fprintf(out, ",%s,%s,%s\n", p_hex, a_hex, b_hex) > 0;
+        else
+            ok = fputs("{\"key_a\":", out) >= 0 && report_writer_quote(out, w->format, key_a)
+                && fputs(",\"key_b\":", out) >= 0 && report_writer_quote(out, w->format, key_b)
+                && fprintf(out, ",\"prime\":\"%s\",\"cofactor_a\":\"%s\",\"cofactor_b\":\"%s\"}\n", p_hex, a_hex, b_hex) > 0;
+        ok = (0 == fclose(out)) && ok;
+        if (ok && report_writer_append(w, line, len)) {
+            __sync_fetch_and_add(&w->findings, 1);
+            ret = 1;
+        }
+        free(line);
+    }
+
+    OPENSSL_free(p_hex);
+    OPENSSL_free(a_hex);
+    OPENSSL_free(b_hex);
+    BN_CTX_end(ctx);
+    return (ret);
+
+}
+
+unsigned report_writer_close(REPORT_WRITER *w){
+
+    unsigned findings;
+
+    if (w == NULL)
+        return 0;
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = 1;
+    pthread_cond_signal(&w->ready);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    fclose(w->file);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->ready);
+    findings = w->findings;
+    free(w->front);
+    free(w->back);
+    free(w);
+    return (findings);
+
+}
@@ -0,0 +1,105 @@
+/** @file report_writer.h
+ *  @brief Findings report
+ *
+ *	Streams every finding as a JSON line or CSV row with both keys,
+ *	the shared prime and both cofactors. Lines are buffered in memory
+ *	and written by a background thread, so compute threads never
+ *	wait for the disk.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef REPORT_WRITER_H
+#define REPORT_WRITER_H
+
+#include <pthread.h>
+#include "cuda_bignum.h"
+
+#define REPORT_WRITER_BUFFER 65536
+
+typedef enum {
+    REPORT_JSONL=0,
+    REPORT_CSV
+} reportFormat;
+
+struct   __REPORT_WRITER__{
+    FILE*           file;
+    reportFormat    format;
+    char*           front;
+    size_t          front_used;
+    size_t          front_size;
+    char*           back;
+    size_t          back_size;
+    unsigned        findings;
+    int             stop;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+};
+
+typedef struct __REPORT_WRITER__     REPORT_WRITER;
+
+
+/** @brief Opens findings report
+ *
+ *	Opens report file and starts its background writer thread.
+ *	Files ending with ".csv" are written as CSV with a header row,
+ *	any other file as JSON lines.
+ *
+ *  @param[in] path report file path
+ *  @return REPORT_WRITER or NULL on failure
+ */
+REPORT_WRITER *report_writer_open(const char *path);
+
+/** @brief Appends raw text to the report
+ *
+ *	Copies text into the in-memory buffer and wakes the writer thread.
+ *	The buffer grows instead of waiting for the disk.
+ *
+ *  @param[in,out] w REPORT_WRITER structure
+ *  @param[in] text text to append
+ *  @param[in] len length of text
+ *  @return 1 on success
+ */
+int report_writer_append(REPORT_WRITER *w, const char *text, size_t len);
+
+/** @brief Writes string as a field of the report format
+ *
+ *	Writes s as a JSON string, with quotes, backslashes and control
+ *	characters escaped, or as a CSV field, quoted with doubled quotes
+ *	if it holds a comma, quote or line break as in RFC 4180.
+ *
+ *  @param[in,out] out stream of the line being formatted
+ *  @param[in] format reportFormat of the line
+ *  @param[in] s string to write
+ *  @return 1 on success
+ */
+int report_writer_quote(FILE *out, reportFormat format, const char *s);
+
+/** @brief Reports a pair of keys sharing a factor
+ *
+ *	Formats one finding with both key names, the shared factor gcd
+ *	and the cofactors n_a/gcd and n_b/gcd. Key names are quoted by
+ *	report_writer_quote().
+ *
+ *  @param[in,out] w REPORT_WRITER structure
+ *  @param[in] key_a name or path of first key
+ *  @param[in] key_b name or path of second key
+ *  @param[in] n_a modulus of first key
+ *  @param[in] n_b modulus of second key
+ *  @param[in] gcd shared factor of both moduli
+ *  @return 1 on success
+ */
+int report_writer_finding(REPORT_WRITER *w, const char *key_a, const char *key_b, const U_BN *n_a, const U_BN *n_b, const U_BN *gcd);
+
+/** @brief Closes findings report
+ *
+ *	Writes out buffered findings, stops the writer thread and
+ *	closes the report file.
+ *
+ *  @param[in] w REPORT_WRITER structure
+ *  @return number of reported findings
+ */
+unsigned report_writer_close(REPORT_WRITER *w);
+
+#endif /* REPORT_WRITER_H */
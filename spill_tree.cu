@@ -0,0 +1,427 @@
+/** @file spill_tree.cu
+ *  @brief Out-of-core product and remainder trees
+ *
+ *	Levels of product and remainder trees streamed through files.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include <unistd.h>
+#include "spill_tree.h"
+
+typedef struct {
+    const SPILL_LEVEL* lv;
+    FILE*              f;
+    unsigned           k;
+    U_BN               buf[2];
+    int                words[2];
+    int                which;
+} SPILL_CURSOR;
+
+typedef struct {
+    SPILL_LEVEL* lv;
+    FILE*        f;
+} SPILL_SINK;
+
+static size_t spill_node_bytes(const U_BN *a){
+
+    return (sizeof(int) + a->top * sizeof(unsigned));
+
+}
+
+static void spill_tree_touch(SPILL_TREE *t, size_t transient){
+
+    if (t->resident + transient > t->peak)
+        t->peak = t->resident + transient;
+
+}
+
+static int spill_cursor_open(SPILL_CURSOR *c, const SPILL_LEVEL *lv){
+
+    memset(c, 0, sizeof(*c));
+    c->lv = lv;
+    if (NULL != lv->nodes)
+        return (1);
+    if ((c->f = fopen(lv->path, "rb")) == NULL) {
+        fprintf(stderr,"Cannot read tree level \"%s\".\n", lv->path);
+        return 0;
+    }
+    setvbuf(c->f, NULL, _IOFBF, SPILL_TREE_IO_BUFFER);
+    return (1);
+
+}
+
+static const U_BN *spill_cursor_next(SPILL_CURSOR *c){
+
+    unsigned *d;
+    U_BN *b;
+    int top;
+
+    if (c->k >= c->lv->count)
+        return (NULL);
+    if (NULL != c->lv->nodes)
+        return (&c->lv->nodes[c->k++]);
+
+    /* two buffers, so the previous node stays valid while the next one is read */
+    if (fread(&top, sizeof(int), 1, c->f) != 1 || top <= 0)
+        return (NULL);
+    b = &c->buf[c->which];
+    if (top > c->words[c->which]) {
+        if ((d = (unsigned *)realloc(b->d, top * sizeof(unsigned))) == NULL)
+            return (NULL);
+        b->d = d;
+        c->words[c->which] = top;
+    }
+    if (fread(b->d, sizeof(unsigned), top, c->f) != (size_t)top)
+        return (NULL);
+    b->top = top;
+    c->which ^= 1;
+    c->k++;
+    return (b);
+
+}
+
+static void spill_cursor_close(SPILL_CURSOR *c){
+
+    if (NULL != c->f)
+        fclose(c->f);
+    free(c->buf[0].d);
+    free(c->buf[1].d);
+
+}
+
+static int spill_sink_open(SPILL_TREE *t, SPILL_SINK *s, SPILL_LEVEL *lv, size_t estimate){
+
+    s->lv = lv;
+    s->f = NULL;
+    lv->bytes = 0;
+    if (t->resident + estimate <= t->memory) {
+        lv->nodes = (U_BN *)calloc(lv->count, sizeof(U_BN));
+        return (NULL != lv->nodes);
+    }
+    if ((s->f = fopen(lv->path, "wb")) == NULL) {
+        fprintf(stderr,"Cannot write tree level \"%s\".\n", lv->path);
+        return 0;
+    }
+    setvbuf(s->f, NULL, _IOFBF, SPILL_TREE_IO_BUFFER);
+    return (1);
+
+}
+
+static int spill_sink_put(SPILL_TREE *t, SPILL_SINK *s, unsigned k, const U_BN *a){
+
+    U_BN *r;
+
+    s->lv->bytes += spill_node_bytes(a);
+    if (NULL == s->f) {
+        r = &s->lv->nodes[k];
+        if ((r->d = (unsigned *)malloc(a->top * sizeof(unsigned))) == NULL)
+            return 0;
+        memcpy(r->d, a->d, a->top * sizeof(unsigned));
+        r->top = a->top;
+        t->resident += spill_node_bytes(a);
+        return (1);
+    }
+    return (fwrite(&a->top, sizeof(int), 1, s->f) == 1
+        && fwrite(a->d, sizeof(unsigned), a->top, s->f) == (size_t)a->top);
+
+}
+
+static int spill_sink_close(SPILL_SINK *s){
+
+    if (NULL == s->f)
+        return (1);
+    return (0 == fclose(s->f));
+
+}
+
+static void spill_level_release(SPILL_TREE *t, SPILL_LEVEL *lv){
+
+    unsigned k;
+
+    if (NULL != lv->nodes) {
+        for (k = 0; k < lv->count; k++)
+            free(lv->nodes[k].d);
+        free(lv->nodes);
+        lv->nodes = NULL;
+        t->resident -= lv->bytes;
+    } else if (NULL != lv->path) {
+        unlink(lv->path);
+    }
+    lv->bytes = 0;
+
+}
+
+static int spill_tree_level(SPILL_TREE *t, int l){
+
+    SPILL_CURSOR below;
+    SPILL_SINK sink;
+    const U_BN *a, *b;
+    U_BN r;
+    unsigned k;
+    int ret;
+
+    if (!spill_cursor_open(&below, &t->level[l - 1]))
+        return 0;
+    ret = spill_sink_open(t, &sink, &t->level[l], t->level[l - 1].bytes);
+    t->spilled += (NULL != sink.f);
+    for (k = 0; ret && k < t->level[l].count; k++) {
+        a = spill_cursor_next(&below);
+        b = (2 * k + 1 < t->level[l - 1].count) ? spill_cursor_next(&below) : NULL;
+        if (NULL == a || (2 * k + 1 < t->level[l - 1].count && NULL == b)) {
+            ret = 0;
+            break;
+        }
+        /* odd node is carried up unchanged */
+        if (NULL == b) {
+            ret = spill_sink_put(t, &sink, k, a);
+            continue;
+        }
+        if ((r.d = (unsigned *)calloc(a->top + b->top, sizeof(unsigned))) == NULL) {
+            ret = 0;
+            break;
+        }
+        r.top = 1;
+        spill_tree_touch(t, spill_node_bytes(a) + spill_node_bytes(b) + (a->top + b->top) * sizeof(unsigned));
+        ret = cu_bn_mul(&r, a, b) && spill_sink_put(t, &sink, k, &r);
+        free(r.d);
+    }
+    if (!spill_sink_close(&sink))
+        ret = 0;
+    spill_cursor_close(&below);
+    return (ret);
+
+}
+
+SPILL_TREE *spill_tree_new(const U_BN *keys, unsigned n, const char *prefix, size_t memory){
+
+    SPILL_TREE *t;
+    SPILL_CURSOR top;
+    SPILL_SINK sink;
+    const U_BN *root;
+    U_BN leaf;
+    unsigned count, k;
+    size_t estimate = 0;
+    int l, ret;
+
+    if(NULL == keys || 0 == n || NULL == prefix)
+        return (NULL);
+
+    if ((t = (SPILL_TREE *)calloc(1, sizeof(*t))) == NULL)
+        return (NULL);
+    t->n = n;
+    t->memory = memory;
+    for (count = n, t->levels = 1; count > 1; count = (count + 1) / 2)
+        t->levels++;
+    t->prefix = strdup(prefix);
+    if (NULL == t->prefix || (t->level = (SPILL_LEVEL *)calloc(t->levels, sizeof(SPILL_LEVEL))) == NULL) {
+        spill_tree_free(t);
+        return (NULL);
+    }
+    for (l = 0; l < t->levels; l++) {
+        t->level[l].count = l ? (t->level[l - 1].count + 1) / 2 : n;
+        if (asprintf(&t->level[l].path, "%s.%d", prefix, l) < 0) {
+            t->level[l].path = NULL;
+            spill_tree_free(t);
+            return (NULL);
+        }
+    }
+
+    for (k = 0; k < n; k++)
+        estimate += sizeof(int) + keys[k].top * sizeof(unsigned);
+    ret = spill_sink_open(t, &sink, &t->level[0], estimate);
+    t->spilled += (NULL != sink.f);
+    for (k = 0; ret && k < n; k++) {
+        leaf = keys[k];
+        cu_bn_correct_top(&leaf);
+        ret = (leaf.top > 0) && spill_sink_put(t, &sink, k, &leaf);
+    }
+    if (!spill_sink_close(&sink))
+        ret = 0;
+
+    for (l = 1; ret && l < t->levels; l++)
+        ret = spill_tree_level(t, l);
+
+    /* root is always needed whole, keep a resident copy */
+    if (ret)
+        ret = spill_cursor_open(&top, &t->level[t->levels - 1]);
+    if (ret) {
+        root = spill_cursor_next(&top);
+        if (NULL != root && (t->root.d = (unsigned *)malloc(root->top * sizeof(unsigned))) != NULL) {
+            memcpy(t->root.d, root->d, root->top * sizeof(unsigned));
+            t->root.top = root->top;
+        } else {
+            ret = 0;
+        }
+        spill_cursor_close(&top);
+    }
+    if (!ret) {
+        spill_tree_free(t);
+        return (NULL);
+    }
+    spill_tree_touch(t, spill_node_bytes(&t->root));
+    return (t);
+
+}
+
+void spill_tree_free(SPILL_TREE *t){
+
+    int l;
+
+    if (t == NULL)
+        return;
+    for (l = 0; t->level != NULL && l < t->levels; l++) {
+        spill_level_release(t, &t->level[l]);
+        free(t->level[l].path);
+    }
+    free(t->level);
+    free(t->root.d);
+    free(t->prefix);
+    free(t);
+
+}
+
+const U_BN *spill_tree_root(const SPILL_TREE *t){
+
+    if (t == NULL)
+        return (NULL);
+    return (&t->root);
+
+}
+
+static int spill_tree_leaf_cofactor(const U_BN *rem, const U_BN *node, U_BN *(*gcd)(U_BN *, U_BN *), char *flag){
+
+    U_BN z;
+    int ret;
+
+    /* P mod n^2 / n = (P / n) mod n, zero when both primes are shared */
+    if ((z.d = (unsigned *)calloc(rem->top, sizeof(unsigned))) == NULL)
+        return 0;
+    z.top = 1;
+    ret = cu_bn_div(&z, NULL, rem, node);
+    if (ret)
+        *flag = cu_bn_is_zero(&z) || !cu_bn_is_one(gcd(cu_bn_pool_dup(node), cu_bn_pool_dup(&z)));
+    free(z.d);
+    cu_bn_pool_reset();
+    return (ret);
+
+}
+
+static int spill_tree_reduce(SPILL_TREE *t, const U_BN *x, U_BN *r, U_BN *(*gcd)(U_BN *, U_BN *), char *flagged){
+
+    SPILL_LEVEL upper, lower;
+    SPILL_CURSOR parents, nodes;
+    SPILL_SINK sink;
+    const U_BN *parent, *node, *divisor;
+    U_BN rem, square;
+    unsigned p, c;
+    int l, ret = 1;
+
+    /* batch GCD reduces the root modulo squares of nodes, the root itself is P mod root^2 */
+    memset(&upper, 0, sizeof(upper));
+    upper.count = 1;
+    if ((rem.d = (unsigned *)calloc(t->root.top, sizeof(unsigned))) == NULL)
+        return 0;
+    rem.top = 1;
+    if (asprintf(&upper.path, "%s.r%d", t->prefix, t->levels - 1) < 0) {
+        free(rem.d);
+        return 0;
+    }
+    ret = (NULL != gcd || cu_bn_div(NULL, &rem, x, &t->root)) && spill_sink_open(t, &sink, &upper, spill_node_bytes(&t->root));
+    if (ret) {
+        ret = spill_sink_put(t, &sink, 0, (NULL != gcd) ? &t->root : &rem);
+        ret = spill_sink_close(&sink) && ret;
+    }
+    free(rem.d);
+
+    /* parents and children are both consumed in leaf order, every read is sequential */
+    for (l = t->levels - 2; ret && l >= 0; l--) {
+        memset(&lower, 0, sizeof(lower));
+        memset(&parents, 0, sizeof(parents));
+        memset(&nodes, 0, sizeof(nodes));
+        sink.f = NULL;
+        lower.count = t->level[l].count;
+        if (l > 0 && asprintf(&lower.path, "%s.r%d", t->prefix, l) < 0) {
+            lower.path = NULL;
+            ret = 0;
+            break;
+        }
+        ret = spill_cursor_open(&parents, &upper) && spill_cursor_open(&nodes, &t->level[l]);
+        if (ret && l > 0)
+            ret = spill_sink_open(t, &sink, &lower, (NULL != gcd) ? 2 * t->level[l].bytes : t->level[l].bytes);
+        for (p = 0; ret && p < upper.count; p++) {
+            if ((parent = spill_cursor_next(&parents)) == NULL) {
+                ret = 0;
+                break;
+            }
+            for (c = 2 * p; ret && c < 2 * p + 2 && c < lower.count; c++) {
+                if ((node = spill_cursor_next(&nodes)) == NULL) {
+                    ret = 0;
+                    break;
+                }
+                if (l == 0 && NULL == gcd) {
+                    ret = cu_bn_div(NULL, &r[c], parent, node);
+                    continue;
+                }
+                square.d = NULL;
+                divisor = node;
+                if (NULL != gcd) {
+                    if ((square.d = (unsigned *)calloc(2 * node->top, sizeof(unsigned))) == NULL) {
+                        ret = 0;
+                        break;
+                    }
+                    ret = cu_bn_sqr(&square, node);
+                    divisor = &square;
+                }
+                if (!ret || (rem.d = (unsigned *)calloc(divisor->top, sizeof(unsigned))) == NULL) {
+                    free(square.d);
+                    ret = 0;
+                    break;
+                }
+                rem.top = 1;
+                spill_tree_touch(t, spill_node_bytes(parent) + spill_node_bytes(node) + ((divisor == node) ? 1 : 2) * spill_node_bytes(divisor));
+                ret = cu_bn_div(NULL, &rem, parent, divisor);
+                if (ret && l == 0)
+                    ret = spill_tree_leaf_cofactor(&rem, node, gcd, &flagged[c]);
+                else if (ret)
+                    ret = spill_sink_put(t, &sink, c, &rem);
+                free(rem.d);
+                free(square.d);
+            }
+        }
+        if (!spill_sink_close(&sink))
+            ret = 0;
+        spill_cursor_close(&parents);
+        spill_cursor_close(&nodes);
+        spill_level_release(t, &upper);
+        free(upper.path);
+        upper = lower;
+    }
+    spill_level_release(t, &upper);
+    free(upper.path);
+    return (ret);
+
+}
+
+int spill_tree_remainders(SPILL_TREE *t, const U_BN *x, U_BN *r){
+
+    if(NULL == t || NULL == x || NULL == r)
+        return 0;
+
+    if (t->levels == 1)
+        return (cu_bn_div(NULL, &r[0], x, &t->root));
+    return (spill_tree_reduce(t, x, r, NULL, NULL));
+
+}
+
+int spill_tree_batch_gcd(SPILL_TREE *t, U_BN *(*gcd)(U_BN *, U_BN *), char *flagged){
+
+    if(NULL == t || NULL == gcd || NULL == flagged)
+        return 0;
+
+    memset(flagged, 0, t->n * sizeof(char));
+    if (t->levels == 1)
+        return (1);
+    return (spill_tree_reduce(t, NULL, NULL, gcd, flagged));
+
+}
@@ -0,0 +1,107 @@
+/** @file spill_tree.h
+ *  @brief Out-of-core product and remainder trees
+ *
+ *	Product tree whose levels are kept in memory only while they fit
+ *	in a memory budget and are otherwise spilled to files. Every level
+ *	is built from the level below and the remainder tree is reduced
+ *	from the level above, both in leaf order, so spilled levels are
+ *	only ever read and written sequentially.
+ *
+ *	Nodes taking part in a single multiplication or division still
+ *	have to fit in memory, and so does the root.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef SPILL_TREE_H
+#define SPILL_TREE_H
+
+#include "cuda_bignum.h"
+
+#define SPILL_TREE_IO_BUFFER (1 << 20)
+
+struct   __SPILL_LEVEL__{
+    unsigned  count;
+    size_t    bytes;
+    U_BN*     nodes;
+    char*     path;
+};
+
+typedef struct __SPILL_LEVEL__     SPILL_LEVEL;
+
+struct   __SPILL_TREE__{
+    unsigned     n;
+    int          levels;
+    SPILL_LEVEL* level;
+    U_BN         root;
+    char*        prefix;
+    size_t       memory;
+    size_t       resident;
+    size_t       peak;
+    unsigned     spilled;
+};
+
+typedef struct __SPILL_TREE__     SPILL_TREE;
+
+
+/** @brief Builds product tree of n moduli within a memory budget
+ *
+ *	Builds the tree level by level. A level stays in memory if it fits
+ *	in what is left of memory bytes, otherwise it is written to the
+ *	file prefix.level.
+ *
+ *  @param[in] keys array of moduli
+ *  @param[in] n number of moduli
+ *  @param[in] prefix path prefix of level files
+ *  @param[in] memory budget for resident levels in bytes
+ *  @return SPILL_TREE or NULL on failure
+ */
+SPILL_TREE *spill_tree_new(const U_BN *keys, unsigned n, const char *prefix, size_t memory);
+
+/** @brief Frees product tree
+ *
+ *	Frees resident levels and removes level files.
+ *
+ *  @param[in] t SPILL_TREE structure
+ *  @return Void
+ */
+void spill_tree_free(SPILL_TREE *t);
+
+/** @brief Returns root of product tree
+ *
+ *	Returns the product of all moduli, which is always resident.
+ *
+ *  @param[in] t SPILL_TREE structure
+ *  @return U_BN product of all leaves
+ */
+const U_BN *spill_tree_root(const SPILL_TREE *t);
+
+/** @brief Reduces x modulo every leaf
+ *
+ *	Reduces x down the tree one level at a time, spilling levels of
+ *	remainders that do not fit in the budget to prefix.rlevel.
+ *	r[i] must have room for the words of leaf i.
+ *
+ *  @param[in,out] t SPILL_TREE structure
+ *  @param[in] x U_BN to reduce
+ *  @param[out] r array of t->n remainders
+ *  @return 1 on success
+ */
+int spill_tree_remainders(SPILL_TREE *t, const U_BN *x, U_BN *r);
+
+/** @brief Flags leaves sharing a factor with any other leaf
+ *
+ *	Batch GCD like product_tree_batch_gcd(): reduces the root modulo
+ *	the square of every node one level at a time, spilling levels of
+ *	remainders like spill_tree_remainders(), and sets flagged[i] when
+ *	gcd(n, P / n mod n) of leaf n is not one. Resets the pool of
+ *	temporaries.
+ *
+ *  @param[in,out] t SPILL_TREE structure
+ *  @param[in] gcd GCD algorithm
+ *  @param[out] flagged array of t->n flags
+ *  @return 1 on success
+ */
+int spill_tree_batch_gcd(SPILL_TREE *t, U_BN *(*gcd)(U_BN *, U_BN *), char *flagged);
+
+#endif /* SPILL_TREE_H */
@@ -8,10 +8,22 @@
 
 
 #include "test.h"
+#include "device_cuda_bignum.h"
+#include "key_clusters.h"
+#include "product_tree.h"
+#include "prime_blacklist.h"
+#include "key_daemon.h"
+#include "key_stream.h"
+#include "spill_tree.h"
+#include "ntt_mul.h"
+#include "div_mod.h"
+#include <fcntl.h>
+#include <unistd.h>
 
 void unit_test(void){
 	INFO("tests start...\n");
 	cu_bn_new_test();
+	cu_bn_pool_test();
 	Hw_test();
 	Lw_test();
 	cu_bn_mul_words_test();
@@ -33,15 +45,43 @@ void unit_test(void){
 	//cu_bn_rshift1_test();
 	//cu_bn_lshift_test();
 	cu_binary_gcd_test();
-	//bignum2u_bn_test();
+	bignum2u_bn_test();
 	get_u_bn_from_mod_PEM_test();
 	cu_fast_binary_euclid_test();
 	cu_classic_euclid_test();
 	cu_ubn_copy_test();
 	cu_ubn_uadd_test();
 	cu_ubn_add_words_test();
-	//algorithm_PM_test();
-	//q_algorithm_PM_test();
+	weak_pairs_test();
+	cu_dev_pair_index_test();
+	u_bn2bignum_test();
+	report_writer_test();
+	cu_bn_div_test();
+	key_clusters_test();
+	cu_bn_mul_test();
+	product_tree_test();
+	cu_bn_hex2bn_test();
+	prime_blacklist_test();
+	cu_bn_bin2bn_test();
+	key_daemon_handle_test();
+	product_tree_query_test();
+	key_stream_test();
+	spill_tree_test();
+	product_tree_sparse_test();
+	product_tree_scaled_test();
+	product_tree_batch_gcd_test();
+	cu_bn_mul_limbs_test();
+	cu_bn_mul_ntt_test();
+	cu_bn_divmod_limbs_test();
+	cu_dev_classic_euclid_test();
+	cu_dev_ctz_binary_gcd_test();
+	algorithm_PM_test();
+	q_algorithm_PM_test();
+	cu_dev_pm_gcd_test();
+	cu_approximate_euclid_test();
+	cu_dev_divsteps_gcd_test();
+	cu_dev_kary_gcd_test();
+	cu_dev_hybrid_gcd_test();
 	INFO("tests completed\n");
 }
 
@@ -54,6 +94,35 @@ void cu_bn_new_test(void){
 	}
 }
 
+void cu_bn_pool_test(void){
+	U_BN   *A = NULL, *B = NULL;
+	U_BN_POOL *pool = NULL;
+	size_t size;
+	unsigned i;
+	A = cu_bn_new();
+	assert(1 == cu_bn_dec2bn(A, "127443773749521740448985064835572871821497258320008925264518297348975527574330581823678917711811966132450236776705531598591537821175218567383336289986769851757919421857153566027389171"));
+	assert(1 == cu_bn_pool_init(1024));
+	pool = cu_bn_pool_get();
+	assert(NULL != cu_bn_pool_ctx());
+	B = cu_bn_pool_dup(A);
+	assert(0 == cu_bn_ucmp(A, B));
+	assert(!strcmp(cu_bn_bn2hex(A), cu_bn_bn2hex(B)));
+	cu_bn_pool_reset();
+	assert(0 == pool->used);
+	size = pool->size;
+	for(i=0; i<4*CU_BN_POOL_TEMPORARIES; i++){
+		B = cu_bn_pool_new();
+		assert(cu_bn_is_zero(B));
+	}
+	assert(NULL != pool->overflow);
+	cu_bn_pool_reset();
+	assert(NULL == pool->overflow);
+	assert(size < pool->size);
+	cu_bn_pool_release();
+	cu_bn_free(A);
+	INFO("Test passed\n");
+}
+
 void Hw_test(void){
 	assert(10 == Hw(42949672988));
 	INFO("Test passed\n");
@@ -546,3 +615,1165 @@ void algorithm_PM_test(void){
     BN_free(r);
     INFO("Test passed\n");
 }
+
+void weak_pairs_test(void){
+	WEAK_PAIRS *wp = NULL;
+	WEAK_PAIRS_STAGE stage;
+	U_BN   *A = NULL;
+	unsigned k;
+	A = cu_bn_new();
+	assert(1 == cu_bn_dec2bn(A, "1848764763497967886363755645778788"));
+	wp = weak_pairs_new(2*WEAK_PAIRS_STAGE_SIZE, A->top);
+	assert(NULL != wp);
+	assert(1 == weak_pairs_push(wp, 7, 9, A));
+	assert(1 == weak_pairs_stage_init(&stage, wp));
+	for(k=0; k<2*WEAK_PAIRS_STAGE_SIZE; k++){
+		assert(1 == weak_pairs_stage_push(&stage, 2*WEAK_PAIRS_STAGE_SIZE-k, k+1000, A));
+	}
+	weak_pairs_stage_free(&stage);
+	assert(2*WEAK_PAIRS_STAGE_SIZE == weak_pairs_size(wp));
+	assert(1 == weak_pairs_dropped(wp));
+	weak_pairs_sort(wp);
+	for(k=1; k<weak_pairs_size(wp); k++){
+		assert(wp->pairs[k-1].i <= wp->pairs[k].i);
+	}
+	assert(2 == wp->pairs[0].i);
+	assert(7 == wp->pairs[5].i);
+	assert(9 == wp->pairs[5].j);
+	assert(0 == cu_bn_ucmp(A, &wp->pairs[0].gcd));
+	assert(0 == weak_pairs_push(wp, 1, 2, A));
+	weak_pairs_free(wp);
+	cu_bn_free(A);
+	INFO("Test passed\n");
+}
+
+void cu_dev_pair_index_test(void){
+	unsigned n, i, j, k, pi, pj;
+	for(n=2; n<300; n+=37){
+		for(i=0, k=0; i<n; i++){
+			for(j=(i+1); j<n; j++, k++){
+				cu_dev_pair_index(k, n, &pi, &pj);
+				assert(pi == i && pj == j);
+			}
+		}
+	}
+	n = 90000;
+	cu_dev_pair_index(0, n, &pi, &pj);
+	assert(0 == pi && 1 == pj);
+	cu_dev_pair_index((n/2)*(n-1) - 1, n, &pi, &pj);
+	assert(n-2 == pi && n-1 == pj);
+	cu_dev_scan_pair_index(5, 37, 0, &pi, &pj);
+	cu_dev_pair_index(5, 37, &i, &j);
+	assert(i == pi && j == pj);
+	for(i=0, k=0; i<7; i++){
+		for(j=7; j<7+11; j++, k++){
+			cu_dev_scan_pair_index(k, 7, 11, &pi, &pj);
+			assert(pi == i && pj == j);
+		}
+	}
+	INFO("Test passed\n");
+}
+
+void u_bn2bignum_test(void){
+	U_BN   *A = NULL;
+	BIGNUM *bn = NULL;
+	char *hex;
+	A = cu_bn_new();
+	bn = BN_new();
+	assert(1 == cu_bn_dec2bn(A, "127443773749521740448985064835572871821497258320008925264518297348975527574330581823678917711811966132450236776705531598591537821175218567383336289986769851757919421857153566027389171"));
+	assert(1 == u_bn2bignum(A, bn));
+	hex = BN_bn2hex(bn);
+	assert(!strcmp(hex, cu_bn_bn2hex(A)));
+	OPENSSL_free(hex);
+	cu_bn_free(A);
+	BN_free(bn);
+	INFO("Test passed\n");
+}
+
+void report_writer_test(void){
+	REPORT_WRITER *w = NULL;
+	U_BN   *A = NULL, *B = NULL, *P = NULL;
+	FILE *f = NULL;
+	char line[512];
+	A = cu_bn_new();
+	B = cu_bn_new();
+	P = cu_bn_new();
+	assert(1 == cu_bn_dec2bn(A, "2305843009213693951"));
+	assert(1 == cu_bn_mul_word(A, 65537));
+	assert(1 == cu_bn_dec2bn(B, "2305843009213693951"));
+	assert(1 == cu_bn_mul_word(B, 257));
+	assert(1 == cu_bn_dec2bn(P, "2305843009213693951"));
+	w = report_writer_open("report_writer_test.jsonl");
+	assert(NULL != w);
+	assert(1 == report_writer_finding(w, "a.pem", "b.pem", A, B, P));
+	assert(1 == report_writer_close(w));
+	f = fopen("report_writer_test.jsonl", "r");
+	assert(NULL != f);
+	assert(NULL != fgets(line, sizeof(line), f));
+	assert(!strcmp("{\"key_a\":\"a.pem\",\"key_b\":\"b.pem\",\"prime\":\"1FFFFFFFFFFFFFFF\",\"cofactor_a\":\"010001\",\"cofactor_b\":\"0101\"}\n", line));
+	fclose(f);
+	remove("report_writer_test.jsonl");
+	/* paths with quotes, backslashes, commas and line breaks */
+	w = report_writer_open("report_writer_test.jsonl");
+	assert(NULL != w);
+	assert(1 == report_writer_finding(w, "a \"1\".pem", "b\\c\n.pem", A, B, P));
+	assert(1 == report_writer_close(w));
+	f = fopen("report_writer_test.jsonl", "r");
+	assert(NULL != fgets(line, sizeof(line), f));
+	assert(!strcmp("{\"key_a\":\"a \\\"1\\\".pem\",\"key_b\":\"b\\\\c\\u000a.pem\",\"prime\":\"1FFFFFFFFFFFFFFF\",\"cofactor_a\":\"010001\",\"cofactor_b\":\"0101\"}\n", line));
+	fclose(f);
+	remove("report_writer_test.jsonl");
+	w = report_writer_open("report_writer_test.csv");
+	assert(NULL != w);
+	assert(1 == report_writer_finding(w, "a,\"1\".pem", "b.pem", A, B, P));
+	assert(1 == report_writer_close(w));
+	f = fopen("report_writer_test.csv", "r");
+	assert(NULL != fgets(line, sizeof(line), f));
+	assert(NULL != fgets(line, sizeof(line), f));
+	assert(!strcmp("\"a,\"\"1\"\".pem\",b.pem,1FFFFFFFFFFFFFFF,010001,0101\n", line));
+	fclose(f);
+	remove("report_writer_test.csv");
+	cu_bn_free(A);
+	cu_bn_free(B);
+	cu_bn_free(P);
+	INFO("Test passed\n");
+}
+
+void cu_bn_div_test(void){
+	U_BN   *A = NULL, *D = NULL, *Q = NULL, *R = NULL;
+	A = cu_bn_new();
+	D = cu_bn_new();
+	assert(1 == cu_bn_dec2bn(A, "2305843009213693951"));
+	assert(1 == cu_bn_mul_word(A, 65537));
+	assert(1 == cu_bn_add_word(A, 5));
+	assert(1 == cu_bn_dec2bn(D, "2305843009213693951"));
+	Q = cu_bn_pool_new();
+	R = cu_bn_pool_new();
+	assert(1 == cu_bn_div(Q, R, A, D));
+	assert(!strcmp("10001", cu_bn_bn2hex(Q)));
+	assert(!strcmp("5", cu_bn_bn2hex(R)));
+	assert(1 == cu_bn_div(NULL, R, D, A));
+	assert(0 == cu_bn_ucmp(R, D));
+	cu_bn_set_word(D, 0);
+	assert(0 == cu_bn_div(Q, R, A, D));
+	cu_bn_pool_reset();
+	cu_bn_free(A);
+	cu_bn_free(D);
+	INFO("Test passed\n");
+}
+
+void key_clusters_test(void){
+	KEY_CLUSTERS *c = NULL;
+	U_BN   *N[4], *P = NULL, *Q = NULL, *R = NULL;
+	const U_BN *g = NULL;
+	int k;
+	for(k=0; k<4; k++)
+		N[k] = cu_bn_new();
+	P = cu_bn_new();
+	Q = cu_bn_new();
+	R = cu_bn_new();
+	assert(1 == cu_bn_dec2bn(P, "2305843009213693951"));
+	assert(1 == cu_bn_dec2bn(Q, "65537"));
+	assert(1 == cu_bn_dec2bn(R, "257"));
+	assert(1 == cu_bn_dec2bn(N[0], "2305843009213693951"));
+	assert(1 == cu_bn_mul_word(N[0], 65537));
+	assert(1 == cu_bn_dec2bn(N[1], "2305843009213693951"));
+	assert(1 == cu_bn_mul_word(N[1], 257));
+	assert(1 == cu_bn_dec2bn(N[2], "65537"));
+	assert(1 == cu_bn_mul_word(N[2], 257));
+	assert(1 == cu_bn_dec2bn(N[3], "3233"));
+	c = key_clusters_new(4);
+	assert(NULL != c);
+	assert(1 == key_clusters_add(c, 0, 1, N[0], N[1], P));
+	assert(key_clusters_find(c, 0) == key_clusters_find(c, 1));
+	assert(key_clusters_find(c, 0) != key_clusters_find(c, 2));
+	assert(1 == key_clusters_is_factored(c, 0));
+	assert(1 == key_clusters_is_factored(c, 1));
+	assert(0 == key_clusters_is_factored(c, 2));
+	assert(0 == cu_bn_ucmp(&c->q[0], Q));
+	assert(0 == cu_bn_ucmp(&c->q[1], R));
+	assert(NULL == key_clusters_known_gcd(c, 1, 2, N[1]));
+	assert(1 == key_clusters_add(c, 0, 2, N[0], N[2], Q));
+	g = key_clusters_known_gcd(c, 1, 2, N[1]);
+	assert(NULL != g && 0 == cu_bn_ucmp(g, R));
+	g = key_clusters_known_gcd(c, 0, 0, N[0]);
+	assert(g == N[0]);
+	assert(2 == c->primes_count);
+	g = key_clusters_trial_gcd(c, 1, N[2]);
+	assert(NULL != g && 0 == cu_bn_ucmp(g, R));
+	g = key_clusters_trial_gcd(c, 0, N[0]);
+	assert(g == N[0]);
+	assert(NULL == key_clusters_trial_gcd(c, 0, N[3]));
+	assert(NULL == key_clusters_trial_gcd(c, 3, N[0]));
+	cu_bn_pool_reset();
+	key_clusters_free(c);
+	for(k=0; k<4; k++)
+		cu_bn_free(N[k]);
+	cu_bn_free(P);
+	cu_bn_free(Q);
+	cu_bn_free(R);
+	INFO("Test passed\n");
+}
+
+void cu_bn_mul_test(void){
+	U_BN   *A = NULL, *B = NULL, *R = NULL;
+	A = cu_bn_new();
+	B = cu_bn_new();
+	assert(1 == cu_bn_dec2bn(A, "2305843009213693951"));
+	assert(1 == cu_bn_dec2bn(B, "2305843009213693951"));
+	R = cu_bn_pool_new();
+	assert(1 == cu_bn_mul(R, A, B));
+	assert(!strcmp("3FFFFFFFFFFFFFFC000000000000001", cu_bn_bn2hex(R)));
+	cu_bn_set_word(B, 0);
+	assert(1 == cu_bn_mul(R, A, B));
+	assert(cu_bn_is_zero(R));
+	cu_bn_pool_reset();
+	cu_bn_free(A);
+	cu_bn_free(B);
+	INFO("Test passed\n");
+}
+
+void product_tree_test(void){
+	PRODUCT_TREE *t = NULL;
+	U_BN   keys[5], rem[5], *X = NULL;
+	unsigned words[5][2], rem_words[5][2], leaves[5];
+	unsigned moduli[5] = {15, 77, 221, 35, 323};
+	unsigned k;
+	for(k=0; k<5; k++){
+		keys[k].d = words[k];
+		keys[k].top = 1;
+		keys[k].d[0] = moduli[k];
+		rem[k].d = rem_words[k];
+		rem[k].top = 1;
+	}
+	t = product_tree_new(keys, 5);
+	assert(NULL != t);
+	assert(4 == t->levels);
+	assert(!strcmp("ABFFA4AF", cu_bn_bn2hex(product_tree_root(t))));
+	X = cu_bn_new();
+	assert(1 == cu_bn_dec2bn(X, "1000000007"));
+	assert(1 == product_tree_remainders(t, X, rem));
+	for(k=0; k<5; k++)
+		assert(1000000007 % moduli[k] == rem[k].d[0]);
+	cu_bn_set_word(X, 91);
+	assert(3 == product_tree_find(t, X, cu_dev_classic_euclid, leaves, 5));
+	assert(1 == leaves[0] && 2 == leaves[1] && 3 == leaves[2]);
+	cu_bn_set_word(X, 19*23);
+	assert(1 == product_tree_find(t, X, cu_dev_classic_euclid, leaves, 5));
+	assert(4 == leaves[0]);
+	cu_bn_set_word(X, 29*31);
+	assert(0 == product_tree_find(t, X, cu_dev_classic_euclid, leaves, 5));
+	cu_bn_pool_reset();
+	product_tree_free(t);
+	cu_bn_free(X);
+	INFO("Test passed\n");
+}
+
+void cu_bn_hex2bn_test(void){
+	U_BN   *A = NULL;
+	A = cu_bn_new();
+	assert(1 == cu_bn_hex2bn(A, "3FFFFFFFFFFFFFFC000000000000001"));
+	assert(4 == A->top);
+	assert(!strcmp("3FFFFFFFFFFFFFFC000000000000001", cu_bn_bn2hex(A)));
+	assert(1 == cu_bn_hex2bn(A, "ff\n"));
+	assert(1 == A->top && 255 == A->d[0]);
+	assert(1 == cu_bn_hex2bn(A, "0"));
+	assert(cu_bn_is_zero(A));
+	assert(0 == cu_bn_hex2bn(A, "xyz"));
+	cu_bn_pool_reset();
+	cu_bn_free(A);
+	INFO("Test passed\n");
+}
+
+void prime_blacklist_test(void){
+	PRIME_BLACKLIST *bl = NULL;
+	U_BN   keys[4], factors[4], *P = NULL;
+	unsigned words[4][2], factor_words[4][2];
+	unsigned moduli[4] = {15, 77, 221, 323};
+	unsigned k;
+	remove("prime_blacklist_test.txt");
+	for(k=0; k<4; k++){
+		keys[k].d = words[k];
+		keys[k].top = 1;
+		keys[k].d[0] = moduli[k];
+		factors[k].d = factor_words[k];
+		factors[k].top = 1;
+	}
+	bl = prime_blacklist_load("prime_blacklist_test.txt");
+	assert(NULL != bl && 0 == bl->count);
+	assert(0 == prime_blacklist_screen(bl, keys, 4, cu_dev_classic_euclid, factors));
+	P = cu_bn_new();
+	cu_bn_set_word(P, 13);
+	assert(1 == prime_blacklist_add(bl, P));
+	assert(0 == prime_blacklist_add(bl, P));
+	cu_bn_set_word(P, 7);
+	assert(1 == prime_blacklist_add(bl, P));
+	assert(1 == prime_blacklist_save(bl));
+	prime_blacklist_free(bl);
+	bl = prime_blacklist_load("prime_blacklist_test.txt");
+	assert(NULL != bl && 2 == bl->count && 2 == bl->loaded);
+	assert(2 == prime_blacklist_screen(bl, keys, 4, cu_dev_classic_euclid, factors));
+	assert(cu_bn_is_one(&factors[0]) && cu_bn_is_one(&factors[3]));
+	assert(7 == factors[1].d[0] && 13 == factors[2].d[0]);
+	cu_bn_set_word(P, 17);
+	assert(1 == prime_blacklist_add(bl, P));
+	assert(3 == prime_blacklist_screen(bl, keys, 4, cu_dev_classic_euclid, factors));
+	assert(221 == factors[2].d[0] && 17 == factors[3].d[0]);
+	assert(13 == prime_blacklist_find(bl, &keys[2], cu_dev_classic_euclid)->d[0]);
+	assert(NULL == prime_blacklist_find(bl, &keys[0], cu_dev_classic_euclid));
+	cu_bn_pool_reset();
+	prime_blacklist_free(bl);
+	remove("prime_blacklist_test.txt");
+	cu_bn_free(P);
+	INFO("Test passed\n");
+}
+
+void cu_bn_bin2bn_test(void){
+	U_BN   *A = NULL;
+	unsigned char bin[16] = {0x00, 0x03, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFC, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01};
+	unsigned char out[16];
+	A = cu_bn_new();
+	assert(1 == cu_bn_bin2bn(A, bin, 16));
+	assert(4 == A->top);
+	assert(!strcmp("3FFFFFFFFFFFFFFFC000000000001", cu_bn_bn2hex(A)));
+	assert(15 == cu_bn_bn2bin(A, out));
+	assert(!memcmp(bin + 1, out, 15));
+	assert(1 == cu_bn_bin2bn(A, bin, 0));
+	assert(cu_bn_is_zero(A));
+	cu_bn_pool_reset();
+	cu_bn_free(A);
+	INFO("Test passed\n");
+}
+
+void key_daemon_handle_test(void){
+	KEY_CORPUS *c = NULL;
+	U_BN   keys[3];
+	unsigned words[3] = {77, 221, 323};
+	unsigned char request[8], response[KEY_DAEMON_MAX_FRAME];
+	unsigned k;
+	for(k=0; k<3; k++){
+		keys[k].d = &words[k];
+		keys[k].top = 1;
+	}
+	c = key_corpus_new(keys, 3);
+	assert(NULL != c && 3 == c->n);
+	assert(77*221*323 == c->product.d[0]);
+	request[0] = KEY_DAEMON_QUERY;
+	request[1] = 0;
+	request[2] = 15;
+	assert(1 == key_daemon_handle(c, cu_dev_classic_euclid, request, 3, response));
+	assert(KEY_DAEMON_COPRIME == response[0]);
+	request[2] = 91;
+	assert(2 == key_daemon_handle(c, cu_dev_classic_euclid, request, 3, response));
+	assert(KEY_DAEMON_WEAK == response[0] && 91 == response[1]);
+	request[0] = KEY_DAEMON_INSERT;
+	request[2] = 15;
+	assert(1 == key_daemon_handle(c, cu_dev_classic_euclid, request, 3, response));
+	assert(KEY_DAEMON_COPRIME == response[0] && 4 == c->n);
+	request[0] = KEY_DAEMON_QUERY;
+	request[2] = 55;
+	assert(2 == key_daemon_handle(c, cu_dev_classic_euclid, request, 3, response));
+	assert(KEY_DAEMON_WEAK == response[0] && 55 == response[1]);
+	request[2] = 0;
+	assert(1 == key_daemon_handle(c, cu_dev_classic_euclid, request, 3, response));
+	assert(KEY_DAEMON_ERROR == response[0]);
+	request[0] = 'X';
+	assert(1 == key_daemon_handle(c, cu_dev_classic_euclid, request, 3, response));
+	assert(KEY_DAEMON_ERROR == response[0]);
+	key_corpus_free(c);
+	INFO("Test passed\n");
+}
+void product_tree_query_test(void){
+	PRODUCT_TREE *t = NULL, *u = NULL;
+	U_BN   keys[5], *X = NULL, *F = NULL;
+	unsigned words[5][2], leaves[5];
+	unsigned moduli[5] = {15, 77, 221, 35, 323};
+	unsigned k;
+	int err, null;
+	for(k=0; k<5; k++){
+		keys[k].d = words[k];
+		keys[k].top = 1;
+		keys[k].d[0] = moduli[k];
+	}
+	t = product_tree_new(keys, 5);
+	assert(1 == product_tree_save(t, "product_tree_test.bin"));
+	u = product_tree_load("product_tree_test.bin");
+	assert(NULL != u && 5 == u->n && 4 == u->levels);
+	assert(0 == cu_bn_ucmp(product_tree_root(t), product_tree_root(u)));
+	X = cu_bn_new();
+	F = cu_bn_pool_new();
+	cu_bn_set_word(X, 19*29);
+	assert(1 == product_tree_query(u, X, cu_dev_classic_euclid, F, leaves, 5));
+	assert(19 == F->d[0] && 4 == leaves[0]);
+	cu_bn_set_word(X, 7*11);
+	assert(2 == product_tree_query(u, X, cu_dev_classic_euclid, F, leaves, 5));
+	assert(77 == F->d[0] && 1 == leaves[0] && 3 == leaves[1]);
+	cu_bn_set_word(X, 29*31);
+	assert(0 == product_tree_query(u, X, cu_dev_classic_euclid, F, leaves, 5));
+	assert(cu_bn_is_one(F));
+	product_tree_free(u);
+	truncate("product_tree_test.bin", 20);
+	/* the corrupted tree message of product_tree_load goes to /dev/null, not to every run of the tool */
+	fflush(stderr);
+	err = dup(2);
+	null = open("/dev/null", O_WRONLY);
+	dup2(null, 2);
+	close(null);
+	assert(NULL == product_tree_load("product_tree_test.bin"));
+	fflush(stderr);
+	dup2(err, 2);
+	close(err);
+	remove("product_tree_test.bin");
+	cu_bn_pool_reset();
+	product_tree_free(t);
+	cu_bn_free(X);
+	INFO("Test passed\n");
+}
+
+void key_stream_test(void){
+	KEY_STREAM *st = NULL;
+	WEAK_PAIRS *wp = NULL;
+	U_BN   keys[200], *g = NULL;
+	unsigned words[200], primes[400];
+	unsigned k, m, p, expected = 0;
+	for(k=0, p=1009; k<400; p+=2){
+		for(m=3; m*m<=p && p%m; m+=2);
+		if(m*m > p)
+			primes[k++] = p;
+	}
+	for(k=0; k<200; k++){
+		keys[k].d = &words[k];
+		keys[k].top = 1;
+		words[k] = primes[2*k] * primes[2*k+1];
+	}
+	/* pairs in one segment, across merged segments, across unmerged segments and with the tail */
+	words[20] = primes[2*10] * primes[2*20+1];
+	words[100] = primes[2*3] * primes[2*100+1];
+	words[150] = primes[2*70] * primes[2*150+1];
+	words[199] = primes[2*5] * primes[2*199+1];
+	words[198] = words[197];
+	wp = weak_pairs_new(64, 1);
+	st = key_stream_new(wp, cu_dev_classic_euclid);
+	assert(NULL != st);
+	for(k=0; k<200; k++){
+		assert(1 == key_stream_insert(st, &keys[k]));
+	}
+	assert(1 == st->merges && NULL != st->segments[1] && 8 == st->buffered);
+	assert(1 == key_stream_finish(st));
+	for(k=0; k<200; k++){
+		for(m=k+1; m<200; m++){
+			g = cu_dev_classic_euclid(cu_bn_pool_dup(&keys[k]), cu_bn_pool_dup(&keys[m]));
+			expected += !cu_bn_is_one(g);
+		}
+		cu_bn_pool_reset();
+	}
+	assert(5 == expected && expected == weak_pairs_size(wp));
+	weak_pairs_sort(wp);
+	assert(3 == wp->pairs[0].i && 100 == wp->pairs[0].j && primes[6] == wp->pairs[0].gcd.d[0]);
+	assert(5 == wp->pairs[1].i && 199 == wp->pairs[1].j);
+	assert(10 == wp->pairs[2].i && 20 == wp->pairs[2].j);
+	assert(70 == wp->pairs[3].i && 150 == wp->pairs[3].j);
+	assert(197 == wp->pairs[4].i && 198 == wp->pairs[4].j && words[197] == wp->pairs[4].gcd.d[0]);
+	key_stream_free(st);
+	weak_pairs_free(wp);
+	INFO("Test passed\n");
+}
+
+void spill_tree_test(void){
+	SPILL_TREE *t = NULL;
+	U_BN   keys[5], rem[5], *X = NULL;
+	unsigned words[5][2], rem_words[5][2];
+	unsigned moduli[5] = {15, 77, 221, 35, 323}, batch[5] = {11*13, 17*19, 11*23, 29*31, 29*31};
+	char flagged[5], expected[5] = {1, 0, 1, 1, 1};
+	size_t memory[3] = {0, 48, 1 << 20};
+	unsigned spilled[3] = {4, 3, 0};
+	unsigned k, m;
+	FILE *f;
+	X = cu_bn_new();
+	assert(1 == cu_bn_dec2bn(X, "1000000007"));
+	for(k=0; k<5; k++){
+		keys[k].d = words[k];
+		keys[k].top = 1;
+		keys[k].d[0] = moduli[k];
+		rem[k].d = rem_words[k];
+		rem[k].top = 1;
+	}
+	for(m=0; m<3; m++){
+		t = spill_tree_new(keys, 5, "spill_tree_test", memory[m]);
+		assert(NULL != t && 4 == t->levels);
+		assert(spilled[m] == t->spilled);
+		assert(!strcmp("ABFFA4AF", cu_bn_bn2hex(spill_tree_root(t))));
+		assert(1 == spill_tree_remainders(t, X, rem));
+		for(k=0; k<5; k++)
+			assert(1000000007 % moduli[k] == rem[k].d[0]);
+		assert(0 == t->resident || memory[m] >= t->resident);
+		spill_tree_free(t);
+		assert(NULL == (f = fopen("spill_tree_test.0", "rb")));
+	}
+	/* batch GCD: a shared prime, both primes shared, and an odd node carried up */
+	for(k=0; k<5; k++)
+		keys[k].d[0] = batch[k];
+	for(m=0; m<3; m++){
+		t = spill_tree_new(keys, 5, "spill_tree_test", memory[m]);
+		assert(1 == spill_tree_batch_gcd(t, cu_dev_binary_gcd, flagged));
+		for(k=0; k<5; k++)
+			assert(expected[k] == flagged[k]);
+		spill_tree_free(t);
+	}
+	t = spill_tree_new(keys, 1, "spill_tree_test", 0);
+	flagged[0] = 1;
+	assert(1 == spill_tree_batch_gcd(t, cu_dev_binary_gcd, flagged));
+	assert(0 == flagged[0]);
+	assert(0 == spill_tree_batch_gcd(t, cu_dev_binary_gcd, NULL));
+	spill_tree_free(t);
+	cu_bn_pool_reset();
+	cu_bn_free(X);
+	INFO("Test passed\n");
+}
+
+void product_tree_sparse_test(void){
+	PRODUCT_TREE *full = NULL, *t = NULL;
+	U_BN   keys[37], rem[37], full_rem[37], *X = NULL, *Y = NULL;
+	unsigned words[37], rem_words[37], full_words[37], leaves[37], full_leaves[37];
+	unsigned k, found;
+	int every;
+	for(k=0; k<37; k++){
+		keys[k].d = &words[k];
+		keys[k].top = 1;
+		words[k] = 1000003 + 2*k;
+		rem[k].d = &rem_words[k];
+		rem[k].top = 1;
+		full_rem[k].d = &full_words[k];
+		full_rem[k].top = 1;
+	}
+	X = cu_bn_new();
+	assert(1 == cu_bn_dec2bn(X, "98765432109876543210987654321"));
+	full = product_tree_new(keys, 37);
+	assert(7 == full->levels);
+	assert(1 == product_tree_remainders(full, X, full_rem));
+	Y = cu_bn_new();
+	cu_bn_set_word(Y, 1000003 + 2*20);
+	found = product_tree_find(full, Y, cu_dev_classic_euclid, full_leaves, 37);
+	for(every=2; every<=4; every++){
+		t = product_tree_new_sparse(keys, 37, every);
+		assert(NULL != t && NULL != t->nodes[0] && NULL != t->nodes[6]);
+		assert((NULL != t->nodes[every]) && (NULL == t->nodes[1]));
+		assert(product_tree_bytes(t) < product_tree_bytes(full));
+		assert(0 == cu_bn_ucmp(product_tree_root(full), product_tree_root(t)));
+		assert(1 == product_tree_remainders(t, X, rem));
+		for(k=0; k<37; k++)
+			assert(0 == cu_bn_ucmp(&full_rem[k], &rem[k]));
+		assert(found == product_tree_find(t, Y, cu_dev_classic_euclid, leaves, 37));
+		for(k=0; k<found; k++)
+			assert(full_leaves[k] == leaves[k]);
+		assert(0 == product_tree_save(t, "product_tree_sparse_test.bin"));
+		cu_bn_pool_reset();
+		product_tree_free(t);
+	}
+	assert(NULL == product_tree_new_sparse(keys, 37, 0));
+	product_tree_free(full);
+	cu_bn_free(X);
+	cu_bn_free(Y);
+	INFO("Test passed\n");
+}
+
+void product_tree_scaled_test(void){
+	PRODUCT_TREE *t = NULL;
+	U_BN   keys[41], rem[41], scaled[41], X;
+	unsigned words[41][3], rem_words[41][3], scaled_words[41][3], x_words[200];
+	unsigned k, m;
+	int every;
+	for(k=0; k<41; k++){
+		keys[k].d = words[k];
+		keys[k].top = 3;
+		words[k][0] = 0x9E3779B9u * (k + 1) | 1;
+		words[k][1] = 0x85EBCA6Bu * (k + 7);
+		words[k][2] = (k % 5) ? 0x40000000u + k : 0;
+		cu_bn_correct_top(&keys[k]);
+		rem[k].d = rem_words[k];
+		scaled[k].d = scaled_words[k];
+	}
+	X.d = x_words;
+	for(every=1; every<=3; every++){
+		t = product_tree_new_sparse(keys, 41, every);
+		/* x above, at and below the size of the root, and a multiple of a leaf */
+		for(m=0; m<4; m++){
+			for(k=0; k<200; k++)
+				x_words[k] = 0xC2B2AE35u * (k + m + 1);
+			X.top = (m == 0) ? 200 : ((m == 1) ? product_tree_root(t)->top : 2);
+			if(m == 3){
+				X.top = keys[6].top + 1;
+				memset(x_words, 0, sizeof(x_words));
+				cu_bn_mul(&X, &keys[6], &keys[7]);
+			}
+			cu_bn_correct_top(&X);
+			assert(1 == product_tree_remainders(t, &X, rem));
+			assert(1 == product_tree_scaled_remainders(t, &X, scaled));
+			for(k=0; k<41; k++)
+				assert(0 == cu_bn_ucmp(&rem[k], &scaled[k]));
+			if(m == 3)
+				assert(cu_bn_is_zero(&scaled[6]) && cu_bn_is_zero(&scaled[7]));
+		}
+		product_tree_free(t);
+	}
+	cu_bn_pool_reset();
+	INFO("Test passed\n");
+}
+
+void product_tree_batch_gcd_test(void){
+	PRODUCT_TREE *t = NULL;
+	U_BN   keys[7];
+	U_BN   big[41];
+	unsigned words[7] = {11*13, 17*19, 11*23, 29*31, 29*31, 37*41, 43*47}, big_words[41][4];
+	char flagged[7], expected[7] = {1, 0, 1, 1, 1, 0, 0}, big_flagged[41], scaled_flagged[41];
+	unsigned k;
+	int every;
+	for(k=0; k<7; k++){
+		keys[k].d = &words[k];
+		keys[k].top = 1;
+	}
+	/* a shared prime, both primes shared, and an odd node carried up */
+	for(every=1; every<=2; every++){
+		t = product_tree_new_sparse(keys, 7, every);
+		assert(1 == product_tree_batch_gcd(t, cu_dev_binary_gcd, flagged));
+		for(k=0; k<7; k++)
+			assert(expected[k] == flagged[k]);
+		assert(1 == product_tree_scaled_batch_gcd(t, cu_dev_binary_gcd, flagged));
+		for(k=0; k<7; k++)
+			assert(expected[k] == flagged[k]);
+		product_tree_free(t);
+	}
+	t = product_tree_new(keys, 1);
+	flagged[0] = 1;
+	assert(1 == product_tree_batch_gcd(t, cu_dev_binary_gcd, flagged));
+	assert(0 == flagged[0]);
+	flagged[0] = 1;
+	assert(1 == product_tree_scaled_batch_gcd(t, cu_dev_binary_gcd, flagged));
+	assert(0 == flagged[0]);
+	assert(0 == product_tree_batch_gcd(t, cu_dev_binary_gcd, NULL));
+	assert(0 == product_tree_scaled_batch_gcd(t, cu_dev_binary_gcd, NULL));
+	product_tree_free(t);
+	/* multi-word leaves of uneven length, the last two share a factor */
+	for(k=0; k<41; k++){
+		big[k].d = big_words[k];
+		big[k].top = 3;
+		big_words[k][0] = 0x9E3779B9u * (k + 1) | 1;
+		big_words[k][1] = 0x85EBCA6Bu * (k + 7);
+		big_words[k][2] = (k % 5) ? 0x40000000u + k : 0;
+		cu_bn_correct_top(&big[k]);
+	}
+	cu_bn_set_word(&big[40], 3);
+	cu_bn_mul_word(&big[39], 3);
+	for(every=1; every<=3; every++){
+		t = product_tree_new_sparse(big, 41, every);
+		assert(1 == product_tree_batch_gcd(t, cu_dev_binary_gcd, big_flagged));
+		assert(1 == product_tree_scaled_batch_gcd(t, cu_dev_binary_gcd, scaled_flagged));
+		assert(0 == memcmp(big_flagged, scaled_flagged, sizeof(big_flagged)));
+		assert(big_flagged[39] && big_flagged[40]);
+		product_tree_free(t);
+	}
+	INFO("Test passed\n");
+}
+
+void cu_bn_mul_limbs_test(void){
+	BN_CTX *ctx = NULL;
+	BIGNUM *ba = NULL, *bb = NULL, *br = NULL, *bm = NULL;
+	U_BN   A, B, R;
+	unsigned a[700], b[700], r[1400], seed = 12345;
+	/* schoolbook, Karatsuba and Toom-3 sizes around their thresholds */
+	int sizes[][2] = {{1, 1}, {5, 3}, {33, 32}, {47, 47}, {48, 48}, {49, 49}, {95, 95}, {96, 96},
+		{97, 97}, {150, 150}, {299, 299}, {300, 300}, {301, 301}, {700, 700}, {700, 96}, {333, 50}, {64, 200}};
+	unsigned k, m;
+	int fill;
+	ctx = BN_CTX_new();
+	ba = BN_new();
+	bb = BN_new();
+	br = BN_new();
+	bm = BN_new();
+	A.d = a;
+	B.d = b;
+	R.d = r;
+	for(fill=0; fill<2; fill++){
+		for(k=0; k<sizeof(sizes)/sizeof(sizes[0]); k++){
+			for(m=0; m<700; m++){
+				seed = seed * 1103515245u + 12345u;
+				a[m] = fill ? 0xFFFFFFFFu : seed;
+				seed = seed * 1103515245u + 12345u;
+				b[m] = fill ? 0xFFFFFFFFu : seed ^ (seed << 13);
+			}
+			A.top = sizes[k][0];
+			B.top = sizes[k][1];
+			assert(1 == cu_bn_mul_limbs(r, a, A.top, b, B.top));
+			R.top = A.top + B.top;
+			assert(1 == u_bn2bignum(&A, ba) && 1 == u_bn2bignum(&B, bb) && 1 == u_bn2bignum(&R, br));
+			assert(1 == BN_mul(bm, ba, bb, ctx));
+			assert(0 == BN_cmp(bm, br));
+			assert(1 == cu_bn_sqr_limbs(r, a, A.top));
+			R.top = 2 * A.top;
+			assert(1 == u_bn2bignum(&R, br));
+			assert(1 == BN_sqr(bm, ba, ctx));
+			assert(0 == BN_cmp(bm, br));
+		}
+	}
+	A.top = 1;
+	a[0] = 0;
+	assert(1 == cu_bn_mul(&R, &A, &B));
+	assert(cu_bn_is_zero(&R));
+	BN_free(ba);
+	BN_free(bb);
+	BN_free(br);
+	BN_free(bm);
+	BN_CTX_free(ctx);
+	INFO("Test passed\n");
+}
+
+void cu_bn_mul_ntt_test(void){
+	unsigned *a = NULL, *b = NULL, *r = NULL, *s = NULL, seed = 54321;
+	/* balanced, unbalanced, single word and transform length boundaries */
+	int sizes[][2] = {{1, 1}, {2, 1}, {3, 5}, {64, 64}, {1000, 1000}, {1024, 1025}, {5000, 17}, {300, 4000}, {4096, 4096}};
+	unsigned k, m;
+	int fill;
+	a = (unsigned*)malloc(5000*sizeof(unsigned));
+	b = (unsigned*)malloc(5000*sizeof(unsigned));
+	r = (unsigned*)malloc(10000*sizeof(unsigned));
+	s = (unsigned*)malloc(10000*sizeof(unsigned));
+	assert(NULL != a && NULL != b && NULL != r && NULL != s);
+	for(fill=0; fill<2; fill++){
+		for(k=0; k<sizeof(sizes)/sizeof(sizes[0]); k++){
+			for(m=0; m<5000; m++){
+				seed = seed * 1103515245u + 12345u;
+				a[m] = fill ? 0xFFFFFFFFu : seed;
+				seed = seed * 1103515245u + 12345u;
+				b[m] = fill ? 0xFFFFFFFFu : seed ^ (seed << 13);
+			}
+			assert(1 == cu_bn_mul_ntt(r, a, sizes[k][0], b, sizes[k][1]));
+			cu_bn_mul_school(s, a, sizes[k][0], b, sizes[k][1]);
+			assert(!memcmp(r, s, (sizes[k][0] + sizes[k][1])*sizeof(unsigned)));
+			assert(1 == cu_bn_mul_ntt(r, a, sizes[k][0], a, sizes[k][0]));
+			cu_bn_sqr_school(s, a, sizes[k][0]);
+			assert(!memcmp(r, s, 2*sizes[k][0]*sizeof(unsigned)));
+		}
+	}
+	/* cu_bn_mul_limbs hands operands past CU_BN_MUL_NTT_THRESHOLD to the transforms */
+	assert(1 == cu_bn_mul_limbs(r, a, 5000, b, CU_BN_MUL_NTT_THRESHOLD));
+	cu_bn_mul_school(s, a, 5000, b, CU_BN_MUL_NTT_THRESHOLD);
+	assert(!memcmp(r, s, (5000 + CU_BN_MUL_NTT_THRESHOLD)*sizeof(unsigned)));
+	assert(0 == cu_bn_mul_ntt(r, a, NTT_MUL_MAX_WORDS, b, 1));
+	free(a);
+	free(b);
+	free(r);
+	free(s);
+	INFO("Test passed\n");
+}
+
+void cu_bn_divmod_limbs_test(void){
+	BN_CTX *ctx = NULL;
+	BIGNUM *ba = NULL, *bd = NULL, *bq = NULL, *br = NULL, *bx = NULL;
+	U_BN   A, D, Q, R;
+	unsigned *a = NULL, *d = NULL, *q = NULL, *r = NULL, seed = 24680;
+	/* Algorithm D, single words, short dividends and Barrett past CU_BN_DIV_NEWTON_THRESHOLD */
+	int sizes[][2] = {{1, 1}, {7, 1}, {3, 5}, {2, 2}, {64, 33}, {700, 191}, {401, 400},
+		{CU_BN_DIV_NEWTON_THRESHOLD + 3, CU_BN_DIV_NEWTON_THRESHOLD}, {3 * CU_BN_DIV_NEWTON_THRESHOLD, CU_BN_DIV_NEWTON_THRESHOLD + 1}};
+	unsigned k, m, words = 3 * CU_BN_DIV_NEWTON_THRESHOLD + 3;
+	int fill;
+	ctx = BN_CTX_new();
+	ba = BN_new();
+	bd = BN_new();
+	bq = BN_new();
+	br = BN_new();
+	bx = BN_new();
+	a = (unsigned*)malloc(words*sizeof(unsigned));
+	d = (unsigned*)malloc(words*sizeof(unsigned));
+	q = (unsigned*)malloc(words*sizeof(unsigned));
+	r = (unsigned*)malloc(words*sizeof(unsigned));
+	assert(NULL != a && NULL != d && NULL != q && NULL != r);
+	A.d = a;
+	D.d = d;
+	Q.d = q;
+	R.d = r;
+	/* random words, all ones and divisors of a single top bit */
+	for(fill=0; fill<3; fill++){
+		for(k=0; k<sizeof(sizes)/sizeof(sizes[0]); k++){
+			for(m=0; m<words; m++){
+				seed = seed * 1103515245u + 12345u;
+				a[m] = (1 == fill) ? 0xFFFFFFFFu : seed;
+				seed = seed * 1103515245u + 12345u;
+				d[m] = (1 == fill) ? 0xFFFFFFFFu : ((2 == fill) ? 0 : seed ^ (seed >> 11));
+			}
+			A.top = sizes[k][0];
+			D.top = sizes[k][1];
+			d[D.top - 1] = (2 == fill) ? 0x80000000u : (d[D.top - 1] | 1);
+			assert(1 == cu_bn_divmod_limbs(q, r, a, A.top, d, D.top));
+			Q.top = (A.top < D.top) ? 1 : A.top - D.top + 1;
+			if (A.top < D.top)
+				q[0] = 0;
+			R.top = D.top;
+			assert(1 == u_bn2bignum(&A, ba) && 1 == u_bn2bignum(&D, bd));
+			assert(1 == BN_div(bq, br, ba, bd, ctx));
+			assert(1 == u_bn2bignum(&Q, bx) && 0 == BN_cmp(bq, bx));
+			assert(1 == u_bn2bignum(&R, bx) && 0 == BN_cmp(br, bx));
+			/* the remainder may overwrite the dividend */
+			assert(1 == cu_bn_mod_limbs(a, a, A.top, d, D.top));
+			assert(!memcmp(a, r, D.top*sizeof(unsigned)));
+		}
+	}
+	d[0] = 0;
+	assert(0 == cu_bn_divmod_limbs(q, r, a, 1, d, 1));
+	BN_free(ba);
+	BN_free(bd);
+	BN_free(bq);
+	BN_free(br);
+	BN_free(bx);
+	BN_CTX_free(ctx);
+	free(a);
+	free(d);
+	free(q);
+	free(r);
+	INFO("Test passed\n");
+}
+
+static void gcd_random_test(U_BN *(*gcd)(U_BN *, U_BN *), int heap, unsigned seed, const int sizes[][3], int count, int rounds, int max_words){
+	BN_CTX *ctx = NULL;
+	BIGNUM *ba = NULL, *bb = NULL, *br = NULL, *bx = NULL;
+	U_BN   A, B, *C = NULL, *D = NULL, *G = NULL;
+	unsigned *a = NULL, *b = NULL, x[64], y[64], p[16];
+	int k, m, n, shift, np;
+	/* sizes are {words of a, words of b, words of a factor shared by both}, up to 64 and 16 */
+	n = ((max_words > 64) ? max_words : 64) + 8;
+	ctx = BN_CTX_new();
+	ba = BN_new();
+	bb = BN_new();
+	br = BN_new();
+	bx = BN_new();
+	a = (unsigned*)malloc(n*sizeof(unsigned));
+	b = (unsigned*)malloc(n*sizeof(unsigned));
+	A.d = a;
+	B.d = b;
+
+	for(shift=0; shift<rounds*23; shift+=23){
+		for(k=0; k<count; k++){
+			np = sizes[k][2];
+			for(m=0; m<64; m++){
+				seed = seed * 1103515245u + 12345u;
+				x[m] = seed;
+				seed = seed * 1103515245u + 12345u;
+				y[m] = seed ^ (seed >> 11);
+			}
+			for(m=0; m<16; m++){
+				seed = seed * 1103515245u + 12345u;
+				p[m] = seed | 1;
+			}
+			A.top = sizes[k][0];
+			B.top = sizes[k][1];
+			memset(a, 0, n*sizeof(unsigned));
+			memset(b, 0, n*sizeof(unsigned));
+			if (np) {
+				cu_bn_mul_school(a, x, A.top - np, p, np);
+				cu_bn_mul_school(b, y, B.top - np, p, np);
+			} else {
+				memcpy(a, x, A.top*sizeof(unsigned));
+				memcpy(b, y, B.top*sizeof(unsigned));
+			}
+			/* a power of two shared by both and one more in a */
+			cu_bn_correct_top(&A);
+			cu_bn_correct_top(&B);
+			cu_dev_bn_lshift(&A, shift + 1);
+			if (shift)
+				cu_dev_bn_lshift(&B, shift);
+			assert(1 == u_bn2bignum(&A, ba) && 1 == u_bn2bignum(&B, bb));
+			assert(1 == BN_gcd(br, ba, bb, ctx));
+			if (heap) {
+				C = cu_bn_new();
+				D = cu_bn_new();
+				assert(1 == bignum2u_bn(ba, C) && 1 == bignum2u_bn(bb, D));
+				G = gcd(C, D);
+			} else {
+				G = gcd(&A, &B);
+			}
+			assert(1 == u_bn2bignum(G, bx) && 0 == BN_cmp(br, bx));
+			if (heap) {
+				cu_bn_free(C);
+				cu_bn_free(D);
+			}
+		}
+	}
+	if (!heap) {
+		/* operands of more than max_words words are left to the binary algorithm */
+		if (max_words) {
+			memset(a, 0, n*sizeof(unsigned));
+			memset(b, 0, n*sizeof(unsigned));
+			a[max_words] = 6;
+			b[0] = 9;
+			A.top = max_words + 1;
+			B.top = 1;
+			G = gcd(&A, &B);
+			assert(1 == G->top && 3 == G->d[0]);
+		}
+		/* a zero operand gives the other one */
+		cu_bn_set_word(&A, 0);
+		cu_bn_set_word(&B, 36);
+		assert(36 == gcd(&A, &B)->d[0]);
+		cu_bn_set_word(&A, 36);
+		cu_bn_set_word(&B, 0);
+		assert(36 == gcd(&A, &B)->d[0]);
+	}
+	free(a);
+	free(b);
+	BN_free(ba);
+	BN_free(bb);
+	BN_free(br);
+	BN_free(bx);
+	BN_CTX_free(ctx);
+}
+
+void cu_dev_classic_euclid_test(void){
+	BN_CTX *ctx = NULL;
+	BIGNUM *ba = NULL, *bb = NULL, *br = NULL, *bx = NULL;
+	U_BN   A, B;
+	unsigned a[64], b[64], seed = 13579;
+	/* single words, unbalanced and keys sharing a prime of the last count of words */
+	int sizes[][3] = {{1, 1, 0}, {5, 1, 0}, {2, 7, 0}, {32, 32, 0}, {64, 3, 0}, {33, 31, 0}, {32, 32, 2}, {40, 20, 3}};
+	/* remainders of all ones operands, the longest quotient digits */
+	int lengths[][2] = {{1, 1}, {5, 1}, {33, 2}, {64, 63}, {64, 3}};
+	unsigned k;
+	int m;
+	ctx = BN_CTX_new();
+	ba = BN_new();
+	bb = BN_new();
+	br = BN_new();
+	bx = BN_new();
+	A.d = a;
+	B.d = b;
+
+	gcd_random_test(cu_dev_classic_euclid, 0, seed, sizes, sizeof(sizes)/sizeof(sizes[0]), 1, 0);
+	for(k=0; k<sizeof(lengths)/sizeof(lengths[0]); k++){
+		for(m=0; m<64; m++){
+			seed = seed * 1103515245u + 12345u;
+			a[m] = (k & 1) ? 0xFFFFFFFFu : seed;
+			b[m] = (k & 1) ? 0xFFFFFFFFu : seed ^ (seed >> 11);
+		}
+		A.top = lengths[k][0];
+		B.top = lengths[k][1];
+		assert(1 == u_bn2bignum(&A, ba) && 1 == u_bn2bignum(&B, bb));
+		assert(1 == BN_mod(br, ba, bb, ctx));
+		assert(1 == cu_dev_bn_umod(&A, &B));
+		assert(1 == u_bn2bignum(&A, bx) && 0 == BN_cmp(br, bx));
+	}
+	/* no remainder by zero */
+	cu_bn_set_word(&A, 35);
+	cu_bn_set_word(&B, 0);
+	assert(0 == cu_dev_bn_umod(&A, &B));
+	BN_free(ba);
+	BN_free(bb);
+	BN_free(br);
+	BN_free(bx);
+	BN_CTX_free(ctx);
+	INFO("Test passed\n");
+}
+
+void cu_dev_ctz_binary_gcd_test(void){
+	U_BN   A, B;
+	unsigned a[2], b[1];
+	/* odd and even operands, unbalanced and keys sharing a prime of the last count of words */
+	int sizes[][3] = {{1, 1, 0}, {5, 1, 0}, {2, 7, 0}, {32, 32, 0}, {64, 3, 0}, {33, 31, 0}, {32, 32, 2}, {40, 20, 3}};
+	A.d = a;
+	B.d = b;
+
+	/* trailing zeros, shifts and the fused subtract and shift */
+	a[0] = 0;
+	a[1] = 0x50;
+	A.top = 2;
+	assert(36 == cu_dev_bn_ctz(&A));
+	assert(1 == cu_dev_bn_rshift(&A, 36) && 1 == A.top && 5 == a[0]);
+	a[0] = 7;
+	a[1] = 1;
+	A.top = 2;
+	b[0] = 3;
+	B.top = 1;
+	assert(1 == cu_dev_bn_sub_rshift(&A, &B) && 1 == A.top && 0x40000001 == a[0]);
+	assert(0 == cu_dev_bn_sub_rshift(&B, &A));
+
+	gcd_random_test(cu_dev_ctz_binary_gcd, 0, 97531, sizes, sizeof(sizes)/sizeof(sizes[0]), 3, 0);
+	INFO("Test passed\n");
+}
+
+void cu_dev_pm_gcd_test(void){
+	U_BN   A, B;
+	unsigned a[2], b[2];
+	/* odd and even operands, unbalanced and keys sharing a prime of the last count of words */
+	int sizes[][3] = {{1, 1, 0}, {5, 1, 0}, {2, 7, 0}, {32, 32, 0}, {64, 3, 0}, {33, 31, 0}, {32, 32, 2}, {40, 20, 3}};
+	A.d = a;
+	B.d = b;
+
+	/* 7 + 5 is divisible by 4 and 7 - 1 is not, a negative difference is negated */
+	cu_bn_set_word(&A, 7);
+	cu_bn_set_word(&B, 5);
+	assert(2 == cu_dev_bn_pm_rshift(&B, &A) && 1 == B.top && 3 == b[0]);
+	cu_bn_set_word(&B, 11);
+	assert(2 == cu_dev_bn_pm_rshift(&B, &A) && 1 == b[0]);
+	a[0] = 0xffffffff;
+	a[1] = 0xffffffff;
+	A.top = 2;
+	cu_bn_set_word(&B, 1);
+	assert(64 == cu_dev_bn_pm_rshift(&B, &A) && 1 == B.top && 1 == b[0]);
+	a[1] = 1;
+	cu_bn_set_word(&B, 3);
+	assert(2 == cu_dev_bn_pm_rshift(&B, &A) && 1 == B.top && 0x7fffffff == b[0]);
+	cu_bn_set_word(&B, 0xffffffff);
+	a[1] = 0;
+	A.top = 1;
+	assert(0 == cu_dev_bn_pm_rshift(&B, &A) && cu_bn_is_zero(&B));
+
+	gcd_random_test(cu_dev_pm_gcd, 0, 24680, sizes, sizeof(sizes)/sizeof(sizes[0]), 3, 0);
+	INFO("Test passed\n");
+}
+
+void cu_approximate_euclid_test(void){
+	U_BN   A, B;
+	unsigned a[3], b[1];
+	/* balanced, unbalanced and a shared factor of the last count of words */
+	int sizes[][3] = {{1, 1, 0}, {6, 1, 0}, {2, 9, 0}, {32, 32, 0}, {64, 2, 0}, {33, 32, 0}, {32, 32, 16}, {64, 64, 2}};
+	A.d = a;
+	B.d = b;
+
+	/* estimates above a leave the absolute value of the difference */
+	cu_bn_set_word(&A, 10);
+	cu_bn_set_word(&B, 3);
+	assert(1 == cu_dev_bn_abs_submul(&A, &B, 4, 0) && 2 == a[0]);
+	cu_bn_set_word(&A, 0xffffffff);
+	cu_bn_set_word(&B, 0x80000000);
+	assert(1 == cu_dev_bn_abs_submul(&A, &B, 1, 1) && 1 == A.top && 1 == a[0]);
+	a[0] = 0;
+	a[1] = 0;
+	a[2] = 4;
+	A.top = 3;
+	cu_bn_set_word(&B, 3);
+	assert(1 == cu_dev_bn_abs_submul(&A, &B, 0x55555556, 34) && 2 == A.top && 0 == a[0] && 8 == a[1]);
+
+	/* the host version takes allocated BIGNUMs */
+	gcd_random_test(cu_approximate_euclid, 1, 13579, sizes, sizeof(sizes)/sizeof(sizes[0]), 1, 0);
+	gcd_random_test(cu_dev_approximate_euclid, 0, 13579, sizes, sizeof(sizes)/sizeof(sizes[0]), 1, 0);
+	INFO("Test passed\n");
+}
+
+void cu_dev_divsteps_gcd_test(void){
+	/* odd and even operands, unbalanced, a shared factor of the last count of words and a fallback above the limbs */
+	int sizes[][3] = {{1, 1, 0}, {4, 1, 0}, {2, 9, 0}, {32, 32, 0}, {64, 2, 0}, {33, 31, 0}, {32, 32, 16}, {64, 64, 2}};
+
+	gcd_random_test(cu_dev_divsteps_gcd, 0, 86420, sizes, sizeof(sizes)/sizeof(sizes[0]), 3, CU_DEV_DIVSTEPS_MAX_BITS / 32);
+	INFO("Test passed\n");
+}
+
+void cu_dev_kary_gcd_test(void){
+	U_BN   A, B;
+	unsigned a[3], b[3];
+	/* odd and even operands, unbalanced, a shared factor of the last count of words and a fallback above the limbs */
+	int sizes[][3] = {{1, 1, 0}, {4, 1, 0}, {2, 9, 0}, {32, 32, 0}, {64, 2, 0}, {33, 31, 0}, {32, 32, 16}, {64, 64, 2}};
+	A.d = a;
+	B.d = b;
+
+	/* 3 a - b clears two words of a = 0x5555...5557 and b = 2^64 + 5, 1 - 3 is negated */
+	a[0] = 0x55555557;
+	a[1] = 0x55555555;
+	a[2] = 0x55555555;
+	A.top = 3;
+	b[0] = 5;
+	b[1] = 0;
+	b[2] = 1;
+	B.top = 3;
+	assert(1 == cu_dev_bn_lincomb_rshift(&A, &B, 3, 1, 0, 2) && 1 == A.top && 0xffffffff == a[0]);
+	a[0] = 1;
+	A.top = 1;
+	b[0] = 3;
+	B.top = 1;
+	assert(1 == cu_dev_bn_lincomb_rshift(&A, &B, 1, 1, 0, 0) && 1 == A.top && 2 == a[0]);
+
+	gcd_random_test(cu_dev_kary_gcd, 0, 75319, sizes, sizeof(sizes)/sizeof(sizes[0]), 3, CU_DEV_KARY_MAX_BITS / 32);
+	INFO("Test passed\n");
+}
+
+void cu_dev_hybrid_gcd_test(void){
+	U_BN   A, B, *G = NULL;
+	unsigned a[4], b[4];
+	unsigned long long x[2], y[2];
+	unsigned __int128 g, h, t;
+	int i;
+	/* operands that start or end in native integers, a common factor above 64 bits and k-ary steps before them */
+	int sizes[][3] = {{1, 1, 0}, {2, 1, 0}, {3, 4, 0}, {4, 4, 3}, {5, 4, 3}, {2, 9, 0}, {32, 32, 0}, {33, 31, 0}, {32, 32, 16}, {64, 64, 2}};
+	A.d = a;
+	B.d = b;
+
+	/* 3 2^64 + 1 - (2^64 + 1) leaves no low word, 2^95 + 1 and 2^95 + 3 keep a high word to the end */
+	memset(a, 0, sizeof(a));
+	memset(b, 0, sizeof(b));
+	a[0] = 1;
+	a[2] = 3;
+	b[0] = 1;
+	b[2] = 1;
+	A.top = 3;
+	B.top = 3;
+	G = cu_dev_hybrid_gcd(&A, &B);
+	assert(1 == G->top && 1 == G->d[0]);
+	a[0] = 1;
+	a[1] = 0;
+	a[2] = 0x80000000;
+	b[0] = 3;
+	b[1] = 0;
+	b[2] = 0x80000000;
+	A.top = 3;
+	B.top = 3;
+	G = cu_dev_hybrid_gcd(&A, &B);
+	assert(1 == G->top && 1 == G->d[0]);
+	a[0] = 0xffffffff;
+	a[1] = 0xffffffff;
+	a[2] = 0xffffffff;
+	a[3] = 0x7fffffff;
+	A.top = 4;
+	memcpy(b, a, 4 * sizeof(unsigned));
+	B.top = 4;
+	G = cu_dev_hybrid_gcd(&A, &B);
+	assert(4 == G->top && 0x7fffffff == G->d[3] && 0xffffffff == G->d[0]);
+
+	/* the device steps on word pairs, no low word, a shift across the words and equal operands */
+	x[0] = 1;
+	x[1] = 3;
+	y[0] = 1;
+	y[1] = 1;
+	cu_dev_pair_binary_steps(x, y);
+	assert(1 == x[0] && 0 == x[1] && 1 == y[0] && 0 == y[1]);
+	x[0] = 0x8000000000000001ULL;
+	x[1] = 1;
+	y[0] = 1;
+	y[1] = 0;
+	cu_dev_pair_binary_steps(x, y);
+	assert(3 == x[0] && 0 == x[1] && 1 == y[0] && 0 == y[1]);
+	x[0] = y[0] = 0xffffffffffffffffULL;
+	x[1] = y[1] = 0x7fffffffffffffffULL;
+	cu_dev_pair_binary_steps(x, y);
+	assert(0xffffffffffffffffULL == x[0] && 0x7fffffffffffffffULL == x[1]);
+	/* against the __int128 steps of the host */
+	srand(40231);
+	for (i = 0; i < 1000; i++) {
+		g = (((unsigned __int128)rand() << 96) ^ ((unsigned __int128)rand() << 64) ^ ((unsigned __int128)rand() << 32) ^ rand()) >> (rand() % 100) | 1;
+		h = (((unsigned __int128)rand() << 96) ^ ((unsigned __int128)rand() << 64) ^ ((unsigned __int128)rand() << 32) ^ rand()) >> (rand() % 100) | 1;
+		x[0] = (unsigned long long)g;
+		x[1] = (unsigned long long)(g >> 64);
+		y[0] = (unsigned long long)h;
+		y[1] = (unsigned long long)(h >> 64);
+		while (((g >> 64) || (h >> 64)) && g != h) {
+			if (g < h) {
+				t = g;
+				g = h;
+				h = t;
+			}
+			g -= h;
+			g >>= (unsigned long long)g ? __builtin_ctzll((unsigned long long)g) : 64 + __builtin_ctzll((unsigned long long)(g >> 64));
+		}
+		cu_dev_pair_binary_steps(x, y);
+		assert(x[0] == (unsigned long long)g && x[1] == (unsigned long long)(g >> 64));
+		assert(y[0] == (unsigned long long)h && y[1] == (unsigned long long)(h >> 64));
+	}
+
+	gcd_random_test(cu_dev_hybrid_gcd, 0, 40231, sizes, sizeof(sizes)/sizeof(sizes[0]), 3, CU_DEV_KARY_MAX_BITS / 32);
+	INFO("Test passed\n");
+}
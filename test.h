@@ -11,6 +11,8 @@
 
 #include "cuda_bignum.h"
 #include "files_manager.h"
+#include "weak_pairs.h"
+#include "report_writer.h"
 #include <assert.h>
 #include <time.h>
 
@@ -43,6 +45,16 @@ void unit_test(void);
  */
 void cu_bn_new_test(void);
 
+/** @brief Test U_BN scratch pool
+ *
+ *	Test if numbers and strings taken from the thread scratch pool 
+ *	hold correct values, survive arena overflow and are reclaimed by reset.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_bn_pool_test(void);
+
 /** @brief Test Hw macro
  *
  *	Test if Hw returns correct 32-bit MSB value of 64-bit number.
@@ -321,24 +333,253 @@ void cu_ubn_add_words_test(void);
 
 /** @brief Test q_algorithm_PM
  *
- *	Test if q_algorithm_PM result using Approximate Euclidean 
+ *	Test if q_algorithm_PM result using plus-minus
  *	algorithm is greatest common divisor of two U_BN.
  *
  *  @param Void
  *  @return Void
- *	@bug not completed tests
  */
 void q_algorithm_PM_test(void);
 
 /** @brief Test algorithm_PM
  *
- *	Test if algorithm_PM result using Approximate Euclidean 
+ *	Test if algorithm_PM result using plus-minus
  *	algorithm is greatest common divisor of two U_BN.
  *
  *  @param Void
  *  @return Void
- *	@bug not completed tests
  */
 void algorithm_PM_test(void);
+
+/** @brief Test weak pairs collection
+ *
+ *	Test if findings pushed directly and through a staging buffer 
+ *	are all stored, sorted by key indices and counted when dropped.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void weak_pairs_test(void);
+
+/** @brief Test cu_dev_pair_index
+ *
+ *	Test if cu_dev_pair_index maps every index of the upper triangle
+ *	back to the key pair enumerated by the nested loops in main.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_dev_pair_index_test(void);
+
+/** @brief Test u_bn2bignum
+ *
+ *	Test if u_bn2bignum result of conversion U_BN to BIGNUM 
+ *	returns correct value.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void u_bn2bignum_test(void);
+
+/** @brief Test findings report
+ *
+ *	Test if report_writer writes JSON line with shared prime and 
+ *	cofactors of both keys from its background thread, and escapes
+ *	key paths in JSON lines and CSV rows.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void report_writer_test(void);
+
+/** @brief Test division
+ *
+ *	Test if cu_bn_div returns correct quotient and remainder
+ *	and fails on division by zero.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_bn_div_test(void);
+
+/** @brief Test clusters of keys sharing primes
+ *
+ *	Test if key_clusters joins components, factors keys and
+ *	derives gcd of pairs from known primes or by trial division.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void key_clusters_test(void);
+
+/** @brief Test multiplication
+ *
+ *	Test if cu_bn_mul returns correct product.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_bn_mul_test(void);
+
+/** @brief Test product tree
+ *
+ *	Test if product_tree computes root, remainders modulo every
+ *	leaf and finds leaves sharing a factor with a modulus.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void product_tree_test(void);
+
+/** @brief Test hexadecimal conversion
+ *
+ *	Test if cu_bn_hex2bn converts output of cu_bn_bn2hex back 
+ *	to the same U_BN.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_bn_hex2bn_test(void);
+
+/** @brief Test blacklist of known weak primes
+ *
+ *	Test if prime_blacklist stores primes across save and load 
+ *	and flags moduli sharing a blacklisted prime.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void prime_blacklist_test(void);
+
+/** @brief Test big-endian bytes conversion
+ *
+ *	Test if cu_bn_bin2bn and cu_bn_bn2bin convert between 
+ *	big-endian bytes and U_BN.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_bn_bin2bn_test(void);
+
+/** @brief Test daemon requests
+ *
+ *	Test if key_daemon_handle answers queries against the corpus 
+ *	product and inserts keys into the corpus.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void key_daemon_handle_test(void);
+void product_tree_query_test(void);
+void key_stream_test(void);
+void spill_tree_test(void);
+void product_tree_sparse_test(void);
+void product_tree_scaled_test(void);
+void product_tree_batch_gcd_test(void);
+
+/** @brief Test multiplication of word arrays
+ *
+ *	Test if schoolbook, Karatsuba and Toom-3 products and squares
+ *	match OpenSSL BN_mul and BN_sqr.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_bn_mul_limbs_test(void);
+
+/** @brief Number theoretic transform multiplication test
+ *
+ *	Checks cu_bn_mul_ntt products and squares against schoolbook
+ *	multiplication and the rejection of too long operands.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_bn_mul_ntt_test(void);
+
+/** @brief Division of word arrays test
+ *
+ *	Checks cu_bn_divmod_limbs quotients and remainders of Algorithm D
+ *	and Barrett sizes against OpenSSL BN_div.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_bn_divmod_limbs_test(void);
+
+/** @brief Euclidean algorithm with remainders test
+ *
+ *	Checks cu_dev_bn_umod against BN_mod and cu_dev_classic_euclid
+ *	against BN_gcd, also with keys sharing a prime and zero operands.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_dev_classic_euclid_test(void);
+
+/** @brief Binary algorithm with trailing zero counts test
+ *
+ *	Checks cu_dev_bn_ctz, cu_dev_bn_rshift, cu_dev_bn_sub_rshift and
+ *	cu_dev_ctz_binary_gcd against BN_gcd, also with even operands.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_dev_ctz_binary_gcd_test(void);
+
+/** @brief Plus-minus algorithm test
+ *
+ *	Checks cu_dev_bn_pm_rshift and cu_dev_pm_gcd against BN_gcd,
+ *	also with even operands.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_dev_pm_gcd_test(void);
+
+/** @brief Approximate Euclidean algorithm test
+ *
+ *	Checks cu_dev_bn_abs_submul, including estimates above the
+ *	quotient, and cu_approximate_euclid and
+ *	cu_dev_approximate_euclid against BN_gcd.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_approximate_euclid_test(void);
+
+/** @brief Divsteps algorithm test
+ *
+ *	Checks cu_dev_divsteps_gcd against BN_gcd, also with even
+ *	operands and operands longer than CU_DEV_DIVSTEPS_MAX_BITS.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_dev_divsteps_gcd_test(void);
+
+/** @brief k-ary algorithm test
+ *
+ *	Checks cu_dev_bn_lincomb_rshift and cu_dev_kary_gcd against
+ *	BN_gcd, also with even operands and operands longer than
+ *	CU_DEV_KARY_MAX_BITS.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_dev_kary_gcd_test(void);
+
+/** @brief hybrid algorithm test
+ *
+ *	Checks cu_dev_hybrid_gcd against BN_gcd for operands that
+ *	fit native integers from the start or after k-ary steps,
+ *	also with even operands and operands longer than
+ *	CU_DEV_KARY_MAX_BITS, and the device steps of
+ *	cu_dev_pair_binary_steps against the __int128 ones.
+ *
+ *  @param Void
+ *  @return Void
+ */
+void cu_dev_hybrid_gcd_test(void);
 #endif /* TEST_H */
 
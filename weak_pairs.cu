@@ -0,0 +1,225 @@
+/** @file weak_pairs.cu
+ *  @brief Weak pairs collection
+ *
+ *	Sparse, lock-free collection of key pairs with a non-trivial
+ *	greatest common divisor.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#include "weak_pairs.h"
+
+static void weak_pairs_store(WEAK_PAIRS *wp, unsigned slot, unsigned i, unsigned j, const U_BN *gcd){
+
+    WEAK_PAIR *p = &wp->pairs[slot];
+    int top = (gcd->top < wp->limbs) ? gcd->top : wp->limbs;
+
+    p->i = i;
+    p->j = j;
+    p->gcd.d = wp->words + ((size_t)slot * wp->limbs);
+    p->gcd.top = top;
+    memcpy(p->gcd.d, gcd->d, top * sizeof(unsigned));
+
+}
+
+WEAK_PAIRS *weak_pairs_new(unsigned capacity, int limbs){
+
+    WEAK_PAIRS *wp;
+
+    if ((wp = (WEAK_PAIRS *)malloc(sizeof(*wp))) == NULL)
+        return (NULL);
+    wp->capacity = capacity;
+    wp->count = 0;
+    wp->limbs = limbs;
+    wp->pairs = (WEAK_PAIR *)malloc(((size_t)capacity + 1) * sizeof(WEAK_PAIR));
+    wp->words = (unsigned *)malloc(((size_t)capacity + 1) * limbs * sizeof(unsigned));
+    if (NULL == wp->pairs || NULL == wp->words) {
+        weak_pairs_free(wp);
+        return (NULL);
+    }
+    return (wp);
+
+}
+
+void weak_pairs_free(WEAK_PAIRS *wp){
+
+    if (wp == NULL)
+        return;
+    if (wp->pairs != NULL)
+        free(wp->pairs);
+    if (wp->words != NULL)
+        free(wp->words);
+    free(wp);
+
+}
+
+unsigned weak_pairs_size(const WEAK_PAIRS *wp){
+
+    return ((wp->count < wp->capacity) ? wp->count : wp->capacity);
+
+}
+
+unsigned weak_pairs_dropped(const WEAK_PAIRS *wp){
+
+    return (wp->count - weak_pairs_size(wp));
+
+}
+
+int weak_pairs_push(WEAK_PAIRS *wp, unsigned i, unsigned j, const U_BN *gcd){
+
+    unsigned slot;
+
+    if(NULL == wp || NULL == gcd || NULL == gcd->d)
+        return 0;
+
+    slot = __sync_fetch_and_add(&wp->count, 1);
+    if (slot >= wp->capacity)
+        return 0;
+    weak_pairs_store(wp, slot, i, j, gcd);
+    return (1);
+
+}
+
+int weak_pairs_stage_init(WEAK_PAIRS_STAGE *st, WEAK_PAIRS *out){
+
+    if(NULL == st || NULL == out)
+        return 0;
+
+    st->out = out;
+    st->n = 0;
+    st->words = (unsigned *)malloc(WEAK_PAIRS_STAGE_SIZE * out->limbs * sizeof(unsigned));
+    return (NULL != st->words);
+
+}
+
+int weak_pairs_stage_push(WEAK_PAIRS_STAGE *st, unsigned i, unsigned j, const U_BN *gcd){
+
+    WEAK_PAIR *p;
+    int top;
+
+    if(NULL == st || NULL == gcd || NULL == gcd->d)
+        return 0;
+
+    if (st->n == WEAK_PAIRS_STAGE_SIZE)
+        weak_pairs_stage_flush(st);
+
+    top = (gcd->top < st->out->limbs) ? gcd->top : st->out->limbs;
+    p = &st->pairs[st->n];
+    p->i = i;
+    p->j = j;
+    p->gcd.d = st->words + (st->n * st->out->limbs);
+    p->gcd.top = top;
+    memcpy(p->gcd.d, gcd->d, top * sizeof(unsigned));
+    st->n++;
+    return (1);
+
+}
+
+unsigned weak_pairs_stage_flush(WEAK_PAIRS_STAGE *st){
+
+    unsigned base, k, dropped = 0;
+
+    if(NULL == st || 0 == st->n)
+        return 0;
+
+    /* one atomic add per batch, the copies below do not contend */
+    base = __sync_fetch_and_add(&st->out->count, st->n);
+    for (k = 0; k < st->n; k++) {
+        if (base + k < st->out->capacity)
+            weak_pairs_store(st->out, base + k, st->pairs[k].i, st->pairs[k].j, &st->pairs[k].gcd);
+        else
+            dropped++;
+    }
+    st->n = 0;
+    return (dropped);
+
+}
+
+void weak_pairs_stage_free(WEAK_PAIRS_STAGE *st){
+
+    if (st == NULL)
+        return;
+    weak_pairs_stage_flush(st);
+    if (st->words != NULL)
+        free(st->words);
+    st->words = NULL;
+
+}
+
+static int weak_pairs_cmp(const void *a, const void *b){
+
+    const WEAK_PAIR *pa = (const WEAK_PAIR *)a;
+    const WEAK_PAIR *pb = (const WEAK_PAIR *)b;
+
+    if (pa->i != pb->i)
+        return ((pa->i > pb->i) ? 1 : -1);
+    if (pa->j != pb->j)
+        return ((pa->j > pb->j) ? 1 : -1);
+    return (0);
+
+}
+
+void weak_pairs_sort(WEAK_PAIRS *wp){
+
+    if (wp == NULL)
+        return;
+    qsort(wp->pairs, weak_pairs_size(wp), sizeof(WEAK_PAIR), weak_pairs_cmp);
+
+}
+
+WEAK_PAIRS *weak_pairs_to_device(const WEAK_PAIRS *wp){
+
+    WEAK_PAIRS dev, *device_wp = NULL;
+
+    dev = *wp;
+    dev.count = 0;
+    if (cudaSuccess != cudaMalloc((void**)&dev.pairs, ((size_t)wp->capacity + 1) * sizeof(WEAK_PAIR)))
+        return (NULL);
+    if (cudaSuccess != cudaMalloc((void**)&dev.words, ((size_t)wp->capacity + 1) * wp->limbs * sizeof(unsigned))) {
+        cudaFree(dev.pairs);
+        return (NULL);
+    }
+    if (cudaSuccess != cudaMalloc((void**)&device_wp, sizeof(WEAK_PAIRS))) {
+        cudaFree(dev.pairs);
+        cudaFree(dev.words);
+        return (NULL);
+    }
+    cudaMemcpy(device_wp, &dev, sizeof(WEAK_PAIRS), cudaMemcpyHostToDevice);
+    return (device_wp);
+
+}
+
+int weak_pairs_from_device(WEAK_PAIRS *wp, const WEAK_PAIRS *device_wp){
+
+    WEAK_PAIRS dev;
+    unsigned k, n;
+
+    if (cudaSuccess != cudaMemcpy(&dev, device_wp, sizeof(WEAK_PAIRS), cudaMemcpyDeviceToHost))
+        return 0;
+
+    wp->count = dev.count;
+    n = weak_pairs_size(wp);
+    if (n) {
+        cudaMemcpy(wp->pairs, dev.pairs, n * sizeof(WEAK_PAIR), cudaMemcpyDeviceToHost);
+        cudaMemcpy(wp->words, dev.words, (size_t)n * wp->limbs * sizeof(unsigned), cudaMemcpyDeviceToHost);
+    }
+    /* gcd limbs point into device memory, rebase them on the host copy */
+    for (k = 0; k < n; k++)
+        wp->pairs[k].gcd.d = wp->words + ((size_t)k * wp->limbs);
+    return (1);
+
+}
+
+void weak_pairs_device_free(WEAK_PAIRS *device_wp){
+
+    WEAK_PAIRS dev;
+
+    if (device_wp == NULL)
+        return;
+    if (cudaSuccess == cudaMemcpy(&dev, device_wp, sizeof(WEAK_PAIRS), cudaMemcpyDeviceToHost)) {
+        cudaFree(dev.pairs);
+        cudaFree(dev.words);
+    }
+    cudaFree(device_wp);
+
+}
@@ -0,0 +1,179 @@
+/** @file weak_pairs.h
+ *  @brief Weak pairs collection
+ *
+ *	Sparse, lock-free collection of key pairs with a non-trivial
+ *	greatest common divisor. Only findings are stored, so coprime
+ *	pairs cost a single cu_bn_is_one() check.
+ *
+ *  @author Przemysław Karbownik (pkarbownik)
+ */
+
+#ifndef WEAK_PAIRS_H
+#define WEAK_PAIRS_H
+
+#include "cuda_bignum.h"
+
+#define WEAK_PAIRS_STAGE_SIZE   32
+#define WEAK_PAIRS_DEFAULT_SIZE 65536
+
+struct   __WEAK_PAIR__{
+    unsigned i;
+    unsigned j;
+    U_BN     gcd;
+};
+
+typedef struct __WEAK_PAIR__     WEAK_PAIR;
+
+struct   __WEAK_PAIRS__{
+    WEAK_PAIR* pairs;
+    unsigned*  words;
+    unsigned   capacity;
+    unsigned   count;
+    int        limbs;
+};
+
+typedef struct __WEAK_PAIRS__     WEAK_PAIRS;
+
+struct   __WEAK_PAIRS_STAGE__{
+    WEAK_PAIRS* out;
+    WEAK_PAIR   pairs[WEAK_PAIRS_STAGE_SIZE];
+    unsigned*   words;
+    unsigned    n;
+};
+
+typedef struct __WEAK_PAIRS_STAGE__     WEAK_PAIRS_STAGE;
+
+
+/** @brief Allocates weak pairs collection
+ *
+ *	Allocates room for capacity findings with gcd of up to limbs words.
+ *	Findings past capacity are counted but not stored.
+ *
+ *  @param[in] capacity maximum number of stored findings
+ *  @param[in] limbs maximum size of stored gcd in words
+ *  @return empty WEAK_PAIRS or NULL on failure
+ */
+WEAK_PAIRS *weak_pairs_new(unsigned capacity, int limbs);
+
+/** @brief Frees weak pairs collection
+ *
+ *	Frees weak pairs collection allocated by weak_pairs_new().
+ *
+ *  @param[in] wp WEAK_PAIRS structure
+ *  @return Void
+ */
+void weak_pairs_free(WEAK_PAIRS *wp);
+
+/** @brief Returns number of stored findings
+ *
+ *	Returns number of stored findings.
+ *
+ *  @param[in] wp WEAK_PAIRS structure
+ *  @return number of stored findings
+ */
+unsigned weak_pairs_size(const WEAK_PAIRS *wp);
+
+/** @brief Returns number of findings that did not fit
+ *
+ *	Returns number of findings reported after the collection was full.
+ *
+ *  @param[in] wp WEAK_PAIRS structure
+ *  @return number of dropped findings
+ */
+unsigned weak_pairs_dropped(const WEAK_PAIRS *wp);
+
+/** @brief Appends a finding to the collection
+ *
+ *	Reserves a slot with a single atomic add, so any number of
+ *	threads may push concurrently.
+ *
+ *  @param[in,out] wp WEAK_PAIRS structure
+ *  @param[in] i index of first key
+ *  @param[in] j index of second key
+ *  @param[in] gcd greatest common divisor of both keys
+ *  @return 1 on success, 0 if the collection is full
+ */
+int weak_pairs_push(WEAK_PAIRS *wp, unsigned i, unsigned j, const U_BN *gcd);
+
+/** @brief Initializes per-thread staging buffer
+ *
+ *	Initializes per-thread staging buffer merged into out in batches
+ *	of WEAK_PAIRS_STAGE_SIZE findings.
+ *
+ *  @param[in,out] st WEAK_PAIRS_STAGE structure
+ *  @param[in] out shared WEAK_PAIRS collection
+ *  @return 1 on success
+ */
+int weak_pairs_stage_init(WEAK_PAIRS_STAGE *st, WEAK_PAIRS *out);
+
+/** @brief Appends a finding to the staging buffer
+ *
+ *	Appends a finding to the staging buffer and merges the buffer
+ *	into the shared collection once it is full.
+ *
+ *  @param[in,out] st WEAK_PAIRS_STAGE structure
+ *  @param[in] i index of first key
+ *  @param[in] j index of second key
+ *  @param[in] gcd greatest common divisor of both keys
+ *  @return 1 on success
+ */
+int weak_pairs_stage_push(WEAK_PAIRS_STAGE *st, unsigned i, unsigned j, const U_BN *gcd);
+
+/** @brief Merges the staging buffer into the shared collection
+ *
+ *	Reserves all staged slots with one atomic add and copies them.
+ *
+ *  @param[in,out] st WEAK_PAIRS_STAGE structure
+ *  @return number of findings that did not fit
+ */
+unsigned weak_pairs_stage_flush(WEAK_PAIRS_STAGE *st);
+
+/** @brief Frees the staging buffer
+ *
+ *	Flushes and frees the staging buffer.
+ *
+ *  @param[in,out] st WEAK_PAIRS_STAGE structure
+ *  @return Void
+ */
+void weak_pairs_stage_free(WEAK_PAIRS_STAGE *st);
+
+/** @brief Sorts findings by key indices
+ *
+ *	Sorts findings by (i, j), so results are reproducible regardless
+ *	of the order in which threads pushed them.
+ *
+ *  @param[in,out] wp WEAK_PAIRS structure
+ *  @return Void
+ */
+void weak_pairs_sort(WEAK_PAIRS *wp);
+
+/** @brief Allocates weak pairs collection in device memory
+ *
+ *	Allocates an empty device copy of a collection with the same
+ *	capacity and gcd size as wp.
+ *
+ *  @param[in] wp host WEAK_PAIRS structure
+ *  @return device pointer to WEAK_PAIRS or NULL on failure
+ */
+WEAK_PAIRS *weak_pairs_to_device(const WEAK_PAIRS *wp);
+
+/** @brief Copies findings from device memory
+ *
+ *	Copies only the stored findings of device_wp back into wp.
+ *
+ *  @param[in,out] wp host WEAK_PAIRS structure
+ *  @param[in] device_wp device WEAK_PAIRS structure
+ *  @return 1 on success
+ */
+int weak_pairs_from_device(WEAK_PAIRS *wp, const WEAK_PAIRS *device_wp);
+
+/** @brief Frees weak pairs collection in device memory
+ *
+ *	Frees collection allocated by weak_pairs_to_device().
+ *
+ *  @param[in] device_wp device WEAK_PAIRS structure
+ *  @return Void
+ */
+void weak_pairs_device_free(WEAK_PAIRS *device_wp);
+
+#endif /* WEAK_PAIRS_H */